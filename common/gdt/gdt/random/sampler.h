@@ -0,0 +1,212 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+
+namespace gdt {
+
+  /*! reverse the bits of a 32-bit word */
+  inline __both__ uint32_t reverseBits(uint32_t x)
+  {
+#ifdef __CUDA_ARCH__
+    return __brev(x);
+#else
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+#endif
+  }
+
+  /*! cheap, well-mixing 32-bit integer hash (c. wellons' lowbias32) */
+  inline __both__ uint32_t hash32(uint32_t x)
+  {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+  }
+
+  inline __both__ uint32_t hashCombine(uint32_t seed, uint32_t v)
+  {
+    return seed ^ (hash32(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+  }
+
+  /*! base-2 owen scrambling of a 32-bit fixed point value in [0,1),
+      via a hash-based laine-karras permutation (burley, "practical
+      hash-based owen scrambling", jcgt 2020; with n. vegdahl's
+      improved constants, which stay well-scrambled when many pixels
+      share one seed, as the blue-noise mode below does) */
+  inline __both__ uint32_t owenScramble(uint32_t x, uint32_t seed)
+  {
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+  }
+
+  /*! the first two dimensions of the sobol sequence, as 32-bit fixed
+      point values: the van der corput sequence, and the one generated
+      by the pascal matrix */
+  inline __both__ uint32_t sobolDim0(uint32_t index)
+  {
+    return reverseBits(index);
+  }
+
+  inline __both__ uint32_t sobolDim1(uint32_t index)
+  {
+    uint32_t result = 0u;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+      if (index & 1u) result ^= v;
+    return result;
+  }
+
+  /*! 32-bit fixed point to float in [0,1) */
+  inline __both__ float fixedToFloat(uint32_t x)
+  {
+    return float(x >> 8) * (1.f / float(1 << 24));
+  }
+
+  /*! interleave the lower 16 bits of x and y */
+  inline __both__ uint32_t mortonCode2D(uint32_t x, uint32_t y)
+  {
+    x &= 0x0000ffffu;                  y &= 0x0000ffffu;
+    x = (x | (x << 8)) & 0x00ff00ffu;  y = (y | (y << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;  y = (y | (y << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;  y = (y | (y << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;  y = (y | (y << 1)) & 0x55555555u;
+    return x | (y << 1);
+  }
+
+  /*! base-4 owen scrambling of a 2*levels-bit morton code: the four
+      children of every quadtree node get their own random order */
+  inline __both__ uint32_t scrambleMortonCode(uint32_t code, int levels,
+                                              uint32_t seed)
+  {
+    uint32_t result = 0u;
+    for (int level=levels-1;level>=0;level--) {
+      const uint32_t prefix = code >> (2*level+2);
+      const uint32_t digit  = (code >> (2*level)) & 3u;
+      // random permutation of 0..3 for this node, fisher-yates
+      uint32_t h = hashCombine(seed,hashCombine(prefix,(uint32_t)level));
+      uint32_t perm = 0xe4u; // (3,2,1,0), two bits each
+      for (uint32_t i=3;i>0;i--) {
+        const uint32_t j  = (h % (i+1));  h /= (i+1);
+        const uint32_t pi = (perm >> (2*i)) & 3u, pj = (perm >> (2*j)) & 3u;
+        perm &= ~((3u << (2*i)) | (3u << (2*j)));
+        perm |= (pj << (2*i)) | (pi << (2*j));
+      }
+      result = (result << 2) | ((perm >> (2*digit)) & 3u);
+    }
+    return result;
+  }
+
+  /*! owen-scrambled sobol sampler, padded: every call draws from a new
+      dimension (pair), each of which shuffles the sample index and
+      scrambles the points with its own seed. the state is just the
+      sample index and the current dimension's seed, so it's as cheap
+      to set up - and to carry around in two payload registers - as an
+      LCG, but samples are stratified along each path dimension.
+
+      initPixel() gives every pixel its own independently scrambled
+      sequence; initBlueNoise() instead makes all pixels share one
+      sequence, in (randomly permuted) morton order of the pixels
+      (ahmed & wonka,
+      "screen-space blue-noise diffusion of monte carlo sampling
+      error via hierarchical ordering of pixels", 2020), so
+      neighboring pixels get complementary samples and their error
+      ends up as blue noise */
+  struct OwenSobolSampler {
+    
+    inline __both__ OwenSobolSampler()
+    { /* intentionally empty so we can use it in device vars that
+         don't allow dynamic initialization (ie, PRD) */
+    }
+
+    /*! sample 'sampleIndex' of the pixel's own sequence */
+    inline __both__ void initPixel(uint32_t pixelID, uint32_t sampleIndex,
+                                   uint32_t seed = 0u)
+    {
+      index      = sampleIndex;
+      this->seed = hashCombine(hash32(pixelID),seed);
+    }
+
+    /*! sample 'sampleIndex' of pixel (x,y) in a frame of the given
+        size, from the sequence shared by all pixels. each pixel gets a
+        run of samplesPerPixel (rounded up to a power of two)
+        consecutive points, so any 2x2, 4x4, ... block of pixels
+        together covers a stratified set; every further run of that
+        many samples (ie, every frame) gets a fresh scramble */
+    inline __both__ void initBlueNoise(const vec2i &pixel, const vec2i &frameSize,
+                                       uint32_t sampleIndex, int samplesPerPixel,
+                                       uint32_t seed = 0u)
+    {
+      int levels = 0;
+      while ((1 << levels) < frameSize.x || (1 << levels) < frameSize.y)
+        levels++;
+      int sampleBits = 0;
+      while ((1 << sampleBits) < samplesPerPixel && sampleBits < 32 - 2*levels)
+        sampleBits++;
+      const uint32_t run   = sampleIndex >> sampleBits;
+      const uint32_t inRun = sampleIndex & ((1u << sampleBits) - 1u);
+      this->seed = hashCombine(hash32(run),seed);
+      const uint32_t pixelIndex
+        = scrambleMortonCode(mortonCode2D(pixel.x,pixel.y),levels,this->seed);
+      index      = (pixelIndex << sampleBits) | inRun;
+    }
+
+    /*! the next dimension, as a float in [0,1) */
+    inline __both__ float operator() ()
+    {
+      const uint32_t shuffled = owenScramble(index,seed);
+      const float u = fixedToFloat(owenScramble(sobolDim0(shuffled),
+                                                hashCombine(seed,0u)));
+      advance();
+      return u;
+    }
+
+    /*! the next two dimensions, stratified jointly */
+    inline __both__ vec2f next2D()
+    {
+      const uint32_t shuffled = owenScramble(index,seed);
+      const vec2f u(fixedToFloat(owenScramble(sobolDim0(shuffled),
+                                              hashCombine(seed,0u))),
+                    fixedToFloat(owenScramble(sobolDim1(shuffled),
+                                              hashCombine(seed,1u))));
+      advance();
+      return u;
+    }
+
+    inline __both__ void advance()
+    { seed = hash32(seed + 0x9e3779b9u); }
+    
+    /*! which point of the sequence */
+    uint32_t index;
+    /*! scramble seed of the current dimension */
+    uint32_t seed;
+  };
+
+} // ::gdt
@@ -15,6 +15,8 @@
 // ======================================================================== //
 
 #include "GLFWindow.h"
+#include <exception>
+#include <thread>
 #include "../imgui-1.87/imgui.h"
 #include "../imgui-1.87/backends/imgui_impl_glfw.h"
 #include "../imgui-1.87/backends/imgui_impl_opengl3.h"
@@ -96,8 +98,14 @@ namespace opz {
     //glfwSetMouseButtonCallback(handle, glfwindow_mouseButton_cb);
     //glfwSetCursorPosCallback(handle, glfwindow_mouseMotion_cb);
     
+    if (renderThread) {
+      runRenderThread();
+      return;
+    }
     while (!glfwWindowShouldClose(handle)) {
+      postUpdates();
       render();
+      numRendered++;
       draw();
         
       CameraMove();
@@ -106,6 +114,68 @@ namespace opz {
     }
   }
 
+  std::unique_lock<std::mutex> GLFWindow::lockRender()
+  {
+    {
+      std::lock_guard<std::mutex> handoff(handoffMutex);
+      uiWaiting++;
+    }
+    std::unique_lock<std::mutex> lock(renderMutex);
+    bool lastWaiting;
+    {
+      std::lock_guard<std::mutex> handoff(handoffMutex);
+      lastWaiting = (--uiWaiting == 0);
+    }
+    if (lastWaiting) uiDone.notify_all();
+    return lock;
+  }
+
+  /*! render() runs back to back on a thread of its own, while this
+      one polls events and draws at whatever rate swapping allows.
+      event callbacks run with render() locked out; draw() and
+      postUpdates() lock it out themselves where they need to */
+  void GLFWindow::runRenderThread()
+  {
+    std::atomic<bool>  stopping{ false };
+    std::exception_ptr renderError;
+    std::thread renderer([this,&stopping,&renderError] {
+        try {
+          while (!stopping) {
+            {
+              std::unique_lock<std::mutex> handoff(handoffMutex);
+              uiDone.wait(handoff,[this]{ return uiWaiting == 0; });
+            }
+            std::lock_guard<std::mutex> lock(renderMutex);
+            render();
+            numRendered++;
+          }
+        } catch (...) {
+          // (main's catch is on the ui thread; hand it over there)
+          renderError = std::current_exception();
+          stopping    = true;
+        }
+      });
+    try {
+      while (!stopping && !glfwWindowShouldClose(handle)) {
+        postUpdates();
+        draw();
+
+        CameraMove();
+        glfwSwapBuffers(handle);
+        auto lock = lockRender();
+        glfwPollEvents();
+      }
+    } catch (...) {
+      stopping = true;
+      renderer.join();
+      throw;
+    }
+    stopping = true;
+    renderer.join();
+    if (renderError)
+      std::rethrow_exception(renderError);
+  }
+
   // GLFWindow *GLFWindow::current = nullptr;
   
 } // ::osc
@@ -22,6 +22,10 @@
 // glfw framework
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
+// for the render thread
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 /*! \namespace opz - Optix ZYM-PKU */
 namespace opz {
@@ -360,12 +364,42 @@ namespace opz {
       virtual void render() {}
       /*draw pixels on the screen ... */
       virtual void draw() {}
+      /*! hand what input changed over to render(); always called on
+          the ui thread, right before render() or draw() */
+      virtual void postUpdates() {}
 
       void run();
 
+      /*! lock out render() while the ui thread touches anything it
+          uses; with no render thread, it's never contended */
+      std::unique_lock<std::mutex> lockRender();
+
       /*! the glfw window handle */
       GLFWwindow* handle{ nullptr };
 
+      /*! call render() on a thread of its own, back to back, instead
+          of once per displayed frame: the ui thread only handles
+          input and draws - at vsync - whatever frame is newest. an
+          exception render() throws stops both, and gets rethrown
+          from run() */
+      bool renderThread{ false };
+
+      /*! render() calls so far */
+      std::atomic<long long> numRendered{ 0 };
+
+  private:
+      void runRenderThread();
+
+      /*! held around every render() on the render thread */
+      std::mutex              renderMutex;
+      /*! @{ ui threads waiting for renderMutex; the render thread
+          sleeps on uiDone until they had their turn, rather than
+          grabbing the mutex right back */
+      std::mutex              handoffMutex;
+      std::condition_variable uiDone;
+      int                     uiWaiting{ 0 };
+      /*! @} */
+
   };
 
 
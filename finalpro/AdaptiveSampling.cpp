@@ -0,0 +1,144 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#include "AdaptiveSampling.h"
+#include "Checks.h"
+#include "gdt/random/random.h"
+// std
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  typedef gdt::LCG<16> Random;
+
+  /*! the simulated pixels of checkAdaptiveSampling: all have mean .5,
+      but differ in how noisy they are */
+  enum { FLAT_PIXEL=0, SMOOTH_PIXEL, SPIKY_PIXEL, PIXEL_KIND_COUNT };
+
+  static float simulatedSample(int kind, Random &random)
+  {
+    switch (kind) {
+    case FLAT_PIXEL:   return .5f;
+    case SMOOTH_PIXEL: return random();                     // uniform [0,1)
+    default:           return random() < .25f ? 2.f : 0.f;  // bernoulli
+    }
+  }
+
+  bool checkAdaptiveSampling()
+  {
+    beginCheck("adaptive sampling error estimates");
+    Random random(0,0);
+    bool ok = true;
+
+    // welford vs two-pass
+    {
+      std::vector<float> values(10000);
+      vec4f stats(0.f);
+      for (auto &v : values) { v = 10.f*random()*random(); addPixelSample(stats,v); }
+      double mean = 0., variance = 0.;
+      for (auto v : values) mean += v;
+      mean /= values.size();
+      for (auto v : values) variance += (v-mean)*(v-mean);
+      variance /= values.size()-1;
+      const bool match
+        = fabs(stats.y-mean) < 1e-4*mean && fabs(pixelVariance(stats)-variance) < 1e-3*variance;
+      std::cout << "  welford mean/variance " << stats.y << "/" << pixelVariance(stats)
+                << ", two-pass " << mean << "/" << variance
+                << (match ? "" : "  <-- FAILED") << std::endl;
+      ok &= match;
+    }
+
+    // the predicted error of a pixel's mean should match its actual
+    // error, over many trials
+    for (int kind=SMOOTH_PIXEL;kind<PIXEL_KIND_COUNT;kind++) {
+      const int numTrials = 4096, numSamples = 64;
+      double sumPredicted = 0., sumActual = 0.;
+      for (int trial=0;trial<numTrials;trial++) {
+        vec4f stats(0.f);
+        for (int i=0;i<numSamples;i++) addPixelSample(stats,simulatedSample(kind,random));
+        const double error = stats.y - .5;
+        sumActual    += error*error;
+        sumPredicted += pixelVariance(stats)/stats.x;
+      }
+      const double ratio = sqrt(sumPredicted/sumActual);
+      const bool match = fabs(ratio-1.) < .1;
+      std::cout << "  predicted/actual error of the mean, "
+                << (kind == SMOOTH_PIXEL ? "smooth" : "spiky") << " pixels: "
+                << ratio << (match ? "" : "  <-- FAILED") << std::endl;
+      ok &= match;
+    }
+
+    // a simulated image, one third each flat, smooth and spiky pixels,
+    // sampled frame by frame until they all converge
+    {
+      const int   numPixels   = 3*1024;
+      const int   baseSamples = 4;
+      const float threshold   = .02f;
+      // (with fewer, one in a hundred spiky pixels sees 16 zeros in a
+      // row and calls itself converged)
+      const int   minSamples  = 64;
+      const float maxScale    = 4.f;
+      const int   maxFrames   = 4096;
+      std::vector<vec4f> stats(numPixels,vec4f(0.f));
+      size_t totalSamples = 0;
+      int frameID = 0, numActive = numPixels;
+      for (;frameID<maxFrames && numActive > 0;frameID++) {
+        numActive = 0;
+        for (int pixelID=0;pixelID<numPixels;pixelID++) {
+          const int n = adaptiveSampleCount(stats[pixelID],baseSamples,
+                                            threshold,minSamples,maxScale);
+          if (n == 0) continue;
+          numActive++;
+          for (int i=0;i<n;i++)
+            addPixelSample(stats[pixelID],simulatedSample(pixelID%PIXEL_KIND_COUNT,random));
+          totalSamples += n;
+        }
+      }
+      // actual relative errors per kind of pixel, and the most
+      // samples any pixel needed - which uniform sampling would have
+      // had to spend on all of them
+      double sumError[PIXEL_KIND_COUNT] = { 0., 0., 0. };
+      float  maxCount = 0.f;
+      for (int pixelID=0;pixelID<numPixels;pixelID++) {
+        const double error = (stats[pixelID].y - .5)/.5;
+        sumError[pixelID%PIXEL_KIND_COUNT] += error*error;
+        maxCount = std::max(maxCount,stats[pixelID].x);
+      }
+      const double uniformSamples = double(maxCount)*numPixels;
+      std::cout << "  simulated image converged after " << frameID << " frames, "
+                << prettyNumber(totalSamples) << " samples (uniform: "
+                << prettyNumber(size_t(uniformSamples)) << ")" << std::endl;
+      ok &= (numActive == 0 && totalSamples < uniformSamples);
+      for (int kind=0;kind<PIXEL_KIND_COUNT;kind++) {
+        const double rmsError = sqrt(sumError[kind]/(numPixels/PIXEL_KIND_COUNT));
+        // stopping on an estimate lets a few pixels stop early, so
+        // allow some slack over the threshold
+        const bool converged = rmsError <= 1.5*threshold;
+        std::cout << "    "
+                  << (kind == FLAT_PIXEL ? "flat  " : kind == SMOOTH_PIXEL ? "smooth" : "spiky ")
+                  << " pixels: rms relative error " << rmsError
+                  << (converged ? "" : "  <-- FAILED") << std::endl;
+        ok &= converged;
+      }
+    }
+    
+    return endCheck("adaptive sampling",ok);
+  }
+  
+} // ::opz
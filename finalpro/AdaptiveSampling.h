@@ -0,0 +1,89 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  // ------------------------------------------------------------------
+  // per-pixel error estimation for adaptive sampling, shared by the
+  // raygen program and the host-side checks in AdaptiveSampling.cpp.
+  // a pixel's statistics are one float4 (so they live in a buffer
+  // next to the color buffer): x = number of samples, y = running
+  // mean and z = running sum of squared deviations of the samples'
+  // luminance (welford), w = samples it took in the last frame
+  // ------------------------------------------------------------------
+
+  inline __both__ float luminance(const vec3f &c)
+  {
+    return 0.2126f*c.x + 0.7152f*c.y + 0.0722f*c.z;
+  }
+
+  /*! welford update of a pixel's statistics with one sample */
+  inline __both__ void addPixelSample(vec4f &stats, float value)
+  {
+    stats.x += 1.f;
+    const float delta = value - stats.y;
+    stats.y += delta / stats.x;
+    stats.z += delta * (value - stats.y);
+  }
+
+  /*! unbiased sample variance */
+  inline __both__ float pixelVariance(const vec4f &stats)
+  {
+    return stats.x > 1.f ? stats.z / (stats.x - 1.f) : 0.f;
+  }
+
+  /*! estimated standard error of the pixel's mean, relative to the
+      mean; 'floor' keeps (almost) black pixels from demanding
+      samples forever */
+  inline __both__ float pixelRelativeError(const vec4f &stats, float floor = 1e-2f)
+  {
+    if (stats.x < 2.f) return 1e20f;
+    return sqrtf(pixelVariance(stats) / stats.x) / (fabsf(stats.y) + floor);
+  }
+
+  /*! how many samples a pixel gets this frame: 'baseSamples' until it
+      has minSamples to trust its variance, then none once its
+      relative error is below 'threshold', and otherwise more the
+      noisier it is, up to maxScale times baseSamples */
+  inline __both__ int adaptiveSampleCount(const vec4f &stats,
+                                          int baseSamples,
+                                          float threshold,
+                                          int minSamples,
+                                          float maxScale)
+  {
+    if (stats.x < float(minSamples)) return baseSamples;
+    const float error = pixelRelativeError(stats);
+    if (error <= threshold) return 0;
+    const float scale = error/threshold < maxScale ? error/threshold : maxScale;
+    return int(ceilf(baseSamples * scale));
+  }
+
+  /*! host-side checks of the above: that the welford statistics match
+      a two-pass computation, that the error estimate predicts the
+      actual error of the mean, and that a simulated image of flat and
+      noisy pixels converges with fewer samples than uniform
+      sampling. prints what it finds, and returns true if all pass */
+  bool checkAdaptiveSampling();
+  
+} // ::opz
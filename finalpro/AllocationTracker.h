@@ -0,0 +1,132 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+// common std stuff
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+/*! the file and line of whoever called the function these are the
+    default arguments of - which is how CUDABuffer knows who's
+    allocating, without every caller having to say */
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+# define OPZ_CALLER_FILE __builtin_FILE()
+# define OPZ_CALLER_LINE __builtin_LINE()
+#else
+# define OPZ_CALLER_FILE "unknown"
+# define OPZ_CALLER_LINE 0
+#endif
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! counts the device memory CUDABuffer allocates - in total, and
+      per call site - and polices HotPathScopes: code in one should
+      never allocate (steady-state frames are meant to allocate
+      nothing), so allocations there get counted separately, and in
+      strict mode (the default for debug builds) throw */
+  struct AllocationTracker {
+    struct Site {
+      size_t numAllocs = 0;
+      size_t numBytes  = 0;
+    };
+
+    static AllocationTracker &get()
+    {
+      static AllocationTracker tracker;
+      return tracker;
+    }
+
+    void recordAlloc(size_t bytes, const char *file, int line)
+    {
+      const std::string site = siteName(file,line);
+      numAllocs++;
+      numBytes  += bytes;
+      liveBytes += bytes;
+      Site &s = sites[site];
+      s.numAllocs++;
+      s.numBytes += bytes;
+      if (hotPathDepth > 0) {
+        numHotPathAllocs++;
+        if (strict)
+          throw std::runtime_error("#osc: "+site+" allocated "+std::to_string(bytes)
+                                   +" bytes of device memory on the render loop's hot path");
+      }
+    }
+
+    void recordFree(size_t bytes)
+    {
+      numFrees++;
+      liveBytes -= bytes;
+    }
+
+    /*! print totals, and the sites sorted by how often they allocated */
+    void print() const
+    {
+      std::cout << "#osc: " << numAllocs << " device allocations ("
+                << (numBytes>>20) << "MB), " << numFrees << " frees, "
+                << (liveBytes>>20) << "MB live, "
+                << numHotPathAllocs << " on the hot path" << std::endl;
+      std::multimap<size_t,std::string,std::greater<size_t>> byCount;
+      for (auto &site : sites) byCount.insert({site.second.numAllocs,site.first});
+      for (auto &entry : byCount) {
+        const Site &s = sites.at(entry.second);
+        std::cout << "  " << entry.second << ": " << s.numAllocs << "x, "
+                  << s.numBytes << " bytes" << std::endl;
+      }
+    }
+
+    size_t numAllocs        = 0;
+    size_t numFrees         = 0;
+    size_t numBytes         = 0;
+    size_t liveBytes        = 0;
+    size_t numHotPathAllocs = 0;
+    std::map<std::string,Site> sites;
+    /*! nesting depth of HotPathScopes */
+    int    hotPathDepth     = 0;
+#ifdef NDEBUG
+    bool   strict           = false;
+#else
+    bool   strict           = true;
+#endif
+
+  private:
+    /*! file name (without its directory) and line */
+    static std::string siteName(const char *file, int line)
+    {
+      std::string name = file ? file : "unknown";
+      const size_t slash = name.find_last_of("/\\");
+      if (slash != std::string::npos) name = name.substr(slash+1);
+      return name+":"+std::to_string(line);
+    }
+  };
+
+  /*! marks a stretch of code - like render()'s per-frame work - that
+      must not allocate device memory */
+  struct HotPathScope {
+    HotPathScope()  { AllocationTracker::get().hotPathDepth++; }
+    ~HotPathScope() { AllocationTracker::get().hotPathDepth--; }
+  };
+  
+} // ::opz
@@ -0,0 +1,371 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+
+#include "AtrousDenoiser.h"
+#include "Checks.h"
+#include "ThreadPool.h"
+#include "gdt/random/random.h"
+// std
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define OPZ_ATROUS_SSE 1
+#endif
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! the B3-spline: each pass's 5x5 kernel is its outer product */
+  static const float B3[5] = { 1.f/16.f, 1.f/4.f, 3.f/8.f, 1.f/4.f, 1.f/16.f };
+
+  /*! run job(begin,end) over bands of rows [0,numRows) - on the
+      pool's threads if there is one, and wait for all of them */
+  template<typename Job>
+  static void forEachBand(ThreadPool *pool, int numRows, const Job &job)
+  {
+    if (!pool || pool->size() < 2 || numRows < 2) {
+      job(0,numRows);
+      return;
+    }
+    // (a few bands per thread, so uneven ones even out)
+    const int numBands = std::min(numRows,4*pool->size());
+    for (int band=0;band<numBands;band++) {
+      const int begin = int((long long)numRows*band/numBands);
+      const int end   = int((long long)numRows*(band+1)/numBands);
+      pool->enqueue([&job,begin,end]{ job(begin,end); });
+    }
+    pool->wait();
+  }
+
+  /*! albedo we divide color by: channels too dark to say anything
+      (like the background's) are left alone */
+  inline float demodulation(float albedo)
+  {
+    return albedo > 1e-3f ? albedo : 1.f;
+  }
+  
+  void AtrousDenoiser::denoise(const vec4f *inColor, const vec4f *inAlbedo,
+                               const vec4f *inNormal, const vec2i &newSize,
+                               vec4f *output, ThreadPool *pool)
+  {
+    size = newSize;
+    if (size.x <= 0 || size.y <= 0) return;
+    const size_t numPixels = size_t(size.x)*size.y;
+    for (int c=0;c<3;c++) {
+      color[0][c].resize(numPixels);
+      color[1][c].resize(numPixels);
+      tone[0][c].resize(numPixels);
+      tone[1][c].resize(numPixels);
+      albedo[c].resize(numPixels);
+      normal[c].resize(numPixels);
+    }
+
+    // demodulate, and split into planes
+    forEachBand(pool,size.y,[&](int begin, int end) {
+        for (size_t i=size_t(begin)*size.x;i<size_t(end)*size.x;i++) {
+          const vec3f N = vec3f(inNormal[i]);
+          const float len = length(N);
+          for (int c=0;c<3;c++) {
+            const float a = inAlbedo[i][c];
+            const float v = inColor[i][c] / demodulation(a);
+            color[0][c][i] = v;
+            tone[0][c][i]  = v/(1.f+v);
+            albedo[c][i]   = a;
+            // (missing normals stay zero, and match nothing)
+            normal[c][i]   = len > 0.f ? N[c]/len : 0.f;
+          }
+        }
+      });
+
+    int src = 0;
+    for (int pass=0;pass<numPasses;pass++) {
+      forEachBand(pool,size.y,[&](int begin, int end) {
+          filterRows(pass,begin,end,src,1-src);
+        });
+      src = 1-src;
+    }
+
+    // ... and modulate back
+    forEachBand(pool,size.y,[&](int begin, int end) {
+        for (size_t i=size_t(begin)*size.x;i<size_t(end)*size.x;i++)
+          output[i] = vec4f(color[src][0][i]*demodulation(albedo[0][i]),
+                            color[src][1][i]*demodulation(albedo[1][i]),
+                            color[src][2][i]*demodulation(albedo[2][i]),
+                            1.f);
+      });
+  }
+
+  void AtrousDenoiser::filterRows(int pass, int begin, int end, int src, int dst)
+  {
+    const int   step = 1<<pass;
+    const float sigmaC = sigmaColor/float(step);
+    const float invSigmaC2 = 1.f/(sigmaC*sigmaC);
+    const float invSigmaA2 = 1.f/(sigmaAlbedo*sigmaAlbedo);
+    int numSquarings = 0;
+    while ((1<<numSquarings) < normalPower) numSquarings++;
+
+    const float *srcR = color[src][0].data();
+    const float *srcG = color[src][1].data();
+    const float *srcB = color[src][2].data();
+    const float *tR = tone[src][0].data();
+    const float *tG = tone[src][1].data();
+    const float *tB = tone[src][2].data();
+    const float *aR = albedo[0].data();
+    const float *aG = albedo[1].data();
+    const float *aB = albedo[2].data();
+    const float *nX = normal[0].data();
+    const float *nY = normal[1].data();
+    const float *nZ = normal[2].data();
+    float *dstR = color[dst][0].data();
+    float *dstG = color[dst][1].data();
+    float *dstB = color[dst][2].data();
+    float *dstTR = tone[dst][0].data();
+    float *dstTG = tone[dst][1].data();
+    float *dstTB = tone[dst][2].data();
+    // (the center tap always counts in full - even for pixels whose
+    // normal is missing, and would match nothing, not even itself)
+    const float centerWeight = B3[2]*B3[2];
+
+    // one pixel, taps clamped to the frame - for the left and right
+    // borders, and where there's no SSE; does exactly what the SSE
+    // version does, in the same order
+    auto filterPixel = [&](int x, int y) {
+      const int   i  = x + size.x*y;
+      const float tr = tR[i], tg = tG[i], tb = tB[i];
+      const float ar = aR[i], ag = aG[i], ab = aB[i];
+      const float nx = nX[i], ny = nY[i], nz = nZ[i];
+      float sumW = centerWeight;
+      float sumR = centerWeight*srcR[i];
+      float sumG = centerWeight*srcG[i];
+      float sumB = centerWeight*srcB[i];
+      for (int dy=-2;dy<=2;dy++) {
+        const int qy = std::max(0,std::min(size.y-1,y+dy*step));
+        for (int dx=-2;dx<=2;dx++) {
+          if (dx == 0 && dy == 0) continue;
+          const int qx = std::max(0,std::min(size.x-1,x+dx*step));
+          const int j  = qx + size.x*qy;
+          const float t0 = tR[j]-tr, t1 = tG[j]-tg, t2 = tB[j]-tb;
+          const float wc = 1.f/(1.f + (t0*t0 + t1*t1 + t2*t2)*invSigmaC2);
+          const float a0 = aR[j]-ar, a1 = aG[j]-ag, a2 = aB[j]-ab;
+          const float wa = 1.f/(1.f + (a0*a0 + a1*a1 + a2*a2)*invSigmaA2);
+          float wn = std::max(nx*nX[j] + ny*nY[j] + nz*nZ[j],0.f);
+          for (int s=0;s<numSquarings;s++) wn = wn*wn;
+          const float w = B3[dy+2]*B3[dx+2]*wc*wa*wn;
+          sumW = sumW + w;
+          sumR = sumR + w*srcR[j];
+          sumG = sumG + w*srcG[j];
+          sumB = sumB + w*srcB[j];
+        }
+      }
+      const float r = sumR/sumW, g = sumG/sumW, b = sumB/sumW;
+      dstR[i] = r; dstTR[i] = r/(1.f+r);
+      dstG[i] = g; dstTG[i] = g/(1.f+g);
+      dstB[i] = b; dstTB[i] = b/(1.f+b);
+    };
+
+    // the columns whose taps all lie inside the frame
+    const int simdBegin = std::min(size.x,2*step);
+    const int simdEnd   = std::max(simdBegin,size.x-2*step);
+    for (int y=begin;y<end;y++) {
+      int x = 0;
+#if OPZ_ATROUS_SSE
+      if (useSimd) {
+        for (;x<simdBegin;x++) filterPixel(x,y);
+        const __m128 one  = _mm_set1_ps(1.f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 invC = _mm_set1_ps(invSigmaC2);
+        const __m128 invA = _mm_set1_ps(invSigmaA2);
+        for (;x+4<=simdEnd;x+=4) {
+          const int    i  = x + size.x*y;
+          const __m128 tr = _mm_loadu_ps(tR+i), tg = _mm_loadu_ps(tG+i), tb = _mm_loadu_ps(tB+i);
+          const __m128 ar = _mm_loadu_ps(aR+i), ag = _mm_loadu_ps(aG+i), ab = _mm_loadu_ps(aB+i);
+          const __m128 nx = _mm_loadu_ps(nX+i), ny = _mm_loadu_ps(nY+i), nz = _mm_loadu_ps(nZ+i);
+          const __m128 wCenter = _mm_set1_ps(centerWeight);
+          __m128 sumW = wCenter;
+          __m128 sumR = _mm_mul_ps(wCenter,_mm_loadu_ps(srcR+i));
+          __m128 sumG = _mm_mul_ps(wCenter,_mm_loadu_ps(srcG+i));
+          __m128 sumB = _mm_mul_ps(wCenter,_mm_loadu_ps(srcB+i));
+          for (int dy=-2;dy<=2;dy++) {
+            const int qy = std::max(0,std::min(size.y-1,y+dy*step));
+            for (int dx=-2;dx<=2;dx++) {
+              if (dx == 0 && dy == 0) continue;
+              const int j = x+dx*step + size.x*qy;
+              const __m128 t0 = _mm_sub_ps(_mm_loadu_ps(tR+j),tr);
+              const __m128 t1 = _mm_sub_ps(_mm_loadu_ps(tG+j),tg);
+              const __m128 t2 = _mm_sub_ps(_mm_loadu_ps(tB+j),tb);
+              const __m128 dt = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0,t0),_mm_mul_ps(t1,t1)),
+                                           _mm_mul_ps(t2,t2));
+              const __m128 wc = _mm_div_ps(one,_mm_add_ps(one,_mm_mul_ps(dt,invC)));
+              const __m128 a0 = _mm_sub_ps(_mm_loadu_ps(aR+j),ar);
+              const __m128 a1 = _mm_sub_ps(_mm_loadu_ps(aG+j),ag);
+              const __m128 a2 = _mm_sub_ps(_mm_loadu_ps(aB+j),ab);
+              const __m128 da = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0,a0),_mm_mul_ps(a1,a1)),
+                                           _mm_mul_ps(a2,a2));
+              const __m128 wa = _mm_div_ps(one,_mm_add_ps(one,_mm_mul_ps(da,invA)));
+              __m128 wn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx,_mm_loadu_ps(nX+j)),
+                                                _mm_mul_ps(ny,_mm_loadu_ps(nY+j))),
+                                     _mm_mul_ps(nz,_mm_loadu_ps(nZ+j)));
+              wn = _mm_max_ps(wn,zero);
+              for (int s=0;s<numSquarings;s++) wn = _mm_mul_ps(wn,wn);
+              const __m128 w
+                = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(B3[dy+2]*B3[dx+2]),wc),wa),wn);
+              sumW = _mm_add_ps(sumW,w);
+              sumR = _mm_add_ps(sumR,_mm_mul_ps(w,_mm_loadu_ps(srcR+j)));
+              sumG = _mm_add_ps(sumG,_mm_mul_ps(w,_mm_loadu_ps(srcG+j)));
+              sumB = _mm_add_ps(sumB,_mm_mul_ps(w,_mm_loadu_ps(srcB+j)));
+            }
+          }
+          const __m128 r = _mm_div_ps(sumR,sumW);
+          const __m128 g = _mm_div_ps(sumG,sumW);
+          const __m128 b = _mm_div_ps(sumB,sumW);
+          _mm_storeu_ps(dstR+i,r); _mm_storeu_ps(dstTR+i,_mm_div_ps(r,_mm_add_ps(one,r)));
+          _mm_storeu_ps(dstG+i,g); _mm_storeu_ps(dstTG+i,_mm_div_ps(g,_mm_add_ps(one,g)));
+          _mm_storeu_ps(dstB+i,b); _mm_storeu_ps(dstTB+i,_mm_div_ps(b,_mm_add_ps(one,b)));
+        }
+      }
+#endif
+      for (;x<size.x;x++) filterPixel(x,y);
+    }
+  }
+
+  /*! a synthetic frame: two materials side by side (left/right),
+      two walls at right angles (top/bottom), a smooth light gradient
+      over all, and a patch of background (no albedo, no normal) in
+      one corner; 'noisy' is 'clean' with seeded multiplicative noise,
+      as unbiased as a path tracer's */
+  struct SyntheticFrame {
+    vec2i size;
+    std::vector<vec4f> clean, noisy, albedo, normal;
+
+    SyntheticFrame(const vec2i &size, float noise)
+      : size(size)
+    {
+      gdt::LCG<16> random(size.x,size.y);
+      for (int y=0;y<size.y;y++)
+        for (int x=0;x<size.x;x++) {
+          const bool background = x >= size.x-16 && y >= size.y-16;
+          const vec3f a
+            = background ? vec3f(0.f)
+            : x < size.x/2 ? vec3f(.8f,.2f,.2f) : vec3f(.2f,.3f,.8f);
+          const vec3f N
+            = background ? vec3f(0.f)
+            : y < size.y/2 ? vec3f(0.f,0.f,1.f) : vec3f(0.f,1.f,0.f);
+          const float light = (y < size.y/2 ? 1.f : .4f) * (1.f+float(x)/size.x);
+          const vec3f c = background ? vec3f(.1f) : a*light;
+          const float n = 1.f + noise*(2.f*random()-1.f);
+          clean.push_back(vec4f(c,1.f));
+          noisy.push_back(vec4f(c*n,1.f));
+          albedo.push_back(vec4f(a,1.f));
+          normal.push_back(vec4f(N,1.f));
+        }
+    }
+
+    /*! relative rms error of 'image' against the clean frame, over
+        the pixels within 'edgeWidth' of a material or wall edge if
+        'edges', or the others if not */
+    float error(const std::vector<vec4f> &image, bool edges, int edgeWidth = 2) const
+    {
+      double sum = 0., ref = 0.;
+      for (int y=0;y<size.y;y++)
+        for (int x=0;x<size.x;x++) {
+          const bool nearEdge
+            = std::abs(x-size.x/2) <= edgeWidth || std::abs(y-size.y/2) <= edgeWidth;
+          if (nearEdge != edges) continue;
+          const int i = x+size.x*y;
+          const vec3f d = vec3f(image[i]) - vec3f(clean[i]);
+          sum += dot(d,d);
+          ref += dot(vec3f(clean[i]),vec3f(clean[i]));
+        }
+      return float(std::sqrt(sum/ref));
+    }
+  };
+
+  static float maxDifference(const std::vector<vec4f> &a, const std::vector<vec4f> &b)
+  {
+    float diff = 0.f;
+    for (size_t i=0;i<a.size();i++)
+      for (int c=0;c<4;c++)
+        diff = std::max(diff,std::fabs(a[i][c]-b[i][c]));
+    return diff;
+  }
+  
+  bool checkAtrousDenoiser()
+  {
+    beginCheck("a-trous denoiser");
+    bool ok = true;
+
+    const SyntheticFrame frame(vec2i(203,150),.8f);
+    std::vector<vec4f> denoised(frame.noisy.size());
+    AtrousDenoiser denoiser;
+    denoiser.denoise(frame.noisy.data(),frame.albedo.data(),frame.normal.data(),
+                     frame.size,denoised.data());
+
+    bool finite = true;
+    for (auto &v : denoised)
+      for (int c=0;c<4;c++) finite &= std::isfinite(v[c]);
+    ok &= checkResult("all pixels finite, including ones with no albedo or normal",finite);
+
+    // same filter without guides: one albedo and normal for all
+    std::vector<vec4f> blurred(frame.noisy.size());
+    {
+      const std::vector<vec4f> flatAlbedo(frame.noisy.size(),vec4f(.5f,.5f,.5f,1.f));
+      const std::vector<vec4f> flatNormal(frame.noisy.size(),vec4f(0.f,0.f,1.f,1.f));
+      AtrousDenoiser blind;
+      blind.sigmaColor = 1e3f;
+      blind.denoise(frame.noisy.data(),flatAlbedo.data(),flatNormal.data(),
+                    frame.size,blurred.data());
+    }
+    std::cout << "  rms error inside/at edges: noisy "
+              << frame.error(frame.noisy,false) << "/" << frame.error(frame.noisy,true)
+              << ", denoised " << frame.error(denoised,false) << "/" << frame.error(denoised,true)
+              << ", unguided " << frame.error(blurred,false) << "/" << frame.error(blurred,true)
+              << std::endl;
+    ok &= checkResult("removes most of the noise",
+                      frame.error(denoised,false) < .25f*frame.error(frame.noisy,false));
+    ok &= checkResult("keeps material and geometry edges that an unguided blur smears",
+                      frame.error(denoised,true) < .5f*frame.error(frame.noisy,true)
+                      && frame.error(denoised,true) < .5f*frame.error(blurred,true));
+
+    // same image every way it can be computed
+    {
+      AtrousDenoiser scalar;
+      scalar.useSimd = false;
+      std::vector<vec4f> reference(frame.noisy.size());
+      scalar.denoise(frame.noisy.data(),frame.albedo.data(),frame.normal.data(),
+                     frame.size,reference.data());
+      ok &= checkResult("SSE and scalar code give the same image",
+                        maxDifference(reference,denoised) <= 1e-5f);
+
+      ThreadPool pool(4);
+      std::vector<vec4f> threaded(frame.noisy);
+      // (in place, too)
+      denoiser.denoise(threaded.data(),frame.albedo.data(),frame.normal.data(),
+                       frame.size,threaded.data(),&pool);
+      ok &= checkResult("threaded and in place gives exactly the same image",
+                        maxDifference(threaded,denoised) == 0.f);
+    }
+
+    return endCheck("a-trous denoiser",ok);
+  }
+  
+} // ::opz
@@ -0,0 +1,84 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+// std
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  class ThreadPool;
+
+  /*! a denoiser that runs on the host, for when there's no optix
+      denoiser to run: the edge-avoiding a-trous wavelet filter of
+      Dammertz et al. 2010, guided by the albedo and normal buffers
+      raygen writes. color gets divided by albedo first, so texture
+      detail doesn't get blurred along with the noise, and multiplied
+      back in at the end. each pass is a 5x5 B3-spline with its taps
+      2^pass pixels apart, whose weights fall off with differences in
+      (tone-compressed) color, albedo and normal; passes run in bands
+      of rows on a thread pool, and four pixels at a time with SSE */
+  class AtrousDenoiser {
+  public:
+    /*! number of passes; the last one's taps are 2^(numPasses-1)
+        pixels apart */
+    int   numPasses   = 5;
+    /*! @{ how quickly tap weights fall off with color and albedo
+        difference; the color one halves with every pass, since each
+        pass leaves less noise to tell edges from */
+    float sigmaColor  = .25f;
+    float sigmaAlbedo = .1f;
+    /*! @} */
+    /*! taps' normals weigh in by dot(N,N')^normalPower, which has
+        to be a power of two */
+    int   normalPower = 32;
+    /*! use the SSE code path where available (it gives the same
+        image; this is for checking that it does) */
+    bool  useSimd     = true;
+
+    /*! denoise the size.x*size.y pixels of 'color' into 'output'
+        (which may be the same array); with a pool, the work gets
+        spread over its threads */
+    void denoise(const vec4f *color, const vec4f *albedo, const vec4f *normal,
+                 const vec2i &size, vec4f *output, ThreadPool *pool = nullptr);
+
+  private:
+    /*! one pass over rows [begin,end) of plane set 'src' into 'dst' */
+    void filterRows(int pass, int begin, int end, int src, int dst);
+    
+    vec2i size { 0 };
+    /*! structure-of-arrays planes, so four neighbouring pixels are
+        one SSE load: demodulated color and its tone-compressed copy
+        (both twice, to ping-pong between passes), albedo and normal */
+    std::vector<float> color[2][3];
+    std::vector<float> tone[2][3];
+    std::vector<float> albedo[3];
+    std::vector<float> normal[3];
+  };
+
+  /*! deterministic host-side checks of the a-trous denoiser on
+      synthetic noisy images; prints what it finds, and returns true
+      if all pass */
+  bool checkAtrousDenoiser();
+  
+} // ::opz
@@ -0,0 +1,515 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "BVHAnalyzer.h"
+#include "Checks.h"
+
+//std
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <queue>
+#include <tuple>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! one triangle reference, as seen by the builder */
+  struct PrimRef {
+    box3f bounds;
+    vec3f centroid;
+  };
+
+  /*! surface area of a box, with empty boxes counting as zero */
+  inline float safeArea(const box3f &box)
+  {
+    return box.empty() ? 0.f : area(box);
+  }
+
+  /*! running sums we collect while building; turned into BVHStats
+      at the end */
+  struct BuildState {
+    BuildState(const BVHBuildConfig &config) : config(config) {}
+
+    const BVHBuildConfig &config;
+    double weightedCost { 0. };
+    double overlapSum   { 0. };
+    int    numOverlapping { 0 };
+    int    numInner     { 0 };
+    int    numLeaves    { 0 };
+    int    maxDepth     { 0 };
+    int    maxLeafSize  { 0 };
+    size_t leafPrimSum  { 0 };
+  };
+
+  static void makeLeaf(BuildState &state, const box3f &bounds, int numPrims, int depth)
+  {
+    state.numLeaves++;
+    state.leafPrimSum += numPrims;
+    state.maxLeafSize  = std::max(state.maxLeafSize,numPrims);
+    state.maxDepth     = std::max(state.maxDepth,depth);
+    state.weightedCost += state.config.intersectCost * numPrims * safeArea(bounds);
+  }
+
+  /*! recursively build over refs[begin..end), only keeping track of
+      the statistics; we never need the actual nodes */
+  static void buildRec(BuildState &state,
+                       std::vector<PrimRef> &refs,
+                       int begin, int end, int depth)
+  {
+    const BVHBuildConfig &config = state.config;
+    const int numPrims = end-begin;
+
+    box3f bounds, centBounds;
+    for (int i=begin;i<end;i++) {
+      bounds.extend(refs[i].bounds);
+      centBounds.extend(refs[i].centroid);
+    }
+
+    if (numPrims <= config.maxLeafSize) {
+      makeLeaf(state,bounds,numPrims,depth);
+      return;
+    }
+
+    // ------------------------------------------------------------------
+    // find best binned split over all three axes
+    // ------------------------------------------------------------------
+    const int numBins = config.numBins;
+    const float nodeArea = safeArea(bounds);
+    float bestCost  = std::numeric_limits<float>::infinity();
+    int   bestDim   = -1;
+    int   bestSplit = -1;
+
+    std::vector<box3f> binBounds(numBins);
+    std::vector<int>   binCount(numBins);
+    std::vector<float> rightArea(numBins);
+    std::vector<int>   rightCount(numBins);
+
+    const vec3f centSpan = centBounds.span();
+    for (int dim=0;dim<3;dim++) {
+      if (centSpan[dim] <= 0.f) continue;
+      const float scale = numBins / centSpan[dim];
+
+      std::fill(binBounds.begin(),binBounds.end(),box3f());
+      std::fill(binCount.begin(),binCount.end(),0);
+      for (int i=begin;i<end;i++) {
+        int binID = int((refs[i].centroid[dim] - centBounds.lower[dim]) * scale);
+        binID = std::min(numBins-1,std::max(0,binID));
+        binBounds[binID].extend(refs[i].bounds);
+        binCount[binID]++;
+      }
+
+      // sweep from the right ...
+      box3f rightBox;
+      int   rightNum = 0;
+      for (int binID=numBins-1;binID>0;binID--) {
+        rightBox.extend(binBounds[binID]);
+        rightNum += binCount[binID];
+        rightArea[binID]  = safeArea(rightBox);
+        rightCount[binID] = rightNum;
+      }
+      // ... then from the left, evaluating each split plane
+      box3f leftBox;
+      int   leftNum = 0;
+      for (int binID=1;binID<numBins;binID++) {
+        leftBox.extend(binBounds[binID-1]);
+        leftNum += binCount[binID-1];
+        if (leftNum == 0 || rightCount[binID] == 0) continue;
+        const float cost
+          = config.traversalCost
+          + config.intersectCost
+          * (safeArea(leftBox)*leftNum + rightArea[binID]*rightCount[binID])
+          / nodeArea;
+        if (cost < bestCost) {
+          bestCost  = cost;
+          bestDim   = dim;
+          bestSplit = binID;
+        }
+      }
+    }
+
+    const float leafCost = config.intersectCost * numPrims;
+    if (bestDim >= 0 && bestCost >= leafCost && numPrims <= 4*config.maxLeafSize) {
+      makeLeaf(state,bounds,numPrims,depth);
+      return;
+    }
+
+    // ------------------------------------------------------------------
+    // partition; fall back to a median split if all centroids are
+    // identical (eg, a stack of duplicate triangles)
+    // ------------------------------------------------------------------
+    int mid = begin + numPrims/2;
+    if (bestDim >= 0) {
+      const float lower = centBounds.lower[bestDim];
+      const float scale = numBins / centSpan[bestDim];
+      auto it = std::partition(refs.begin()+begin,refs.begin()+end,
+                               [&](const PrimRef &ref) {
+                                 int binID = int((ref.centroid[bestDim] - lower) * scale);
+                                 binID = std::min(numBins-1,std::max(0,binID));
+                                 return binID < bestSplit;
+                               });
+      mid = int(it - refs.begin());
+      if (mid == begin || mid == end)
+        mid = begin + numPrims/2;
+    }
+
+    box3f leftBounds, rightBounds;
+    for (int i=begin;i<mid;i++) leftBounds.extend(refs[i].bounds);
+    for (int i=mid;i<end;i++)   rightBounds.extend(refs[i].bounds);
+
+    state.numInner++;
+    state.weightedCost += config.traversalCost * nodeArea;
+    const box3f overlap = intersection(leftBounds,rightBounds);
+    if (!overlap.empty() && nodeArea > 0.f) {
+      state.overlapSum += safeArea(overlap) / nodeArea;
+      state.numOverlapping++;
+    }
+
+    buildRec(state,refs,begin,mid,depth+1);
+    buildRec(state,refs,mid,end,depth+1);
+  }
+
+  BVHStats analyzeBVH(const Model *model, const BVHBuildConfig &config)
+  {
+    std::vector<PrimRef> refs;
+    for (auto mesh : model->meshes)
+      for (auto idx : mesh->index) {
+        PrimRef ref;
+        ref.bounds.extend(mesh->vertex[idx.x]);
+        ref.bounds.extend(mesh->vertex[idx.y]);
+        ref.bounds.extend(mesh->vertex[idx.z]);
+        ref.centroid = ref.bounds.center();
+        refs.push_back(ref);
+      }
+
+    BVHStats stats;
+    stats.numTriangles = (int)refs.size();
+    if (refs.empty()) return stats;
+
+    box3f rootBounds;
+    for (auto &ref : refs) rootBounds.extend(ref.bounds);
+
+    BuildState state(config);
+    buildRec(state,refs,0,(int)refs.size(),0);
+
+    const float rootArea = safeArea(rootBounds);
+    stats.sahCost     = rootArea > 0.f ? float(state.weightedCost / rootArea) : 0.f;
+    stats.numNodes    = state.numInner + state.numLeaves;
+    stats.numLeaves   = state.numLeaves;
+    stats.maxDepth    = state.maxDepth;
+    stats.maxLeafSize = state.maxLeafSize;
+    stats.avgLeafSize = float(state.leafPrimSum) / state.numLeaves;
+    if (state.numInner > 0) {
+      stats.avgOverlap          = float(state.overlapSum / state.numInner);
+      stats.overlappingFraction = float(state.numOverlapping) / state.numInner;
+    }
+    return stats;
+  }
+
+  void printBVHStats(const std::string &label, const BVHStats &stats)
+  {
+    std::cout << "#osc: bvh stats (" << label << ")" << std::endl
+              << "  triangles      : " << prettyNumber(stats.numTriangles) << std::endl
+              << "  SAH cost       : " << stats.sahCost << std::endl
+              << "  nodes / leaves : " << prettyNumber(stats.numNodes)
+              << " / " << prettyNumber(stats.numLeaves) << std::endl
+              << "  max depth      : " << stats.maxDepth << std::endl
+              << "  leaf size      : avg " << stats.avgLeafSize
+              << ", max " << stats.maxLeafSize << std::endl
+              << "  child overlap  : avg " << stats.avgOverlap
+              << " of node area, in " << (100.f*stats.overlappingFraction)
+              << "% of inner nodes" << std::endl;
+  }
+
+  // ==================================================================
+  // triangle pre-splitting
+  // ==================================================================
+
+  /*! one candidate for splitting; we always split the triangle that
+      wastes the most box area first. 'index' is the triangle as it
+      was queued - splitting a neighbor can change it meanwhile */
+  struct SplitCandidate {
+    float waste;
+    int   meshID;
+    int   triID;
+    vec3i index;
+    bool operator<(const SplitCandidate &other) const { return waste < other.waste; }
+  };
+
+  inline float triangleArea(const vec3f &a, const vec3f &b, const vec3f &c)
+  {
+    return .5f*length(cross(b-a,c-a));
+  }
+
+  /*! returns the box area this triangle wastes, or a negative value
+      if it doesn't qualify for splitting */
+  static float splitWaste(const TriangleMesh &mesh, int triID,
+                          const PresplitConfig &config, float minArea)
+  {
+    const vec3i idx = mesh.index[triID];
+    const vec3f &a = mesh.vertex[idx.x];
+    const vec3f &b = mesh.vertex[idx.y];
+    const vec3f &c = mesh.vertex[idx.z];
+    box3f bounds;
+    bounds.extend(a).extend(b).extend(c);
+    const float boxArea = safeArea(bounds);
+    const float triArea = triangleArea(a,b,c);
+    // (degenerate triangles would always qualify, and stay degenerate)
+    if (triArea == 0.f) return -1.f;
+    if (boxArea < minArea) return -1.f;
+    if (boxArea <= config.areaRatio * triArea) return -1.f;
+    return boxArea - triArea;
+  }
+
+  /*! an undirected edge, by the positions of its end points: meshes
+      don't share vertices (and loadOBJ duplicates them along normal
+      and texcoord seams), but watertight neighbors do share these */
+  typedef std::tuple<float,float,float,float,float,float> EdgeKey;
+
+  inline EdgeKey edgeKey(const vec3f &a, const vec3f &b)
+  {
+    const bool aFirst = std::make_tuple(a.x,a.y,a.z) < std::make_tuple(b.x,b.y,b.z);
+    const vec3f &lo = aFirst ? a : b;
+    const vec3f &hi = aFirst ? b : a;
+    return EdgeKey(lo.x,lo.y,lo.z,hi.x,hi.y,hi.z);
+  }
+
+  /*! (meshID,triID) of every triangle using an edge */
+  typedef std::map<EdgeKey,std::vector<std::pair<int,int>>> EdgeTriangles;
+
+  static void addEdges(EdgeTriangles &edges, const TriangleMesh &mesh,
+                       int meshID, int triID)
+  {
+    const vec3i idx = mesh.index[triID];
+    const int v[3] = { idx.x, idx.y, idx.z };
+    for (int e=0;e<3;e++)
+      edges[edgeKey(mesh.vertex[v[e]],mesh.vertex[v[(e+1)%3]])]
+        .push_back(std::make_pair(meshID,triID));
+  }
+
+  static void removeEdges(EdgeTriangles &edges, const TriangleMesh &mesh,
+                          int meshID, int triID)
+  {
+    const vec3i idx = mesh.index[triID];
+    const int v[3] = { idx.x, idx.y, idx.z };
+    for (int e=0;e<3;e++) {
+      auto it = edges.find(edgeKey(mesh.vertex[v[e]],mesh.vertex[v[(e+1)%3]]));
+      if (it == edges.end()) continue;
+      auto &tris = it->second;
+      tris.erase(std::remove(tris.begin(),tris.end(),std::make_pair(meshID,triID)),
+                 tris.end());
+      if (tris.empty()) edges.erase(it);
+    }
+  }
+
+  /*! add the midpoint of edge (v0,v1) to the mesh, or return the one
+      created earlier, so neighboring splits share their vertices */
+  static int midpointVertex(TriangleMesh &mesh,
+                            std::map<std::pair<int,int>,int> &knownMidpoints,
+                            int v0, int v1)
+  {
+    const std::pair<int,int> key(std::min(v0,v1),std::max(v0,v1));
+    auto it = knownMidpoints.find(key);
+    if (it != knownMidpoints.end()) return it->second;
+
+    const int newID = (int)mesh.vertex.size();
+    // (a+b rounds the same as b+a, so the neighbors across this edge
+    // - which may see it the other way around - get the same point)
+    mesh.vertex.push_back(.5f*(mesh.vertex[v0]+mesh.vertex[v1]));
+    if (!mesh.normal.empty()) {
+      vec3f n = mesh.normal[v0]+mesh.normal[v1];
+      mesh.normal.push_back(dot(n,n) > 0.f ? normalize(n) : mesh.normal[v0]);
+    }
+    if (!mesh.texcoord.empty())
+      mesh.texcoord.push_back(.5f*(mesh.texcoord[v0]+mesh.texcoord[v1]));
+    knownMidpoints[key] = newID;
+    return newID;
+  }
+
+  int presplitTriangles(Model *model, const PresplitConfig &config)
+  {
+    const float minArea = config.minRelativeArea * safeArea(model->bounds);
+
+    size_t numOriginal = 0;
+    std::priority_queue<SplitCandidate> candidates;
+    EdgeTriangles edges;
+    auto pushCandidate = [&](int meshID, int triID) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      const float waste = splitWaste(mesh,triID,config,minArea);
+      if (waste > 0.f) candidates.push({waste,meshID,triID,mesh.index[triID]});
+    };
+    for (int meshID=0;meshID<(int)model->meshes.size();meshID++) {
+      const TriangleMesh &mesh = *model->meshes[meshID];
+      numOriginal += mesh.index.size();
+      for (int triID=0;triID<(int)mesh.index.size();triID++) {
+        addEdges(edges,mesh,meshID,triID);
+        pushCandidate(meshID,triID);
+      }
+    }
+
+    const int budget = int(config.maxGrowth * numOriginal);
+    std::vector<std::map<std::pair<int,int>,int>> knownMidpoints(model->meshes.size());
+
+    int numAdded = 0;
+    while (!candidates.empty()) {
+      const SplitCandidate cand = candidates.top();
+      candidates.pop();
+      const TriangleMesh &candMesh = *model->meshes[cand.meshID];
+      if (candMesh.index[cand.triID] != cand.index)
+        // already split as some other triangle's neighbor
+        continue;
+
+      // split along the longest edge - and so every triangle sharing
+      // that edge, or we'd leave t-junctions (and, since the midpoint
+      // is rounded, cracks) in the surface
+      const int v[3] = { cand.index.x, cand.index.y, cand.index.z };
+      int longest = 0;
+      float longestLen = -1.f;
+      for (int e=0;e<3;e++) {
+        const float len = length(candMesh.vertex[v[(e+1)%3]]-candMesh.vertex[v[e]]);
+        if (len > longestLen) { longestLen = len; longest = e; }
+      }
+      const vec3f p0 = candMesh.vertex[v[longest]];
+      const vec3f p1 = candMesh.vertex[v[(longest+1)%3]];
+      const EdgeKey key = edgeKey(p0,p1);
+      std::vector<std::pair<int,int>> sharing = edges[key];
+      // (a degenerate triangle can have this edge twice)
+      std::sort(sharing.begin(),sharing.end());
+      sharing.erase(std::unique(sharing.begin(),sharing.end()),sharing.end());
+      if (numAdded + (int)sharing.size() > budget) break;
+
+      for (auto tri : sharing) {
+        const int meshID = tri.first, triID = tri.second;
+        TriangleMesh &mesh = *model->meshes[meshID];
+
+        // rotate the triangle so the split edge is (v0,v1) - this
+        // keeps the winding order
+        const vec3i idx = mesh.index[triID];
+        const int w[3] = { idx.x, idx.y, idx.z };
+        int e = 0;
+        while (e < 3 && edgeKey(mesh.vertex[w[e]],mesh.vertex[w[(e+1)%3]]) != key) e++;
+        if (e == 3) continue;
+        removeEdges(edges,mesh,meshID,triID);
+        const int v0 = w[e];
+        const int v1 = w[(e+1)%3];
+        const int v2 = w[(e+2)%3];
+        const int m  = midpointVertex(mesh,knownMidpoints[meshID],v0,v1);
+
+        mesh.index[triID] = vec3i(v0,m,v2);
+        const int newTriID = (int)mesh.index.size();
+        mesh.index.push_back(vec3i(m,v1,v2));
+        numAdded++;
+
+        for (int half : { triID, newTriID }) {
+          addEdges(edges,mesh,meshID,half);
+          pushCandidate(meshID,half);
+        }
+      }
+    }
+    return numAdded;
+  }
+
+  /*! a box along (1,1,1), 'length' long and one unit wide, made of
+      two meshes (the sides facing +/- the first cross axis in one, the
+      rest in the other) that don't share any vertices */
+  static void addDiagonalBox(Model &model, float length)
+  {
+    const vec3f u = normalize(vec3f(1.f,1.f,1.f));
+    const vec3f v = normalize(vec3f(1.f,-1.f,0.f));
+    const vec3f w = cross(u,v);
+    vec3f corner[8];
+    for (int i=0;i<8;i++)
+      corner[i] = ((i&1) ? length : 0.f)*u + ((i&2) ? 1.f : 0.f)*v + ((i&4) ? 1.f : 0.f)*w;
+    // the six sides, as corner indices around each
+    const int side[6][4] = {
+      { 0,1,5,4 }, { 2,6,7,3 },  // -v, +v
+      { 0,2,3,1 }, { 4,5,7,6 },  // -w, +w
+      { 0,4,6,2 }, { 1,3,7,5 },  // -u, +u
+    };
+    for (int m=0;m<2;m++) {
+      TriangleMesh *mesh = new TriangleMesh;
+      for (int f=(m==0 ? 0 : 2);f<(m==0 ? 2 : 6);f++) {
+        const int base = (int)mesh->vertex.size();
+        for (int i=0;i<4;i++) mesh->vertex.push_back(corner[side[f][i]]);
+        mesh->index.push_back(vec3i(base,base+1,base+2));
+        mesh->index.push_back(vec3i(base,base+2,base+3));
+      }
+      model.meshes.push_back(mesh);
+    }
+    for (auto mesh : model.meshes)
+      for (auto &vtx : mesh->vertex) model.bounds.extend(vtx);
+  }
+
+  static float surfaceArea(const Model &model)
+  {
+    double sum = 0.;
+    for (auto mesh : model.meshes)
+      for (auto &idx : mesh->index)
+        sum += triangleArea(mesh->vertex[idx.x],mesh->vertex[idx.y],mesh->vertex[idx.z]);
+    return (float)sum;
+  }
+
+  bool checkPresplit()
+  {
+    beginCheck("triangle pre-splitting");
+    bool ok = true;
+    {
+      Model model;
+      addDiagonalBox(model,100.f);
+      // plus a degenerate triangle, off on its own
+      TriangleMesh *degenerate = new TriangleMesh;
+      degenerate->vertex = { vec3f(-50.f), vec3f(-40.f), vec3f(-30.f) };
+      degenerate->index  = { vec3i(0,1,2) };
+      model.meshes.push_back(degenerate);
+      model.bounds.extend(vec3f(-50.f));
+
+      const float areaBefore = surfaceArea(model);
+      PresplitConfig config;
+      config.maxGrowth = 20.f;
+      const int numAdded = presplitTriangles(&model,config);
+      std::cout << "  13 triangles, " << numAdded << " added" << std::endl;
+      ok &= checkResult("splits the thin triangles",numAdded > 13);
+
+      std::map<EdgeKey,int> numUses;
+      for (auto mesh : model.meshes)
+        for (auto &idx : mesh->index) {
+          if (mesh == degenerate) continue;
+          const int v[3] = { idx.x, idx.y, idx.z };
+          for (int e=0;e<3;e++)
+            numUses[edgeKey(mesh->vertex[v[e]],mesh->vertex[v[(e+1)%3]])]++;
+        }
+      bool closed = true;
+      for (auto &edge : numUses) closed &= (edge.second == 2);
+      ok &= checkResult("the box stays closed: every edge has two triangles, across meshes too",
+                        closed);
+      const float areaAfter = surfaceArea(model);
+      ok &= checkResult("the surface area stays the same",
+                        fabsf(areaAfter-areaBefore) <= 1e-4f*areaBefore);
+      ok &= checkResult("degenerate triangles don't get split",
+                        degenerate->index.size() == 1);
+    }
+    {
+      Model model;
+      addDiagonalBox(model,100.f);
+      const int numAdded = presplitTriangles(&model);
+      ok &= checkResult("stays within its budget",
+                        numAdded <= int(PresplitConfig().maxGrowth * 12));
+    }
+    return endCheck("triangle pre-splitting",ok);
+  }
+
+}
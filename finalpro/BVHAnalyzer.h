@@ -0,0 +1,90 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! parameters for the host-side binned SAH builder. the cost
+      constants only have to be right relative to each other - we use
+      the usual 1:1 traversal/intersection ratio */
+  struct BVHBuildConfig {
+    int   numBins       { 16 };
+    int   maxLeafSize   { 4 };
+    float traversalCost { 1.f };
+    float intersectCost { 1.f };
+  };
+
+  /*! quality statistics of a binned SAH BVH built over all triangles
+      of a model. this is _not_ the BVH optix builds, but it suffers
+      from the same bad input (long, thin, diagonal triangles), so it
+      is a good proxy for how much trouble a scene will give the
+      traversal units */
+  struct BVHStats {
+    /*! expected cost of a random ray, normalized by root surface area */
+    float sahCost        { 0.f };
+    int   numTriangles   { 0 };
+    int   numNodes       { 0 };
+    int   numLeaves      { 0 };
+    int   maxDepth       { 0 };
+    int   maxLeafSize    { 0 };
+    float avgLeafSize    { 0.f };
+    /*! average over all inner nodes of area(left & right)/area(node) */
+    float avgOverlap     { 0.f };
+    /*! fraction of inner nodes whose children overlap at all */
+    float overlappingFraction { 0.f };
+  };
+
+  /*! limits for triangle pre-splitting. we split a triangle along its
+      longest edge while the surface area of its bounding box exceeds
+      'areaRatio' times its own area, and stop once 'maxGrowth' times
+      the original triangle count has been added */
+  struct PresplitConfig {
+    float areaRatio { 8.f };
+    float maxGrowth { .25f };
+    /*! triangles with a box area below this fraction of the scene
+        box area are never worth splitting */
+    float minRelativeArea { 1e-5f };
+  };
+
+  /*! build a binned SAH BVH over all triangles in the model and
+      return its quality statistics; does not modify the model */
+  BVHStats analyzeBVH(const Model *model,
+                      const BVHBuildConfig &config = BVHBuildConfig());
+
+  /*! print the given stats in a human-readable form */
+  void printBVHStats(const std::string &label, const BVHStats &stats);
+
+  /*! split badly-shaped triangles in place (rewriting each mesh's
+      vertex, normal, texcoord and index arrays), so the accel built
+      afterwards gets tighter boxes. splits are done at edge midpoints,
+      and split every triangle sharing the edge (by position, so also
+      across meshes), so the surface itself does not change and stays
+      as watertight as it was. returns the number of triangles that
+      were added */
+  int presplitTriangles(Model *model,
+                        const PresplitConfig &config = PresplitConfig());
+
+  /*! host-side checks of presplitTriangles on a long, thin, diagonal
+      box made of two meshes: it stays closed (no t-junctions), keeps
+      its area, honors the budget, and leaves degenerate triangles
+      alone; prints what it finds, and returns true if all pass */
+  bool checkPresplit();
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "optix7.h"
+#include "AllocationTracker.h"
 // common std stuff
 #include <vector>
 #include <assert.h>
@@ -26,22 +27,34 @@
 namespace opz {
 
   /*! simple wrapper for creating, and managing a device-side CUDA
-      buffer */
+      buffer. all (de-)allocations get counted by the
+      AllocationTracker, under the site that asked for them */
   struct CUDABuffer {
     inline CUdeviceptr d_pointer() const
     { return (CUdeviceptr)d_ptr; }
 
     //! re-size buffer to given number of bytes
-    void resize(size_t size)
+    void resize(size_t size,
+                const char *file = OPZ_CALLER_FILE, int line = OPZ_CALLER_LINE)
     {
       if (d_ptr) free();
-      alloc(size);
+      alloc(size,file,line);
+    }
+
+    //! make sure the buffer holds at least given number of bytes;
+    //! only ever grows, so re-sizing back and forth allocates nothing
+    void reserve(size_t size,
+                 const char *file = OPZ_CALLER_FILE, int line = OPZ_CALLER_LINE)
+    {
+      if (sizeInBytes < size) resize(size,file,line);
     }
     
     //! allocate to given number of bytes
-    void alloc(size_t size)
+    void alloc(size_t size,
+               const char *file = OPZ_CALLER_FILE, int line = OPZ_CALLER_LINE)
     {
       assert(d_ptr == nullptr);
+      AllocationTracker::get().recordAlloc(size,file,line);
       this->sizeInBytes = size;
       CUDA_CHECK(Malloc( (void**)&d_ptr, sizeInBytes));
     }
@@ -49,23 +62,27 @@ namespace opz {
     //! free allocated memory
     void free()
     {
+      AllocationTracker::get().recordFree(sizeInBytes);
       CUDA_CHECK(Free(d_ptr));
       d_ptr = nullptr;
       sizeInBytes = 0;
     }
 
     template<typename T>
-    void alloc_and_upload(const std::vector<T> &vt)
+    void alloc_and_upload(const std::vector<T> &vt,
+                          const char *file = OPZ_CALLER_FILE, int line = OPZ_CALLER_LINE)
     {
-      alloc(vt.size()*sizeof(T));
+      alloc(vt.size()*sizeof(T),file,line);
       upload((const T*)vt.data(),vt.size());
     }
     
+    //! (buffers may be larger than what's in use; up- and downloads
+    //! only touch the first 'count' elements)
     template<typename T>
     void upload(const T *t, size_t count)
     {
       assert(d_ptr != nullptr);
-      assert(sizeInBytes == count*sizeof(T));
+      assert(sizeInBytes >= count*sizeof(T));
       CUDA_CHECK(Memcpy(d_ptr, (void *)t,
                         count*sizeof(T), cudaMemcpyHostToDevice));
     }
@@ -74,7 +91,7 @@ namespace opz {
     void download(T *t, size_t count)
     {
       assert(d_ptr != nullptr);
-      assert(sizeInBytes == count*sizeof(T));
+      assert(sizeInBytes >= count*sizeof(T));
       CUDA_CHECK(Memcpy((void *)t, d_ptr,
                         count*sizeof(T), cudaMemcpyDeviceToHost));
     }
@@ -0,0 +1,48 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+// std
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! @{ reporting for the host-side check*() functions, which the
+      finalproChecks test runs: each check announces itself, prints
+      every condition it tests (flagging the ones that fail), and sums
+      up with its overall result */
+  inline void beginCheck(const char *name)
+  {
+    std::cout << "#osc: checking " << name << std::endl;
+  }
+
+  inline bool checkResult(const char *what, bool ok)
+  {
+    std::cout << "  " << what << (ok ? "" : "  <-- FAILED") << std::endl;
+    return ok;
+  }
+
+  inline bool endCheck(const char *name, bool ok)
+  {
+    std::cout << "#osc: " << name << " " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+  }
+  /*! @} */
+  
+} // ::opz
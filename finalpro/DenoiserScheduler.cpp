@@ -0,0 +1,103 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+
+#include "DenoiserScheduler.h"
+#include "Checks.h"
+// std
+#include <algorithm>
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  bool DenoiserScheduler::shouldDenoise(bool presented, uint32_t samples)
+  {
+    numFrames++;
+    if (!presented) return false;
+    framesSinceDenoise++;
+    const bool denoise
+      = !upToDate
+      || samples < convergedSamples
+      || (convergedInterval > 0 && framesSinceDenoise >= convergedInterval);
+    if (!denoise) return false;
+    upToDate           = true;
+    framesSinceDenoise = 0;
+    numDenoised++;
+    return true;
+  }
+
+  bool checkDenoiserScheduler()
+  {
+    beginCheck("denoiser scheduler");
+    bool ok = true;
+
+    // a session: 100 frames of moving the camera (every frame starts
+    // over), then 2000 of standing still at 4 spp per frame, with
+    // every third frame never shown
+    DenoiserScheduler scheduler;
+    const uint32_t samplesPerFrame = 4;
+    uint32_t samples = 0;
+    bool   allMovingDenoised = true, noHiddenDenoised = true;
+    int    longestGap = 0, gap = 0;
+    size_t denoisedBefore = 0, framesBefore = 0;
+    for (int frameID=0;frameID<2100;frameID++) {
+      const bool moving    = frameID < 100;
+      const bool presented = frameID % 3 != 2;
+      if (moving || frameID == 100) {
+        samples = 0;
+        scheduler.invalidate();
+      }
+      samples += samplesPerFrame;
+      if (frameID == 1100) {
+        denoisedBefore = scheduler.numDenoised;
+        framesBefore   = scheduler.numFrames;
+      }
+      const bool denoised = scheduler.shouldDenoise(presented,samples);
+      if (moving && presented) allMovingDenoised &= denoised;
+      if (!presented) noHiddenDenoised &= !denoised;
+      if (!moving && presented) {
+        gap = denoised ? 0 : gap+1;
+        longestGap = std::max(longestGap,gap);
+      }
+    }
+    ok &= checkResult("every shown frame gets denoised while moving",allMovingDenoised);
+    ok &= checkResult("frames that aren't shown never get denoised",noHiddenDenoised);
+    const double convergedRate
+      = double(scheduler.numDenoised-denoisedBefore)/(scheduler.numFrames-framesBefore);
+    std::cout << "  converged: " << int(1000*convergedRate)/10.
+              << "% of frames denoised, at most " << longestGap
+              << " shown frames in a row reused the last one" << std::endl;
+    ok &= checkResult("converged images get denoised every convergedInterval shown frames",
+                      longestGap == scheduler.convergedInterval-1);
+
+    // a change (eg, turning the denoiser on) gets denoised right away
+    scheduler.invalidate();
+    ok &= checkResult("the first shown frame after a change gets denoised",
+                      !scheduler.shouldDenoise(false,1<<20)
+                      && scheduler.shouldDenoise(true,1<<20));
+    scheduler.convergedInterval = 0;
+    bool anyAgain = false;
+    for (int i=0;i<100;i++) anyAgain |= scheduler.shouldDenoise(true,1<<20);
+    ok &= checkResult("with no interval, converged images get denoised only once",!anyAgain);
+
+    return endCheck("denoiser scheduler",ok);
+  }
+  
+} // ::opz
@@ -0,0 +1,70 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! decides which frames get denoised at all: none that nobody
+      gets to see, every one that's shown while the image is still
+      noisy - or right after it changed - and, once accumulation has
+      converged (ie, reached convergedSamples per pixel), only every
+      convergedInterval-th shown frame; in between, the last denoised
+      image gets shown again, which by then hardly differs. pure host
+      logic, no cuda - see checkDenoiserScheduler() */
+  class DenoiserScheduler {
+  public:
+    /*! samples per pixel from which on the accumulated image counts
+        as converged */
+    uint32_t convergedSamples  = 256;
+    /*! converged images get denoised every this many shown frames;
+        0 means not again until they change */
+    int      convergedInterval = 8;
+
+    /*! the last denoised image no longer matches the frame - after
+        accumulation started over, a resize, a new denoiser, or the
+        denoiser getting switched on - so the next shown frame has
+        to be denoised, converged or not */
+    inline void invalidate() { upToDate = false; }
+
+    /*! whether to denoise the frame about to be finished, which has
+        'samples' per pixel accumulated and will be 'presented' or not */
+    bool shouldDenoise(bool presented, uint32_t samples);
+
+    /*! @{ frames asked about, and how many of those got denoised */
+    size_t numFrames   = 0;
+    size_t numDenoised = 0;
+    /*! @} */
+    
+  private:
+    bool upToDate           = false;
+    int  framesSinceDenoise = 0;
+  };
+
+  /*! host-side checks of the scheduling policy over a simulated
+      interactive session; prints what it finds, and returns true if
+      all pass */
+  bool checkDenoiserScheduler();
+  
+} // ::opz
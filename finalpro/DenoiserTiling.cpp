@@ -0,0 +1,203 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#include "DenoiserTiling.h"
+#include "Checks.h"
+#include "gdt/random/random.h"
+// std
+#include <algorithm>
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! one axis of a tile plan */
+  struct TileSpan {
+    int inputBegin, inputSize, outputBegin, outputSize;
+  };
+
+  /*! split [0,size) into spans: the first one gets tile+overlap
+      output pixels (it has no context to its left), all others tile;
+      each reads a fixed-size window starting 'overlap' before its
+      output, pulled back at the far end so it never leaves the image */
+  static std::vector<TileSpan> splitAxis(int size, int tile, int overlap)
+  {
+    std::vector<TileSpan> spans;
+    const int inputSize = std::min(tile+2*overlap,size);
+    for (int begin=0;begin<size;) {
+      TileSpan span;
+      span.outputBegin = begin;
+      span.outputSize  = begin == 0
+        ? std::min(size,tile+overlap)
+        : std::min(tile,size-begin);
+      span.inputSize   = inputSize;
+      span.inputBegin  = begin == 0 ? 0 : std::min(begin-overlap,size-inputSize);
+      spans.push_back(span);
+      begin += span.outputSize;
+    }
+    return spans;
+  }
+  
+  std::vector<DenoiserTile> planDenoiserTiles(const vec2i &imageSize,
+                                              const vec2i &tileSize,
+                                              int overlap)
+  {
+    std::vector<DenoiserTile> tiles;
+    if (imageSize.x <= 0 || imageSize.y <= 0) return tiles;
+    const std::vector<TileSpan> spansX
+      = splitAxis(imageSize.x,std::max(1,tileSize.x),std::max(0,overlap));
+    const std::vector<TileSpan> spansY
+      = splitAxis(imageSize.y,std::max(1,tileSize.y),std::max(0,overlap));
+    for (auto &y : spansY)
+      for (auto &x : spansX) {
+        DenoiserTile tile;
+        tile.inputOrigin  = vec2i(x.inputBegin,y.inputBegin);
+        tile.inputSize    = vec2i(x.inputSize,y.inputSize);
+        tile.outputOrigin = vec2i(x.outputBegin,y.outputBegin);
+        tile.outputSize   = vec2i(x.outputSize,y.outputSize);
+        tiles.push_back(tile);
+      }
+    return tiles;
+  }
+
+  /*! true if the outputs cover every pixel exactly once, and every
+      input window lies in the image, is the same size, contains its
+      output, and has 'overlap' pixels of context wherever the image
+      has them */
+  static bool validPlan(const std::vector<DenoiserTile> &tiles,
+                        const vec2i &imageSize, int overlap)
+  {
+    if (tiles.empty()) return false;
+    std::vector<int> count(imageSize.x*imageSize.y,0);
+    for (auto &tile : tiles) {
+      const vec2i inEnd  = tile.inputOrigin + tile.inputSize;
+      const vec2i outEnd = tile.outputOrigin + tile.outputSize;
+      if (tile.inputSize != tiles[0].inputSize) return false;
+      if (tile.inputOrigin.x < 0 || tile.inputOrigin.y < 0
+          || inEnd.x > imageSize.x || inEnd.y > imageSize.y)
+        return false;
+      const vec2i before = tile.inputOffset();
+      const vec2i after  = inEnd - outEnd;
+      for (int a=0;a<2;a++) {
+        if (before[a] < std::min(overlap,tile.outputOrigin[a])) return false;
+        if (after[a]  < std::min(overlap,imageSize[a]-outEnd[a])) return false;
+      }
+      for (int iy=tile.outputOrigin.y;iy<outEnd.y;iy++)
+        for (int ix=tile.outputOrigin.x;ix<outEnd.x;ix++)
+          count[ix+imageSize.x*iy]++;
+    }
+    for (int c : count) if (c != 1) return false;
+    return true;
+  }
+
+  /*! a stand-in for the denoiser: a box filter of given radius over
+      the window [begin,end), clamped at the window's edges - which is
+      all the denoiser can do, too, since it doesn't see beyond them */
+  static float boxFilter(const std::vector<float> &image, int width,
+                         const vec2i &begin, const vec2i &end,
+                         int x, int y, int radius)
+  {
+    float sum = 0.f;
+    for (int dy=-radius;dy<=radius;dy++)
+      for (int dx=-radius;dx<=radius;dx++) {
+        const int sx = std::max(begin.x,std::min(end.x-1,x+dx));
+        const int sy = std::max(begin.y,std::min(end.y-1,y+dy));
+        sum += image[sx+width*sy];
+      }
+    return sum;
+  }
+
+  /*! run the filter tile by tile, and count the pixels that differ
+      from running it on the whole image */
+  static int countSeamPixels(const vec2i &imageSize, const vec2i &tileSize,
+                             int overlap, int radius)
+  {
+    gdt::LCG<16> random(imageSize.x,imageSize.y);
+    std::vector<float> image(imageSize.x*imageSize.y);
+    for (auto &v : image) v = random();
+
+    int numDifferent = 0;
+    for (auto &tile : planDenoiserTiles(imageSize,tileSize,overlap)) {
+      const vec2i inEnd  = tile.inputOrigin + tile.inputSize;
+      const vec2i outEnd = tile.outputOrigin + tile.outputSize;
+      for (int iy=tile.outputOrigin.y;iy<outEnd.y;iy++)
+        for (int ix=tile.outputOrigin.x;ix<outEnd.x;ix++) {
+          const float whole
+            = boxFilter(image,imageSize.x,vec2i(0),imageSize,ix,iy,radius);
+          const float tiled
+            = boxFilter(image,imageSize.x,tile.inputOrigin,inEnd,ix,iy,radius);
+          if (whole != tiled) numDifferent++;
+        }
+    }
+    return numDifferent;
+  }
+  
+  bool checkDenoiserTiling()
+  {
+    beginCheck("denoiser tiling");
+    bool ok = true;
+
+    const vec2i imageSizes[] = { vec2i(1920,1080),vec2i(1000,37),vec2i(513,512),vec2i(1) };
+    const int   tileSizes[]  = { 256,64,17 };
+    const int   overlaps[]   = { 0,8,32 };
+    bool allValid = true;
+    for (auto &imageSize : imageSizes)
+      for (int tileSize : tileSizes)
+        for (int overlap : overlaps)
+          allValid &= validPlan(planDenoiserTiles(imageSize,vec2i(tileSize),overlap),
+                                imageSize,overlap);
+    ok &= checkResult("outputs cover the image once, inputs carry their overlap",allValid);
+
+    {
+      const std::vector<DenoiserTile> one
+        = planDenoiserTiles(vec2i(1920,1080),vec2i(2048),64);
+      ok &= checkResult("an image smaller than a tile is a single tile",
+                        one.size() == 1
+                        && one[0].inputSize == vec2i(1920,1080)
+                        && one[0].outputSize == vec2i(1920,1080));
+    }
+    {
+      // what bounds the denoiser's memory: no input window is ever
+      // larger than a tile plus its overlap, however big the image
+      const vec2i tileSize(1024);
+      const int   overlap = 64;
+      const std::vector<DenoiserTile> tiles
+        = planDenoiserTiles(vec2i(16384,8192),tileSize,overlap);
+      std::cout << "  16k x 8k image: " << tiles.size() << " tiles of "
+                << tiles[0].inputSize.x << "x" << tiles[0].inputSize.y
+                << " input pixels" << std::endl;
+      ok &= checkResult("input windows are bounded by tile+2*overlap",
+                        tiles[0].inputSize == tileSize+2*overlap);
+    }
+
+    // the point of the overlap: a filter reaching no further than it
+    // can't tell tiles from the whole image - and one reaching
+    // further can, so the test isn't vacuous
+    const int sameWithOverlap = countSeamPixels(vec2i(300,200),vec2i(64),4,4);
+    const int seamsWithout    = countSeamPixels(vec2i(300,200),vec2i(64),2,4);
+    std::cout << "  box filter of radius 4: " << sameWithOverlap
+              << " seam pixels with overlap 4, " << seamsWithout
+              << " with overlap 2" << std::endl;
+    ok &= checkResult("tiled filtering matches the whole image when overlap covers the filter",
+                      sameWithOverlap == 0 && seamsWithout > 0);
+
+    return endCheck("denoiser tiling",ok);
+  }
+  
+} // ::opz
@@ -0,0 +1,62 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+// std
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  /*! one tile of a tiled denoiser invocation: the denoiser reads the
+      'input' window - the output rectangle plus up to 'overlap'
+      pixels of context on each side - and writes only the 'output'
+      rectangle, so neighbouring tiles never see a seam. all input
+      windows of a plan have the same size (they get shifted back
+      inside the image at its far borders rather than clipped), which
+      is what the denoiser was set up for */
+  struct DenoiserTile {
+    vec2i inputOrigin;
+    vec2i inputSize;
+    vec2i outputOrigin;
+    vec2i outputSize;
+    /*! where the output rectangle starts within the input window -
+        the denoiser's inputOffsetX/Y */
+    inline vec2i inputOffset() const { return outputOrigin - inputOrigin; }
+  };
+
+  /*! split an image of 'imageSize' pixels into tiles of at most
+      tileSize^2 output pixels, each with 'overlap' pixels of context -
+      the same split optixUtilDenoiserSplitImage() makes, so denoiser
+      memory only ever depends on tileSize+2*overlap, never on the
+      image. an image no bigger than one tile gives one tile covering
+      all of it */
+  std::vector<DenoiserTile> planDenoiserTiles(const vec2i &imageSize,
+                                              const vec2i &tileSize,
+                                              int overlap);
+
+  /*! host-side checks of the tile plans: outputs cover the image
+      exactly once, inputs stay inside it and carry their overlap, and
+      a local filter run tile by tile gives the same image as run on
+      the whole; prints what it finds, and returns true if all pass */
+  bool checkDenoiserTiling();
+  
+} // ::opz
@@ -0,0 +1,84 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Checks.h"
+#include "gdt/random/random.h"
+// std
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! how ResolutionController and SampleCountController move their
+      setting from 'current' towards the 'ideal' one a frame measured:
+      ideal gets clamped to [lo,hi], and of the way there we only take
+      a damped step (gain), and none at all if we're within deadBand
+      (relative) already - so measurement noise doesn't make it flicker */
+  inline float dampedStep(float current, float ideal, float lo, float hi,
+                          float gain, float deadBand)
+  {
+    ideal = std::max(lo,std::min(hi,ideal));
+    if (std::fabs(ideal-current) <= deadBand*current)
+      // (but do snap to the limits, rather than hover just short)
+      return (ideal == lo || ideal == hi) ? ideal : current;
+    return std::max(lo,std::min(hi,current + gain*(ideal-current)));
+  }
+
+  // ------------------------------------------------------------------
+  // what the controllers' checks simulate gpus with
+  // ------------------------------------------------------------------
+
+  /*! seeded relative jitter for simulated timings: every call to
+      jitter() is a factor in [1-noise,1+noise] */
+  struct SimulatedNoise {
+    double       noise;
+    gdt::LCG<16> random;
+    SimulatedNoise(double noise, unsigned seed0, unsigned seed1)
+      : noise(noise), random(seed0,seed1)
+    {}
+    inline double jitter() { return 1. + noise*(2.*random()-1.); }
+  };
+
+  /*! the steady-load check both controllers share: run 'frame' -
+      which renders one simulated frame and returns what the
+      controller picked for it - numWarmup times, then numFrames more,
+      counting how often the pick changes; passes if that's at most
+      maxChanges */
+  template<typename Frame>
+  bool checkNoFlicker(const std::string &what, Frame frame,
+                      int numWarmup = 20, int numFrames = 180, int maxChanges = 2)
+  {
+    auto last = frame();
+    for (int frameID=1;frameID<numWarmup;frameID++)
+      last = frame();
+    int numChanges = 0;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      const auto picked = frame();
+      if (picked != last) numChanges++;
+      last = picked;
+    }
+    std::cout << "  noisy gpu: " << numChanges << " " << what << " changes over "
+              << numFrames << " settled frames" << std::endl;
+    return checkResult(("noise doesn't make the "+what+" flicker").c_str(),
+                       numChanges <= maxChanges);
+  }
+  
+} // ::opz
@@ -0,0 +1,142 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+
+#include "HalfFloat.h"
+#include "Checks.h"
+#include "gdt/random/random.h"
+// std
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! value of half h for judging rounding: inf counts as 2^16, the
+      step past the largest half, so only past their midpoint 65520
+      do floats round to it */
+  static double roundingValue(uint16_t h)
+  {
+    if ((h & 0x7fff) == 0x7c00) return (h & 0x8000) ? -65536. : 65536.;
+    return halfToFloat(h);
+  }
+  
+  /*! true if h is the half nearest to f - with ties going to the
+      even one - judged against its neighbours in double */
+  static bool roundsToNearest(float f, uint16_t h)
+  {
+    const double err = std::fabs(double(f) - roundingValue(h));
+    // (neighbours of the same sign, one step down and up in magnitude)
+    for (int step=-1;step<=1;step+=2) {
+      const int m = (h & 0x7fff) + step;
+      if (m < 0 || m > 0x7c00) continue;
+      const double otherErr
+        = std::fabs(double(f) - roundingValue(uint16_t((h & 0x8000) | m)));
+      if (otherErr < err) return false;
+      if (otherErr == err && (h & 1)) return false;
+    }
+    return true;
+  }
+  
+  bool checkHalfFloat()
+  {
+    beginCheck("half floats");
+    bool ok = true;
+
+    bool allRoundTrip = true;
+    for (uint32_t h=0;h<0x10000;h++) {
+      const float f = halfToFloat(uint16_t(h));
+      const uint16_t back = floatToHalf(f);
+      if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff))
+        allRoundTrip &= std::isnan(f) && (back & 0x7c00) == 0x7c00 && (back & 0x3ff);
+      else
+        allRoundTrip &= back == h;
+    }
+    ok &= checkResult("all 65536 halfs convert to float and back",allRoundTrip);
+
+    ok &= checkResult("special values",
+                      floatToHalf(1.f) == 0x3c00
+                      && floatToHalf(-2.f) == 0xc000
+                      && floatToHalf(65504.f) == 0x7bff
+                      && floatToHalf(65519.f) == 0x7bff
+                      && floatToHalf(65520.f) == 0x7c00
+                      && floatToHalf(1e9f) == 0x7c00
+                      && floatToHalf(std::ldexp(1.f,-24)) == 0x0001
+                      && floatToHalf(std::ldexp(1.f,-25)) == 0x0000
+                      && floatToHalf(std::ldexp(1.5f,-25)) == 0x0001
+                      && floatToHalf(std::ldexp(1.f,-14)) == 0x0400
+                      && std::isinf(halfToFloat(floatToHalf(INFINITY)))
+                      && std::isnan(halfToFloat(floatToHalf(NAN))));
+
+    // random floats over the whole half range - normal, denormal,
+    // and overflowing - plus exact ties, all round to nearest even
+    gdt::LCG<16> random(7,11);
+    bool allNearest = true;
+    for (int i=0;i<200000;i++) {
+      const float f
+        = (random() < .5f ? -1.f : 1.f)
+        * std::ldexp(1.f+random(),int(random()*44.f)-28);
+      allNearest &= roundsToNearest(f,floatToHalf(f));
+      // the point halfway to the next half up
+      const uint16_t h = floatToHalf(std::fabs(f));
+      if (h < 0x7bff) {
+        const float tie = .5f*(halfToFloat(h)+halfToFloat(uint16_t(h+1)));
+        allNearest &= roundsToNearest(tie,floatToHalf(tie));
+      }
+    }
+    ok &= checkResult("floats round to the nearest half, ties to even",allNearest);
+
+    // pixel buffers: half3 drops alpha, and both keep within half's
+    // precision of what got written
+    {
+      std::vector<uint16_t> half3(3*64), half4(4*64);
+      const PixelBuffer buffer3 = { half3.data(), PIXEL_HALF3 };
+      const PixelBuffer buffer4 = { half4.data(), PIXEL_HALF4 };
+      float maxError = 0.f;
+      bool  alphaOk = true;
+      for (int i=0;i<64;i++) {
+        const vec4f v(random()*10.f,random(),random()*1e-3f,.5f);
+        buffer3.write(i,v);
+        buffer4.write(i,v);
+        const vec4f r3 = buffer3.read(i), r4 = buffer4.read(i);
+        alphaOk &= r3.w == 1.f && r4.w == .5f;
+        for (int c=0;c<3;c++) {
+          maxError = std::max(maxError,std::fabs(r3[c]-v[c])/v[c]);
+          maxError = std::max(maxError,std::fabs(r4[c]-v[c])/v[c]);
+        }
+      }
+      ok &= checkResult("half3/half4 pixel buffers keep 11 bits, and half3 reads alpha as 1",
+                        alphaOk && maxError <= std::ldexp(1.f,-11));
+    }
+
+    // what the frame buffers cost, per 4k frame: color (which
+    // accumulates, so stays float), normal, albedo and denoised
+    const double numPixels = 3840.*2160.;
+    const double allFloat = numPixels*4*pixelSize(PIXEL_FLOAT4);
+    const double halfAovs = numPixels*(pixelSize(PIXEL_FLOAT4)
+                                       + 2*pixelSize(PIXEL_HALF3)
+                                       + pixelSize(PIXEL_HALF4));
+    std::cout << "  4k frame buffers: " << int(allFloat/(1<<20)) << "MB as float4, "
+              << int(halfAovs/(1<<20)) << "MB with half aovs" << std::endl;
+
+    return endCheck("half floats",ok);
+  }
+  
+} // ::opz
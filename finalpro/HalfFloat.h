@@ -0,0 +1,147 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+#ifdef __CUDACC__
+# include <cuda_fp16.h>
+#endif
+// std
+#include <cstdint>
+#include <cstring>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  /*! float to IEEE half, rounding to nearest even; too large
+      becomes inf, too small zero, nan stays nan. the device uses
+      the hardware conversion, the host does the same in bits */
+  inline __both__ uint16_t floatToHalf(float f)
+  {
+#ifdef __CUDA_ARCH__
+    return __half_as_ushort(__float2half_rn(f));
+#else
+    uint32_t x;
+    memcpy(&x,&f,sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+    // inf and nan (keeping it a quiet nan)
+    if (x >= 0x7f800000)
+      return uint16_t(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0));
+    // 65520 and up round to inf
+    if (x >= 0x477ff000)
+      return uint16_t(sign | 0x7c00);
+    // below 2^-14, halfs are denormal, in steps of 2^-24
+    if (x < 0x38800000) {
+      if (x < 0x33000000) return uint16_t(sign);
+      const uint32_t shift = 126 - (x >> 23);
+      const uint32_t m     = (x & 0x7fffff) | 0x800000;
+      const uint32_t rest  = m & ((1u << shift) - 1);
+      const uint32_t tie   = 1u << (shift - 1);
+      uint32_t h = m >> shift;
+      if (rest > tie || (rest == tie && (h & 1))) h++;
+      return uint16_t(sign | h);
+    }
+    // normal: rebias the exponent, round off 13 bits of mantissa (a
+    // carry into the exponent is just what rounding up should do)
+    uint32_t h = (x >> 13) - (112u << 10);
+    const uint32_t rest = x & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+    return uint16_t(sign | h);
+#endif
+  }
+
+  /*! IEEE half to float, which is exact */
+  inline __both__ float halfToFloat(uint16_t h)
+  {
+#ifdef __CUDA_ARCH__
+    return __half2float(__ushort_as_half(h));
+#else
+    const uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t e = (h >> 10) & 0x1f;
+    uint32_t m = h & 0x3ff;
+    uint32_t x;
+    if (e == 0x1f)
+      x = sign | 0x7f800000 | (m << 13);
+    else if (e == 0 && m == 0)
+      x = sign;
+    else if (e == 0) {
+      // denormal: shift up until it's normal
+      e = 113;
+      while (!(m & 0x400)) { m <<= 1; e--; }
+      x = sign | (e << 23) | ((m & 0x3ff) << 13);
+    } else
+      x = sign | ((e + 112) << 23) | (m << 13);
+    float f;
+    memcpy(&f,&x,sizeof(f));
+    return f;
+#endif
+  }
+
+  /*! how the pixels of a frame buffer are stored */
+  typedef enum {
+    PIXEL_FLOAT4=0,
+    /*! rgb only, for buffers whose alpha is always 1 */
+    PIXEL_HALF3,
+    PIXEL_HALF4
+  } PixelFormat;
+
+  /*! bytes per pixel */
+  inline __both__ int pixelSize(int format)
+  {
+    return format == PIXEL_HALF3 ? 6 : format == PIXEL_HALF4 ? 8 : 16;
+  }
+
+  /*! a frame buffer in one of the PIXEL_* formats, read and written
+      as vec4f either way - the same on host and device */
+  struct PixelBuffer {
+    void *data;
+    int   format;
+
+    inline __both__ vec4f read(size_t i) const
+    {
+      if (format == PIXEL_FLOAT4)
+        return ((const vec4f*)data)[i];
+      const uint16_t *h = (const uint16_t*)data + i*(format == PIXEL_HALF3 ? 3 : 4);
+      return vec4f(halfToFloat(h[0]),halfToFloat(h[1]),halfToFloat(h[2]),
+                   format == PIXEL_HALF3 ? 1.f : halfToFloat(h[3]));
+    }
+
+    inline __both__ void write(size_t i, const vec4f &v) const
+    {
+      if (format == PIXEL_FLOAT4) {
+        ((vec4f*)data)[i] = v;
+        return;
+      }
+      uint16_t *h = (uint16_t*)data + i*(format == PIXEL_HALF3 ? 3 : 4);
+      h[0] = floatToHalf(v.x);
+      h[1] = floatToHalf(v.y);
+      h[2] = floatToHalf(v.z);
+      if (format == PIXEL_HALF4) h[3] = floatToHalf(v.w);
+    }
+  };
+
+  /*! host-side checks of the half conversions (all halfs, and a
+      seeded set of floats against nearest-even rounding) and of
+      PixelBuffer; prints what it finds, and returns true if all pass */
+  bool checkHalfFloat();
+  
+} // ::opz
@@ -0,0 +1,225 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+
+#include "ImageIO.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "3rdParty/stb_image_write.h"
+// std
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  ImageFormat imageFormatOf(const std::string &fileName)
+  {
+    const size_t dot = fileName.find_last_of('.');
+    if (dot == std::string::npos) return IMAGE_FORMAT_UNKNOWN;
+    std::string ext = fileName.substr(dot+1);
+    std::transform(ext.begin(),ext.end(),ext.begin(),::tolower);
+    if (ext == "png") return IMAGE_PNG;
+    if (ext == "exr") return IMAGE_EXR;
+    if (ext == "hdr") return IMAGE_HDR;
+    if (ext == "pfm") return IMAGE_PFM;
+    if (ext == "raw") return IMAGE_RAW;
+    return IMAGE_FORMAT_UNKNOWN;
+  }
+
+  void writePNG(const std::string &fileName, const vec2i &size, const uint32_t *pixels)
+  {
+    // (a negative stride has stb flip it for us)
+    const uint32_t *topRow = pixels + size_t(size.y-1)*size.x;
+    if (!stbi_write_png(fileName.c_str(),size.x,size.y,4,topRow,-size.x*int(sizeof(uint32_t))))
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  /*! little-endian bytes of an openexr header or scanline */
+  struct ExrBytes {
+    std::vector<char> data;
+
+    void append(const void *ptr, size_t size)
+    {
+      data.insert(data.end(),(const char*)ptr,(const char*)ptr+size);
+    }
+    void appendInt(int32_t i)   { append(&i,sizeof(i)); }
+    void appendFloat(float f)   { append(&f,sizeof(f)); }
+    void appendString(const char *s) { append(s,strlen(s)+1); }
+    /*! name, type, and size of an attribute; its value comes next */
+    void attribute(const char *name, const char *type, int32_t size)
+    {
+      appendString(name);
+      appendString(type);
+      appendInt(size);
+    }
+  };
+
+  void writeEXR(const std::string &fileName, const vec2i &size, const vec4f *pixels)
+  {
+    // channels have to be in alphabetical order; all 32-bit float
+    const char  *channelNames[4] = { "A","B","G","R" };
+    const int    channelOf[4]    = { 3,2,1,0 };
+    const int32_t EXR_FLOAT = 2;
+
+    ExrBytes header;
+    const uint32_t magic = 20000630;
+    header.append(&magic,sizeof(magic));
+    // version 2, single-part scanline
+    header.appendInt(2);
+
+    header.attribute("channels","chlist",4*(2+16)+1);
+    for (auto name : channelNames) {
+      header.appendString(name);
+      header.appendInt(EXR_FLOAT);
+      // pLinear, and three reserved bytes
+      header.appendInt(0);
+      // x and y sampling
+      header.appendInt(1);
+      header.appendInt(1);
+    }
+    header.append("",1);
+    header.attribute("compression","compression",1);
+    header.append("",1);
+    for (auto window : { "dataWindow","displayWindow" }) {
+      header.attribute(window,"box2i",16);
+      header.appendInt(0);
+      header.appendInt(0);
+      header.appendInt(size.x-1);
+      header.appendInt(size.y-1);
+    }
+    header.attribute("lineOrder","lineOrder",1);
+    header.append("",1);
+    header.attribute("pixelAspectRatio","float",4);
+    header.appendFloat(1.f);
+    header.attribute("screenWindowCenter","v2f",8);
+    header.appendFloat(0.f);
+    header.appendFloat(0.f);
+    header.attribute("screenWindowWidth","float",4);
+    header.appendFloat(1.f);
+    header.append("",1);
+
+    // uncompressed, every scanline is a block of its own: its y, its
+    // size, then each channel's row of values
+    const int32_t lineSize = 4*size.x*int32_t(sizeof(float));
+    const size_t  blockSize = 2*sizeof(int32_t) + lineSize;
+    ExrBytes offsets;
+    const uint64_t firstBlock = header.data.size() + size.y*sizeof(uint64_t);
+    for (int y=0;y<size.y;y++) {
+      const uint64_t offset = firstBlock + y*blockSize;
+      offsets.append(&offset,sizeof(offset));
+    }
+
+    std::ofstream out(fileName,std::ios::binary);
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+    out.write(header.data.data(),header.data.size());
+    out.write(offsets.data.data(),offsets.data.size());
+    std::vector<float> line(4*size.x);
+    for (int y=0;y<size.y;y++) {
+      // (exr's y goes down, ours goes up)
+      const vec4f *row = pixels + size_t(size.y-1-y)*size.x;
+      for (int c=0;c<4;c++)
+        for (int x=0;x<size.x;x++)
+          line[c*size.x+x] = (&row[x].x)[channelOf[c]];
+      out.write((const char*)&y,sizeof(y));
+      out.write((const char*)&lineSize,sizeof(lineSize));
+      out.write((const char*)line.data(),lineSize);
+    }
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  void writeHDR(const std::string &fileName, const vec2i &size, const vec4f *pixels)
+  {
+    std::vector<vec3f> flipped(size_t(size.x)*size.y);
+    for (int y=0;y<size.y;y++)
+      for (int x=0;x<size.x;x++) {
+        const vec4f &p = pixels[size_t(size.y-1-y)*size.x+x];
+        flipped[size_t(y)*size.x+x] = vec3f(p.x,p.y,p.z);
+      }
+    if (!stbi_write_hdr(fileName.c_str(),size.x,size.y,3,&flipped[0].x))
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  void writePFM(const std::string &fileName, const vec2i &size, const vec4f *pixels)
+  {
+    std::ofstream out(fileName,std::ios::binary);
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+    // (a negative scale says little-endian; rows go bottom to top,
+    // like ours)
+    out << "PF\n" << size.x << " " << size.y << "\n-1.0\n";
+    std::vector<vec3f> line(size.x);
+    for (int y=0;y<size.y;y++) {
+      for (int x=0;x<size.x;x++) {
+        const vec4f &p = pixels[size_t(y)*size.x+x];
+        line[x] = vec3f(p.x,p.y,p.z);
+      }
+      out.write((const char*)line.data(),size.x*sizeof(vec3f));
+    }
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  void writeRaw(const std::string &fileName, const void *pixels, size_t numBytes)
+  {
+    std::ofstream out(fileName,std::ios::binary);
+    out.write((const char*)pixels,numBytes);
+    if (!out)
+      throw std::runtime_error("could not write "+fileName);
+  }
+
+  void writeImage(const std::string &fileName, const vec2i &size, const uint32_t *pixels)
+  {
+    switch (imageFormatOf(fileName)) {
+    case IMAGE_PNG:
+      writePNG(fileName,size,pixels);
+      break;
+    case IMAGE_RAW:
+      writeRaw(fileName,pixels,size_t(size.x)*size.y*sizeof(uint32_t));
+      break;
+    default:
+      throw std::runtime_error("can't write rgba8 pixels to "+fileName);
+    }
+  }
+
+  void writeImage(const std::string &fileName, const vec2i &size, const vec4f *pixels)
+  {
+    switch (imageFormatOf(fileName)) {
+    case IMAGE_EXR:
+      writeEXR(fileName,size,pixels);
+      break;
+    case IMAGE_HDR:
+      writeHDR(fileName,size,pixels);
+      break;
+    case IMAGE_PFM:
+      writePFM(fileName,size,pixels);
+      break;
+    case IMAGE_RAW:
+      writeRaw(fileName,pixels,size_t(size.x)*size.y*sizeof(vec4f));
+      break;
+    default:
+      throw std::runtime_error("can't write linear color to "+fileName);
+    }
+  }
+
+} // ::opz
@@ -0,0 +1,59 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+// common gdt helper tools
+#include "gdt/math/vec.h"
+// std
+#include <string>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  /*! image file formats we write, by file extension: png takes the
+      display's tone-mapped rgba8 pixels, exr, hdr and pfm linear
+      color; raw is just the pixels - either kind - with no header */
+  typedef enum { IMAGE_PNG, IMAGE_EXR, IMAGE_HDR, IMAGE_PFM, IMAGE_RAW,
+                 IMAGE_FORMAT_UNKNOWN } ImageFormat;
+
+  ImageFormat imageFormatOf(const std::string &fileName);
+  inline bool isLinearFormat(ImageFormat format) { return format != IMAGE_PNG; }
+
+  /*! @{ write an image the way the renderer has it - bottom row
+      first - as an image file, which has its top row first. throws
+      on failure */
+  void writePNG(const std::string &fileName, const vec2i &size, const uint32_t *pixels);
+  /*! uncompressed scanline openexr, 32-bit float rgba */
+  void writeEXR(const std::string &fileName, const vec2i &size, const vec4f *pixels);
+  /*! radiance rgbe, through stb */
+  void writeHDR(const std::string &fileName, const vec2i &size, const vec4f *pixels);
+  /*! portable float map, little-endian rgb */
+  void writePFM(const std::string &fileName, const vec2i &size, const vec4f *pixels);
+  /*! the pixels' bytes, as they are - bottom row first */
+  void writeRaw(const std::string &fileName, const void *pixels, size_t numBytes);
+  /*! @} */
+
+  /*! @{ write in whichever of the above the file name says; throws
+      for formats that don't take that kind of pixels */
+  void writeImage(const std::string &fileName, const vec2i &size, const uint32_t *pixels);
+  void writeImage(const std::string &fileName, const vec2i &size, const vec4f *pixels);
+  /*! @} */
+
+} // ::opz
@@ -0,0 +1,323 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#include "ImageWriter.h"
+#include "Checks.h"
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#ifdef _WIN32
+#  include <direct.h>
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  ImageWriter::ImageWriter(int numThreads, int maxQueued)
+    : pool(numThreads),
+      queueLimit(std::max(1,maxQueued))
+  {}
+
+  ImageWriter::~ImageWriter()
+  {
+    pool.wait();
+  }
+
+  void ImageWriter::enqueue(std::function<void()> encode)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      roomInQueue.wait(lock,[this]{ return numQueued < queueLimit; });
+      numQueued++;
+      peakQueued = std::max(peakQueued,numQueued);
+    }
+    pool.enqueue([this,encode]{
+        std::string error;
+        try {
+          encode();
+        } catch (std::exception &e) {
+          error = e.what();
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          numQueued--;
+          if (error.empty())
+            numWritten++;
+          else if (firstError.empty())
+            firstError = error;
+        }
+        roomInQueue.notify_one();
+      });
+  }
+
+  void ImageWriter::write(const std::string &fileName, const vec2i &size,
+                          std::vector<uint32_t> &&pixels)
+  {
+    const ImageFormat format = imageFormatOf(fileName);
+    if (format != IMAGE_PNG && format != IMAGE_RAW)
+      throw std::runtime_error("can't write rgba8 pixels to "+fileName);
+    // (std::function wants to be copyable, so the pixels go in a
+    // shared_ptr rather than being moved into the lambda)
+    auto frame = std::make_shared<std::vector<uint32_t>>(std::move(pixels));
+    enqueue([fileName,size,frame]{ writeImage(fileName,size,frame->data()); });
+  }
+
+  void ImageWriter::write(const std::string &fileName, const vec2i &size,
+                          std::vector<vec4f> &&pixels)
+  {
+    const ImageFormat format = imageFormatOf(fileName);
+    if (format == IMAGE_PNG || format == IMAGE_FORMAT_UNKNOWN)
+      throw std::runtime_error("can't write linear color to "+fileName);
+    auto frame = std::make_shared<std::vector<vec4f>>(std::move(pixels));
+    enqueue([fileName,size,frame]{ writeImage(fileName,size,frame->data()); });
+  }
+
+  void ImageWriter::write(const std::string &fileName, const vec2i &size,
+                          std::vector<uint8_t> &&pixels, int pixelFormat)
+  {
+    const ImageFormat format = imageFormatOf(fileName);
+    if (format == IMAGE_PNG || format == IMAGE_FORMAT_UNKNOWN)
+      throw std::runtime_error("can't write linear color to "+fileName);
+    const size_t numPixels = size_t(size.x)*size.y;
+    if (pixels.size() < numPixels*pixelSize(pixelFormat))
+      throw std::runtime_error("not enough pixels for "+fileName);
+    auto frame = std::make_shared<std::vector<uint8_t>>(std::move(pixels));
+    enqueue([fileName,size,frame,pixelFormat,numPixels]{
+        const PixelBuffer in = { frame->data(),pixelFormat };
+        std::vector<vec4f> color(numPixels);
+        for (size_t i=0;i<numPixels;i++) color[i] = in.read(i);
+        writeImage(fileName,size,color.data());
+      });
+  }
+
+  void ImageWriter::finish()
+  {
+    pool.wait();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!firstError.empty()) {
+      const std::string error = firstError;
+      firstError.clear();
+      throw std::runtime_error(error);
+    }
+  }
+
+  // ------------------------------------------------------------------
+  // checks
+  // ------------------------------------------------------------------
+
+  /*! a new, empty directory for the checks to write to; throws if
+      there is no way to make one */
+  static std::string makeTempDirectory()
+  {
+#ifdef _WIN32
+    char *name = _tempnam(nullptr,"imagewriter");
+    const std::string dir = name ? name : "";
+    free(name);
+    if (dir.empty() || _mkdir(dir.c_str()) != 0)
+#else
+    const char *tmp = getenv("TMPDIR");
+    std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp")+"/imagewriter_XXXXXX";
+    const std::string dir = mkdtemp(&pattern[0]) ? pattern : "";
+    if (dir.empty())
+#endif
+      throw std::runtime_error("could not create a temporary directory");
+    return dir;
+  }
+
+  /*! remove a directory makeTempDirectory() made, once empty */
+  static void removeTempDirectory(const std::string &dir)
+  {
+#ifdef _WIN32
+    _rmdir(dir.c_str());
+#else
+    rmdir(dir.c_str());
+#endif
+  }
+
+  static std::string readFile(const std::string &fileName)
+  {
+    std::ifstream in(fileName,std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+  }
+
+  /*! some smooth color with a little detail, so the encoders have
+      something realistic to compress */
+  static void fillTestFrame(const vec2i &size, int frameID,
+                            std::vector<vec4f> &color, std::vector<uint32_t> &rgba)
+  {
+    color.resize(size_t(size.x)*size.y);
+    rgba.resize(size_t(size.x)*size.y);
+    for (int y=0;y<size.y;y++)
+      for (int x=0;x<size.x;x++) {
+        const size_t i = size_t(y)*size.x+x;
+        const float u = float(x)/size.x, v = float(y)/size.y;
+        const float detail = float((x*7+y*13+frameID) & 15)/64.f;
+        color[i] = vec4f(u+detail,v,.5f*(u+v)+frameID*.01f,1.f);
+        const vec3i c = clamp(vec3i(255.f*vec3f(color[i].x,color[i].y,color[i].z)),
+                              vec3i(0),vec3i(255));
+        rgba[i] = c.x | (c.y << 8) | (c.z << 16) | (255u << 24);
+      }
+  }
+
+  bool checkImageWriter()
+  {
+    beginCheck("image writer");
+    bool ok = true;
+    const std::string dir = makeTempDirectory();
+    std::cout << "  writing to " << dir << std::endl;
+
+    // small frames, read back
+    {
+      const vec2i size(37,23);
+      std::vector<vec4f> color;
+      std::vector<uint32_t> rgba;
+      fillTestFrame(size,0,color,rgba);
+      const std::vector<vec4f>    colorCopy = color;
+      const std::vector<uint32_t> rgbaCopy  = rgba;
+      // the same color again, as half4 pixels the way the renderer
+      // might keep them - so it reads back rounded to half
+      std::vector<uint8_t> half(colorCopy.size()*pixelSize(PIXEL_HALF4));
+      const PixelBuffer halfPixels = { half.data(),PIXEL_HALF4 };
+      for (size_t i=0;i<colorCopy.size();i++) halfPixels.write(i,colorCopy[i]);
+      const std::vector<uint8_t> halfCopy = half;
+
+      ImageWriter writer(2,2);
+      writer.write(dir+"/check.pfm",size,std::move(color));
+      writer.write(dir+"/check.raw",size,std::move(rgba));
+      writer.write(dir+"/check_half.pfm",size,std::move(half),PIXEL_HALF4);
+      bool rejected = false;
+      try {
+        writer.write(dir+"/check.png",size,std::vector<vec4f>(colorCopy));
+      } catch (std::runtime_error &) {
+        rejected = true;
+      }
+      // (the temporary directory is new, so this one can't exist)
+      writer.write(dir+"/missing/x.pfm",size,std::vector<vec4f>(colorCopy));
+      bool reported = false;
+      try {
+        writer.finish();
+      } catch (std::runtime_error &) {
+        reported = true;
+      }
+      ok &= checkResult("formats that don't take the pixels get turned down",rejected);
+      ok &= checkResult("failed writes get reported by finish()",reported);
+      ok &= checkResult("... and the others written",writer.numWritten == 3);
+
+      std::stringstream expectedHeader;
+      expectedHeader << "PF\n" << size.x << " " << size.y << "\n-1.0\n";
+      const std::string header = expectedHeader.str();
+      // true if 'fileName' is a pfm of the given pixels
+      auto pfmMatches = [&](const std::string &fileName, const PixelBuffer &expected) {
+        const std::string pfm = readFile(fileName);
+        bool match = pfm.size() == header.size() + size_t(size.x)*size.y*3*sizeof(float)
+          && pfm.compare(0,header.size(),header) == 0;
+        for (size_t i=0;match && i<colorCopy.size();i++) {
+          const float *rgb = (const float*)(pfm.data()+header.size())+3*i;
+          const vec4f c = expected.read(i);
+          match = rgb[0] == c.x && rgb[1] == c.y && rgb[2] == c.z;
+        }
+        return match;
+      };
+      ok &= checkResult("pfm reads back the same, bottom row first",
+                        pfmMatches(dir+"/check.pfm",
+                                   PixelBuffer{ (void*)colorCopy.data(),PIXEL_FLOAT4 }));
+      ok &= checkResult("half pixels get converted on the way",
+                        pfmMatches(dir+"/check_half.pfm",
+                                   PixelBuffer{ (void*)halfCopy.data(),PIXEL_HALF4 }));
+      const std::string raw = readFile(dir+"/check.raw");
+      ok &= checkResult("raw reads back the same",
+                        raw.size() == rgbaCopy.size()*sizeof(uint32_t)
+                        && memcmp(raw.data(),rgbaCopy.data(),raw.size()) == 0);
+      for (auto name : { "/check.pfm","/check.raw","/check_half.pfm" })
+        std::remove((dir+name).c_str());
+    }
+
+    // a slow writer (one thread, png) against a fast producer: the
+    // queue has to stay bounded
+    {
+      const vec2i size(512,512);
+      std::vector<vec4f> color;
+      std::vector<uint32_t> rgba;
+      ImageWriter writer(1,3);
+      for (int i=0;i<12;i++) {
+        fillTestFrame(size,i,color,rgba);
+        writer.write(dir+"/check_"+std::to_string(i)+".png",size,std::move(rgba));
+      }
+      writer.finish();
+      for (int i=0;i<12;i++)
+        std::remove((dir+"/check_"+std::to_string(i)+".png").c_str());
+      ok &= checkResult("the queue never holds more than maxQueued frames",
+                        writer.peakQueued <= writer.maxQueued());
+      ok &= checkResult("... and all of them get written",writer.numWritten == 12);
+    }
+
+    removeTempDirectory(dir);
+    return endCheck("image writer",ok);
+  }
+
+  void benchmarkImageWriter(int numFrames)
+  {
+    const std::string dir = makeTempDirectory();
+    std::cout << "#osc: image writer throughput at 4k, writing to " << dir << std::endl;
+    const vec2i size(3840,2160);
+    std::vector<vec4f> color;
+    std::vector<uint32_t> rgba;
+    fillTestFrame(size,0,color,rgba);
+    const char *extensions[] = { "png","exr","hdr","pfm","raw" };
+    std::vector<int> numThreads = { 1 };
+    if (std::thread::hardware_concurrency() > 1)
+      numThreads.push_back(std::thread::hardware_concurrency());
+    for (auto ext : extensions) {
+      const bool linear = isLinearFormat(imageFormatOf(std::string("x.")+ext));
+      std::cout << "  " << ext << (linear ? " (float)" : " (rgba8)") << ":";
+      for (int threads : numThreads) {
+        ImageWriter writer(threads,2*threads);
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i=0;i<numFrames;i++) {
+          const std::string fileName = dir+"/4k_"+std::to_string(i)+"."+ext;
+          // (the copy is what a renderer would hand over, too)
+          if (linear)
+            writer.write(fileName,size,std::vector<vec4f>(color));
+          else
+            writer.write(fileName,size,std::vector<uint32_t>(rgba));
+        }
+        writer.finish();
+        const double seconds
+          = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        std::cout << "  " << threads << " thread(s) " << int(10*numFrames/seconds)/10.
+                  << " frames/s";
+        for (int i=0;i<numFrames;i++)
+          std::remove((dir+"/4k_"+std::to_string(i)+"."+ext).c_str());
+      }
+      std::cout << std::endl;
+    }
+    removeTempDirectory(dir);
+  }
+
+} // ::opz
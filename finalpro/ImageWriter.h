@@ -0,0 +1,95 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+#include "ImageIO.h"
+#include "HalfFloat.h"
+#include "ThreadPool.h"
+// std
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! writes finished frames to image files in the background: write()
+      hands a frame over and returns, and a pool of threads encodes
+      and writes them - several at once. at most maxQueued frames
+      wait or get encoded at any one time; write() blocks while that
+      many do, so a writer that can't keep up slows the renderer down
+      instead of piling up frames. see checkImageWriter() */
+  class ImageWriter {
+  public:
+    /*! numThreads 0 means one per hardware thread */
+    explicit ImageWriter(int numThreads = 0, int maxQueued = 8);
+    /*! waits for everything queued, but - unlike finish() - doesn't
+        throw whatever went wrong */
+    ~ImageWriter();
+
+    /*! @{ queue a frame (bottom row first, as the renderer has them)
+        for writing to 'fileName', in the format its extension says.
+        takes over the pixels; throws right away for formats that
+        don't take that kind of pixels */
+    void write(const std::string &fileName, const vec2i &size,
+               std::vector<uint32_t> &&pixels);
+    void write(const std::string &fileName, const vec2i &size,
+               std::vector<vec4f> &&pixels);
+    /*! linear color in one of the PixelBuffer formats, as the
+        renderer keeps it - the conversion happens on the pool too */
+    void write(const std::string &fileName, const vec2i &size,
+               std::vector<uint8_t> &&pixels, int pixelFormat);
+    /*! @} */
+
+    /*! wait for everything queued so far to be written; throws the
+        first error any of it ran into */
+    void finish();
+
+    inline int maxQueued() const { return queueLimit; }
+
+    /*! @{ frames written so far, and the most ever queued at once */
+    size_t numWritten = 0;
+    int    peakQueued = 0;
+    /*! @} */
+
+  private:
+    /*! wait for room in the queue, then have the pool run 'encode' */
+    void enqueue(std::function<void()> encode);
+
+    ThreadPool              pool;
+    const int               queueLimit;
+    std::mutex              mutex;
+    std::condition_variable roomInQueue;
+    int                     numQueued = 0;
+    std::string             firstError;
+  };
+
+  /*! host-side checks of the writer: files come out right, errors
+      get reported, and the queue stays bounded; writes only to a
+      fresh temporary directory. prints what it finds, and returns
+      true if all pass */
+  bool checkImageWriter();
+
+  /*! print how many 4k frames per second each format writes, with one
+      thread and with one per hardware thread (into a temporary
+      directory, like the checks) */
+  void benchmarkImageWriter(int numFrames = 4);
+
+} // ::opz
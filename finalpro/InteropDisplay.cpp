@@ -0,0 +1,142 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#include "InteropDisplay.h"
+#include "optix7.h"
+#include <cuda_gl_interop.h>
+// for the gl 1.5 entry points, which the gl header doesn't promise
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <iostream>
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+# define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+# define GL_STREAM_DRAW 0x88E0
+#endif
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! @{ buffer object functions, loaded through glfw */
+  typedef void (APIENTRY *GenBuffersProc)(GLsizei,GLuint*);
+  typedef void (APIENTRY *DeleteBuffersProc)(GLsizei,const GLuint*);
+  typedef void (APIENTRY *BindBufferProc)(GLenum,GLuint);
+  typedef void (APIENTRY *BufferDataProc)(GLenum,ptrdiff_t,const void*,GLenum);
+  static GenBuffersProc    genBuffers    = nullptr;
+  static DeleteBuffersProc deleteBuffers = nullptr;
+  static BindBufferProc    bindBuffer    = nullptr;
+  static BufferDataProc    bufferData    = nullptr;
+  /*! @} */
+
+  InteropDisplay::InteropDisplay(int numBuffers)
+    : resources(numBuffers,nullptr),
+      pbos(numBuffers,0)
+  {}
+
+  InteropDisplay::~InteropDisplay()
+  {
+    release();
+  }
+
+  /*! load the buffer functions, and see if cuda takes a buffer of
+      this context */
+  bool InteropDisplay::init()
+  {
+    genBuffers    = (GenBuffersProc)glfwGetProcAddress("glGenBuffers");
+    deleteBuffers = (DeleteBuffersProc)glfwGetProcAddress("glDeleteBuffers");
+    bindBuffer    = (BindBufferProc)glfwGetProcAddress("glBindBuffer");
+    bufferData    = (BufferDataProc)glfwGetProcAddress("glBufferData");
+    if (!genBuffers || !deleteBuffers || !bindBuffer || !bufferData) {
+      std::cout << "#osc: no gl buffer objects, downloading frames instead" << std::endl;
+      return false;
+    }
+
+    GLuint pbo = 0;
+    genBuffers(1,&pbo);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER,pbo);
+    bufferData(GL_PIXEL_UNPACK_BUFFER,sizeof(uint32_t),nullptr,GL_STREAM_DRAW);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    cudaGraphicsResource_t resource = nullptr;
+    const cudaError_t rc
+      = cudaGraphicsGLRegisterBuffer(&resource,pbo,cudaGraphicsRegisterFlagsWriteDiscard);
+    if (rc == cudaSuccess)
+      CUDA_CHECK(GraphicsUnregisterResource(resource));
+    deleteBuffers(1,&pbo);
+    if (rc != cudaSuccess) {
+      // (and don't leave the error for the next check to find)
+      cudaGetLastError();
+      std::cout << "#osc: no cuda-gl interop (" << cudaGetErrorString(rc)
+                << "), downloading frames instead" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void InteropDisplay::release()
+  {
+    for (size_t i=0;i<pbos.size();i++) {
+      if (resources[i])
+        CUDA_CHECK_NOEXCEPT(GraphicsUnregisterResource(resources[i]));
+      if (pbos[i])
+        deleteBuffers(1,&pbos[i]);
+      resources[i] = nullptr;
+      pbos[i]      = 0;
+    }
+    pboPixels = 0;
+  }
+
+  /*! make sure all buffers hold at least 'size' pixels - they only
+      ever grow, like the renderer's own */
+  void InteropDisplay::resize(const vec2i &size)
+  {
+    const size_t numPixels = size_t(size.x)*size.y;
+    if (numPixels <= pboPixels) return;
+    release();
+    genBuffers((GLsizei)pbos.size(),pbos.data());
+    for (size_t i=0;i<pbos.size();i++) {
+      bindBuffer(GL_PIXEL_UNPACK_BUFFER,pbos[i]);
+      bufferData(GL_PIXEL_UNPACK_BUFFER,numPixels*sizeof(uint32_t),nullptr,GL_STREAM_DRAW);
+      CUDA_CHECK(GraphicsGLRegisterBuffer(&resources[i],pbos[i],
+                                          cudaGraphicsRegisterFlagsWriteDiscard));
+    }
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    pboPixels = numPixels;
+  }
+
+  /*! copy the given buffer into 'texture' - a gpu-side copy, since
+      the pixels come from the bound unpack buffer */
+  void InteropDisplay::upload(int buffer, GLuint texture, const vec2i &size)
+  {
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER,pbos[buffer]);
+    glBindTexture(GL_TEXTURE_2D,texture);
+    if (texture != textureName || size != textureSize) {
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,size.x,size.y,0,GL_RGBA,
+                   GL_UNSIGNED_BYTE,nullptr);
+      textureName = texture;
+      textureSize = size;
+    } else
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,0,size.x,size.y,GL_RGBA,
+                      GL_UNSIGNED_BYTE,nullptr);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    // (a render thread may map the buffer again as soon as we let go)
+    glFlush();
+  }
+
+} // ::opz
@@ -0,0 +1,67 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+// cuda runtime, for the graphics resources
+#include <cuda_runtime.h>
+// common gdt helper tools
+#include "gdt/math/vec.h"
+// opengl types
+#include <GL/gl.h>
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  /*! the window's side of showing frames without a round trip
+      through the host: one gl pixel unpack buffer per frame slot,
+      registered with cuda for the renderer to tone map into, and
+      copied into the display texture on the gpu */
+  class InteropDisplay {
+  public:
+    explicit InteropDisplay(int numBuffers);
+    ~InteropDisplay();
+
+    /*! false if cuda can't get at buffers of the current gl context
+        (say, it runs on another gpu) - download frames then */
+    bool init();
+
+    /*! make sure all buffers hold at least 'size' pixels; this
+        re-registers them, so detach the renderer first */
+    void resize(const vec2i &size);
+
+    /*! copy the given buffer's first size.x*size.y pixels into
+        'texture' */
+    void upload(int buffer, GLuint texture, const vec2i &size);
+
+    /*! the registered buffers, one per frame slot */
+    std::vector<cudaGraphicsResource_t> resources;
+
+  private:
+    void release();
+
+    std::vector<GLuint> pbos;
+    size_t              pboPixels   = 0;
+    /*! size the last texture we uploaded to was allocated at */
+    GLuint              textureName = 0;
+    vec2i               textureSize { 0 };
+  };
+
+} // ::opz
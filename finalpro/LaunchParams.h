@@ -19,48 +19,249 @@
 
 #include "gdt/math/vec.h"
 #include "optix7.h"
+#include "Sampling.h"
+#include "AdaptiveSampling.h"
+#include "HalfFloat.h"
 
 /*! \namespace opz - Optix ZYM-PKU */
 namespace opz {
   using namespace gdt;
 
-  // for this simple example, we have a single ray type
-  enum { RADIANCE_RAY_TYPE=0, SHADOW_RAY_TYPE, RAY_TYPE_COUNT };
+  // for this simple example, we have a single ray type; the extend
+  // rays are only used by the wavefront renderer, and just report
+  // where they hit
+  enum { RADIANCE_RAY_TYPE=0, SHADOW_RAY_TYPE, EXTEND_RAY_TYPE, RAY_TYPE_COUNT };
 
-  struct TriangleMeshSBTData {
-    vec3f  color;
+  /*! per-ray data travels either directly in payload registers
+      (sampler index and seed + path vertex + depth = 16 values), or
+      as a pointer to a stack-allocated PRD split over two of them;
+      set from cmake */
+#ifndef USE_REGISTER_PAYLOAD
+# define USE_REGISTER_PAYLOAD 1
+#endif
+  /*! (extend rays always use four registers: mesh, prim, u and v) */
+  enum { NUM_PAYLOAD_VALUES = USE_REGISTER_PAYLOAD ? 16 : 4 };
+
+  /*! how pixels draw their samples: each from its own owen-scrambled
+      sobol sequence, or all from one shared sequence in pixel order,
+      which spreads the error as blue noise (see gdt/random/sampler.h) */
+  enum { SAMPLER_SOBOL=0, SAMPLER_BLUE_NOISE, SAMPLER_COUNT };
+
+  /*! light samples per hit point; the host sizes the wavefront
+      shadow queue from this */
+#define NUM_LIGHT_SAMPLES 4
+
+  /*! longest path the recursive variant supports; its pipeline gets
+      linked for this trace depth (plus one for the shadow rays) */
+#define MAX_PATH_DEPTH 16
+
+  /*! one entry of the device-side material table; shared by all
+      meshes using that material */
+  struct MaterialData {
+    /*! diffuse texture, or 0 if the material is untextured */
+    cudaTextureObject_t diffuseTexture;
+    vec3f               diffuseColor;
+    /*! emitted radiance (MTL 'Ke'); zero for most materials */
+    vec3f               emission;
+  };
+
+  /*! one entry of the device-side mesh table; optional attribute
+      arrays are null if the mesh doesn't have them */
+  struct MeshData {
     vec3f *vertex;
     vec3f *normal;
     vec2f *texcoord;
     vec3i *index;
-    bool                hasTexture;
-    cudaTextureObject_t texture;
+    int    materialID;
+    /*! light ID of this mesh's first triangle if it is emissive (its
+        other triangles follow in order), or -1 */
+    int    firstLightID;
+  };
+
+  /*! the only thing a hitgroup record carries: which mesh it is for
+      (shadow records leave it unused) */
+  struct HitgroupData {
+    int meshID;
+  };
+  
+  /*! a camera ray waiting to be traced by the wavefront 'extend' stage */
+  struct WavefrontRay {
+    vec3f    origin;
+    vec3f    direction;
+    int      pixelID;
+    /*! sampler state (index and current seed) */
+    uint32_t rngIndex, rngSeed;
+  };
+
+  /*! a hit waiting to be shaded by the wavefront 'shade' stage */
+  struct WavefrontHit {
+    vec3f    rayDir;
+    int      pixelID;
+    int      meshID;
+    int      primID;
+    float    u, v;
+    uint32_t rngIndex, rngSeed;
+  };
+
+  /*! a shadow ray waiting for the wavefront 'connect' stage; adds
+      'contribution' to its pixel if unoccluded */
+  struct WavefrontShadowRay {
+    vec3f origin;
+    vec3f direction;
+    vec3f contribution;
+    float tmax;
+    int   pixelID;
+  };
+
+  /*! indices into WavefrontQueues::counters */
+  enum { WF_NUM_HITS=0, WF_NUM_SHADOW_RAYS, WF_COUNTER_COUNT };
+
+  /*! queues and per-pixel sums of the wavefront renderer. the queues
+      hold one batch of pixels - firstPixel on - at a time, and the
+      sums the whole frame; rays are indexed by
+      (pixelID-firstPixel)*numPixelSamples+sampleID, the hit and
+      shadow queues are compacted (appended to through the counters) */
+  struct WavefrontQueues {
+    int                 firstPixel;
+    WavefrontRay       *rays;
+    /*! 1 for every ray that hit something, for checking compaction */
+    int                *hitFlags;
+    WavefrontHit       *hits;
+    /*! hits, reordered by material ID */
+    WavefrontHit       *sortedHits;
+    WavefrontShadowRay *shadowRays;
+    int                *counters;
+    /*! per-pixel sums over this frame's samples */
+    float4             *colorSum;
+    float4             *normalSum;
+    float4             *albedoSum;
+  };
+  
+  /*! the camera as the raygen programs see it: pixel (x,y) of a
+      WxH frame looks along direction + (x/W-.5)*horizontal +
+      (y/H-.5)*vertical, all three mutually orthogonal */
+  struct LaunchCamera {
+    vec3f position;
+    vec3f direction;
+    vec3f horizontal;
+    vec3f vertical;
   };
+
+  /*! where a point seen in direction d (from the camera's position,
+      not normalized) shows up in a frame of given size rendered with
+      that camera, in (continuous) pixel coordinates; false if it's
+      behind the camera */
+  inline __both__ bool projectDirection(const LaunchCamera &camera,
+                                        const vec2i &size,
+                                        const vec3f &d,
+                                        vec2f &pixel)
+  {
+    const float depth = dot(d,camera.direction);
+    if (depth <= 0.f) return false;
+    const float a = dot(d,camera.horizontal) / (depth*dot(camera.horizontal,camera.horizontal));
+    const float b = dot(d,camera.vertical)   / (depth*dot(camera.vertical,camera.vertical));
+    pixel = vec2f(a+.5f,b+.5f) * vec2f(size) - vec2f(.5f);
+    return true;
+  }
+
+  /*! same, for world-space point P */
+  inline __both__ bool projectToPixel(const LaunchCamera &camera,
+                                      const vec2i &size,
+                                      const vec3f &P,
+                                      vec2f &pixel)
+  {
+    return projectDirection(camera,size,P - camera.position,pixel);
+  }
   
   struct LaunchParams
   {
     int numPixelSamples = 1;
     struct {
       int       frameID = 0;
+      /*! index of this launch's first sample of each pixel, ie, the
+          samples per pixel accumulated so far (numPixelSamples can
+          change between the launches of one accumulation) */
+      uint32_t  firstSampleIndex = 0;
       float4   *colorBuffer;
-      float4   *normalBuffer;
-      float4   *albedoBuffer;
+      /*! @{ the denoiser's guides - float4, or half3 (see
+          SampleRenderer::aovPrecision); unlike color they don't
+          accumulate, so half is all the precision they need */
+      PixelBuffer normalBuffer;
+      PixelBuffer albedoBuffer;
+      /*! @} */
+      /*! average first-hit position of the pixel's samples, w = 1 if
+          any of them hit something (for temporal reprojection) */
+      float4   *positionBuffer;
+      /*! number of samples accumulated into each pixel's color, which
+          can differ per pixel once history got reprojected */
+      float    *historyBuffer;
+      /*! where each pixel's first hit was in the frame motionCamera
+          saw, as the offset to get there (in pixels) - the flow the
+          temporal denoiser warps its previous output by; null if no
+          one needs it */
+      float2   *motionBuffer = nullptr;
+      LaunchCamera motionCamera;
       
       /*! the size of the frame buffer to render */
       vec2i     size;
+      /*! first pixel of the tile __raygen__renderFrame gets launched
+          over (launches over the whole frame leave it at 0) */
+      vec2i     tileOrigin = vec2i(0);
     } frame;
     
+    LaunchCamera camera;
+
+    /*! all area lights, picked by power through the alias table. the
+        quad lights come first - they aren't part of the geometry, so
+        brdf samples have to check them one by one */
     struct {
-      vec3f position;
-      vec3f direction;
-      vec3f horizontal;
-      vec3f vertical;
-    } camera;
+      const LightData  *lights;
+      const AliasEntry *aliasTable;
+      int               numLights     = 0;
+      int               numQuadLights = 0;
+    } lights;
+
+    /*! pair each light sample with a brdf sample, and combine the two
+        with multiple importance sampling */
+    int misEnabled = 1;
 
+    /*! one of SAMPLER_* */
+    int sampler = SAMPLER_SOBOL;
+
+    /*! per-pixel sample counts driven by each pixel's running variance
+        (megakernel only): pixels stop once their relative error is
+        below 'threshold', noisier ones get up to maxScale times
+        numPixelSamples (see AdaptiveSampling.h) */
     struct {
-      vec3f origin, du, dv, power;
-    } light;
+      int     enabled    = 0;
+      float   threshold  = .02f;
+      int     minSamples = 64;
+      float   maxScale   = 4.f;
+      /*! one float4 of statistics per pixel, next to colorBuffer */
+      float4 *statsBuffer;
+      /*! number of pixels that still took samples this frame */
+      int    *activePixels;
+    } adaptive;
+
+    struct {
+      /*! number of path segments (1 = direct light only); the last
+          vertex adds the ambient term in place of what comes after */
+      int maxDepth      = 4;
+      /*! first bounce that is subject to russian roulette */
+      int rouletteDepth = 2;
+      /*! if set, hit programs trace the next bounce themselves (for
+          comparison only - needs a much deeper stack) */
+      int recursive     = 0;
+    } path;
     
+    /*! the scene's mesh and material tables, indexed by
+        HitgroupData::meshID and MeshData::materialID, respectively */
+    const MeshData     *meshes;
+    const MaterialData *materials;
+
+    /*! only valid (and only used) in wavefront mode */
+    WavefrontQueues wavefront;
+
     OptixTraversableHandle traversable;
   };
 
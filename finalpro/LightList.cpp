@@ -0,0 +1,141 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "LightList.h"
+#include "gdt/random/random.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  LightList buildLightList(const Model *model,
+                           const std::vector<QuadLight> &quadLights)
+  {
+    LightList list;
+    for (auto &quad : quadLights) {
+      LightData light;
+      light.origin     = quad.origin;
+      light.e1         = quad.du;
+      light.e2         = quad.dv;
+      // radiant intensity along the normal, spread over the area
+      light.radiance   = quad.power * (1.f/areaLightArea(quad.du,quad.dv,false));
+      light.isTriangle = 0;
+      list.lights.push_back(light);
+    }
+    list.numQuadLights = (int)list.lights.size();
+
+    for (auto mesh : model->meshes) {
+      if (reduce_max(mesh->emission) <= 0.f) {
+        list.meshFirstLightID.push_back(-1);
+        continue;
+      }
+      list.meshFirstLightID.push_back((int)list.lights.size());
+      for (auto &index : mesh->index) {
+        LightData light;
+        light.origin     = mesh->vertex[index.x];
+        light.e1         = mesh->vertex[index.y] - light.origin;
+        light.e2         = mesh->vertex[index.z] - light.origin;
+        light.radiance   = mesh->emission;
+        light.isTriangle = 1;
+        list.lights.push_back(light);
+      }
+    }
+
+    std::vector<float> powers;
+    for (auto &light : list.lights)
+      powers.push_back(lightPower(light));
+    list.aliasTable = buildAliasTable(powers);
+    return list;
+  }
+
+  float lightPower(const LightData &light)
+  {
+    const float luminance
+      = 0.2126f*light.radiance.x
+      + 0.7152f*light.radiance.y
+      + 0.0722f*light.radiance.z;
+    return luminance * areaLightArea(light.e1,light.e2,light.isTriangle);
+  }
+
+  std::vector<AliasEntry> buildAliasTable(const std::vector<float> &weights)
+  {
+    const int size = (int)weights.size();
+    std::vector<AliasEntry> table(size);
+    if (size == 0) return table;
+
+    double sum = 0.;
+    for (float weight : weights) sum += std::max(0.f,weight);
+
+    // scale so the average bucket is 1, then sort buckets into the
+    // ones that have room to spare and the ones that overflow
+    std::vector<double> scaled(size);
+    std::vector<int> small, large;
+    for (int i=0;i<size;i++) {
+      table[i].pmf = (sum > 0.)
+        ? float(std::max(0.f,weights[i])/sum)
+        : 1.f/size;
+      scaled[i] = double(table[i].pmf) * size;
+      (scaled[i] < 1. ? small : large).push_back(i);
+    }
+    // fill up each small bucket with some of a large one
+    while (!small.empty() && !large.empty()) {
+      const int s = small.back(); small.pop_back();
+      const int l = large.back();
+      table[s].prob  = float(scaled[s]);
+      table[s].alias = l;
+      scaled[l] -= 1. - scaled[s];
+      if (scaled[l] < 1.) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // whatever's left is full, up to rounding
+    for (int i : small) { table[i].prob = 1.f; table[i].alias = i; }
+    for (int i : large) { table[i].prob = 1.f; table[i].alias = i; }
+    return table;
+  }
+
+  bool checkAliasTable(const std::vector<float> &weights, int numSamples)
+  {
+    const std::vector<AliasEntry> table = buildAliasTable(weights);
+    const int size = (int)table.size();
+    if (size == 0) return true;
+    
+    gdt::LCG<16> random(0,0);
+    std::vector<int> counts(size,0);
+    bool pmfOK = true;
+    for (int i=0;i<numSamples;i++) {
+      float pmf;
+      const int picked = sampleAliasTable(table.data(),size,random(),pmf);
+      counts[picked]++;
+      pmfOK &= (pmf == table[picked].pmf);
+    }
+    
+    double maxError = 0.;
+    for (int i=0;i<size;i++) {
+      const double expected = double(table[i].pmf)*numSamples;
+      // in units of the expected count's standard deviation
+      const double sigma = sqrt(std::max(1.,expected));
+      maxError = std::max(maxError,fabs(counts[i]-expected)/sigma);
+    }
+    const bool ok = pmfOK && maxError < 5.;
+    std::cout << "#osc: alias table over " << size << " lights: max deviation "
+              << maxError << " sigma after " << prettyNumber(numSamples)
+              << " samples - " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+  }
+  
+} // ::opz
@@ -0,0 +1,58 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Sampling.h"
+#include "Model.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! all lights of a scene, plus the alias table to pick them by
+      power; pure host data, uploaded by the renderer */
+  struct LightList {
+    std::vector<LightData>  lights;
+    std::vector<AliasEntry> aliasTable;
+    /*! the quad lights are lights[0..numQuadLights) */
+    int                     numQuadLights { 0 };
+    /*! per mesh in model->meshes: light ID of its first triangle, or
+        -1 if the mesh doesn't emit */
+    std::vector<int>        meshFirstLightID;
+  };
+
+  /*! collect the given quad lights, then one triangle light for each
+      triangle of every mesh with non-zero emission */
+  LightList buildLightList(const Model *model,
+                           const std::vector<QuadLight> &quadLights);
+
+  /*! emitted power of a light, up to a constant factor; this is what
+      the alias table is weighted by */
+  float lightPower(const LightData &light);
+
+  /*! build a Walker/Vose alias table that picks index i with
+      probability weights[i]/sum(weights). if all weights are zero,
+      every index is equally likely */
+  std::vector<AliasEntry> buildAliasTable(const std::vector<float> &weights);
+
+  /*! host-side check that sampling the alias table for the given
+      weights reproduces them; prints the largest deviation and
+      returns true if it is within tolerance */
+  bool checkAliasTable(const std::vector<float> &weights,
+                       int numSamples = 1<<22);
+  
+} // ::opz
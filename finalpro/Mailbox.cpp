@@ -0,0 +1,86 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Mailbox.h"
+#include "Checks.h"
+// std
+#include <iostream>
+#include <thread>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! big enough that a torn copy would show */
+  struct MailboxTestValue {
+    long long serial;
+    long long copies[15];
+  };
+
+  bool checkMailbox()
+  {
+    beginCheck("mailbox");
+    bool ok = true;
+
+    Mailbox<MailboxTestValue> box;
+    MailboxTestValue value;
+    ok &= checkResult("an empty box has nothing to take",!box.take(value));
+    value.serial = 1;
+    box.post(value);
+    value.serial = 2;
+    box.post(value);
+    ok &= checkResult("the reader gets the newest of what got posted meanwhile",
+                      box.take(value) && value.serial == 2);
+    ok &= checkResult("... and only once",!box.take(value));
+
+    // a writer posting as fast as it can, and a reader taking as
+    // fast as it can
+    const long long numPosts = 1000000;
+    std::atomic<bool> writerDone { false };
+    std::thread writer([&]{
+        MailboxTestValue posted;
+        for (long long i=1;i<=numPosts;i++) {
+          posted.serial = i;
+          for (auto &copy : posted.copies) copy = i;
+          box.post(posted);
+        }
+        writerDone = true;
+      });
+    long long lastSerial = 0, numTaken = 0;
+    bool noneTorn = true, inOrder = true;
+    while (true) {
+      // (read the flag first: once it's set, whatever's left is in the box)
+      const bool done = writerDone;
+      MailboxTestValue taken;
+      if (box.take(taken)) {
+        numTaken++;
+        for (auto copy : taken.copies)
+          noneTorn &= copy == taken.serial;
+        inOrder &= taken.serial > lastSerial;
+        lastSerial = taken.serial;
+      }
+      if (done) break;
+    }
+    writer.join();
+    std::cout << "  took " << numTaken << " of " << numPosts << " posts" << std::endl;
+    ok &= checkResult("no value is ever read half-written",noneTorn);
+    ok &= checkResult("values come out newer every time",inOrder);
+    ok &= checkResult("the last value posted always arrives",lastSerial == numPosts);
+
+    return endCheck("mailbox",ok);
+  }
+
+} // ::opz
@@ -0,0 +1,70 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+// std
+#include <atomic>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! lock-free single-writer, single-reader box holding the newest
+      value posted - a triple buffer: the writer fills one slot, the
+      reader reads another, and the third one (the 'middle') gets
+      swapped with either, atomically. neither side ever waits, and
+      values posted before the reader got to them just get replaced
+      - which is what camera updates want. see checkMailbox() */
+  template<typename T>
+  class Mailbox {
+  public:
+    /*! writer side: replace whatever is in the box */
+    void post(const T &value)
+    {
+      slots[back] = value;
+      back = middle.exchange(back | FRESH,std::memory_order_acq_rel) & INDEX;
+    }
+
+    /*! reader side: take the newest value, if any got posted since
+        the last take */
+    bool take(T &value)
+    {
+      if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        return false;
+      front = middle.exchange(front,std::memory_order_acq_rel) & INDEX;
+      value = slots[front];
+      return true;
+    }
+
+  private:
+    enum { INDEX = 3, FRESH = 4 };
+    T                slots[3];
+    /*! index of the middle slot, plus FRESH while it holds a value
+        the reader didn't take yet */
+    std::atomic<int> middle { 1 };
+    /*! owned by the writer and the reader, respectively */
+    int              back   = 0;
+    int              front  = 2;
+  };
+
+  /*! host-side check of the mailbox under a writer and a reader
+      thread racing each other; prints what it finds, and returns true
+      if all pass */
+  bool checkMailbox();
+
+} // ::opz
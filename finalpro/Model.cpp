@@ -191,6 +191,7 @@ namespace opz {
                     addVertex(mesh, attributes, idx2, knownVertices));
           mesh->index.push_back(idx);
           mesh->diffuse = (const vec3f&)materials[materialID].diffuse;
+          mesh->emission = (const vec3f&)materials[materialID].emission;
           mesh->diffuseTextureID = loadTexture(model,
                                                knownTextures,
                                                materials[materialID].diffuse_texname,
@@ -35,8 +35,12 @@ namespace opz {
     // material data:
     vec3f              diffuse;
     int                diffuseTextureID { -1 };
+    /*! MTL 'Ke'; meshes with non-zero emission become lights */
+    vec3f              emission { 0.f, 0.f, 0.f };
   };
 
+  /*! quad light along origin + [0,1]*du + [0,1]*dv, emitting along
+      cross(du,dv); power is its radiant intensity along that normal */
   struct QuadLight {
     vec3f origin, du, dv, power;
   };
@@ -0,0 +1,133 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#include "ResolutionController.h"
+#include "FrameTimeControl.h"
+// std
+#include <algorithm>
+#include <cmath>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  float ResolutionController::beginFrame(bool cameraMoved)
+  {
+    if (cameraMoved)
+      framesSinceMove = 0;
+    else if (framesSinceMove < (1<<30))
+      framesSinceMove++;
+    currentScale = framesSinceMove < settleFrames ? movingScale : 1.f;
+    return currentScale;
+  }
+
+  void ResolutionController::endFrame(float scale, double seconds)
+  {
+    if (seconds <= 0.) return;
+    // time ~ scale^2, so this is the scale that would have hit the
+    // target exactly
+    const float ideal = scale*(float)std::sqrt(targetFrameTime/seconds);
+    movingScale = dampedStep(movingScale,ideal,minScale,1.f,gain,deadBand);
+  }
+
+  /*! a simulated gpu: fixed cost plus cost per (full resolution)
+      pixel fraction, with up to +-noise relative jitter */
+  struct SimulatedGPU {
+    double fixedTime, fullResTime;
+    SimulatedNoise noise;
+    SimulatedGPU(double fixedTime, double fullResTime, double noise)
+      : fixedTime(fixedTime), fullResTime(fullResTime), noise(noise,7,11)
+    {}
+    double frameTime(float scale)
+    {
+      return (fixedTime + fullResTime*scale*scale) * noise.jitter();
+    }
+  };
+
+  bool checkResolutionController()
+  {
+    beginCheck("dynamic resolution controller");
+    bool ok = true;
+
+    // a gpu that needs 4x the budget at full resolution: should settle
+    // near scale .5 and hold the target while moving ...
+    {
+      ResolutionController controller;
+      SimulatedGPU gpu(1e-3,4.*controller.targetFrameTime,.05);
+      double lastTimes = 0.;
+      for (int frameID=0;frameID<60;frameID++) {
+        const float scale = controller.beginFrame(true);
+        const double t = gpu.frameTime(scale);
+        controller.endFrame(t);
+        if (frameID >= 50) lastTimes += t/10.;
+      }
+      std::cout << "  slow gpu: moving scale " << controller.interactiveScale()
+                << ", frame time " << lastTimes*1000. << "ms" << std::endl;
+      ok &= checkResult("slow gpu holds the target frame time within 15%",
+                        std::fabs(lastTimes/controller.targetFrameTime-1.) < .15);
+      // ... and go back to full resolution settleFrames after stopping
+      int framesToFull = 0;
+      while (controller.beginFrame(false) < 1.f && framesToFull < 100) {
+        controller.endFrame(gpu.frameTime(controller.scale()));
+        framesToFull++;
+      }
+      ok &= checkResult("back to full resolution once the camera stops",
+                        framesToFull == controller.settleFrames-1);
+      // the next move starts from the learned scale, not from scratch
+      ok &= checkResult("remembers its scale for the next move",
+                        controller.beginFrame(true) < .6f);
+    }
+
+    // a gpu that's fast enough never leaves full resolution
+    {
+      ResolutionController controller;
+      SimulatedGPU gpu(1e-3,.5*controller.targetFrameTime,.05);
+      float lowest = 1.f;
+      for (int frameID=0;frameID<60;frameID++) {
+        lowest = std::min(lowest,controller.beginFrame(true));
+        controller.endFrame(gpu.frameTime(controller.scale()));
+      }
+      ok &= checkResult("fast gpu stays at full resolution",lowest == 1.f);
+    }
+
+    // one that can't make it even at minScale clamps there
+    {
+      ResolutionController controller;
+      SimulatedGPU gpu(2.*controller.targetFrameTime,controller.targetFrameTime,0.);
+      for (int frameID=0;frameID<60;frameID++) {
+        controller.beginFrame(true);
+        controller.endFrame(gpu.frameTime(controller.scale()));
+      }
+      ok &= checkResult("hopeless gpu clamps to minScale",
+                        controller.interactiveScale() == controller.minScale);
+    }
+
+    // with noise but a steady load, the scale shouldn't keep changing
+    {
+      ResolutionController controller;
+      SimulatedGPU gpu(0.,2.*controller.targetFrameTime,.03);
+      ok &= checkNoFlicker("resolution",[&]{
+          const float scale = controller.beginFrame(true);
+          controller.endFrame(gpu.frameTime(scale));
+          return scale;
+        });
+    }
+
+    return endCheck("dynamic resolution controller",ok);
+  }
+  
+} // ::opz
@@ -0,0 +1,71 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#pragma once
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! picks the render resolution while the camera moves: frame time is
+      taken to grow with the number of pixels, ie, with scale^2, so
+      from each measured frame the controller knows which scale would
+      have hit the target, and moves part of the way there. once the
+      camera has stood still for settleFrames frames it goes back to
+      full resolution (but keeps what it learned for the next move).
+      pure host logic, no cuda - see checkResolutionController() */
+  class ResolutionController {
+  public:
+    /*! frame time to aim for while interacting, in seconds */
+    double targetFrameTime = 1./60.;
+    /*! lowest scale (per axis) we ever go down to */
+    float  minScale        = .25f;
+    /*! how many unmoved frames before going back to full resolution */
+    int    settleFrames    = 3;
+    /*! fraction of the way to the ideal scale taken per frame */
+    float  gain            = .5f;
+    /*! relative changes smaller than this are ignored, so the
+        resolution doesn't flicker with measurement noise */
+    float  deadBand        = .05f;
+
+    /*! scale to render the next frame at, given whether the camera
+        moved since the last one */
+    float beginFrame(bool cameraMoved);
+
+    /*! report how long the frame at beginFrame()'s scale took */
+    inline void endFrame(double seconds) { endFrame(currentScale,seconds); }
+    /*! report how long a frame at 'scale' took - for frames that
+        finish only after later ones already began */
+    void  endFrame(float scale, double seconds);
+
+    /*! scale of the current frame, and the one we'd use for moving */
+    inline float scale()            const { return currentScale; }
+    inline float interactiveScale() const { return movingScale; }
+    
+  private:
+    float currentScale    = 1.f;
+    float movingScale     = 1.f;
+    int   framesSinceMove = 1<<30;
+  };
+
+  /*! deterministic host-side checks of the controller against a
+      simulated gpu whose frame time is a fixed cost plus a per-pixel
+      cost (plus some seeded noise); prints what it finds, and returns
+      true if all pass */
+  bool checkResolutionController();
+  
+} // ::opz
@@ -0,0 +1,202 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#include "SampleCountController.h"
+#include "FrameTimeControl.h"
+// std
+#include <algorithm>
+#include <cmath>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  SamplePlan SampleCountController::beginFrame(bool cameraMoved, int numPixels)
+  {
+    this->numPixels = numPixels;
+    if (cameraMoved || pixelSampleTime <= 0.)
+      currentPlan = { minSamples,1 };
+    else if (frameBudget <= 0.)
+      currentPlan = { maxSamples,maxLaunches };
+    else {
+      // as few launches as it takes, each as large as the budget allows
+      const float total = std::max((float)minSamples,frameSamples);
+      const int numLaunches
+        = std::max(1,std::min(maxLaunches,(int)std::ceil(total/maxSamples)));
+      const int samplesPerLaunch
+        = std::max(minSamples,std::min(maxSamples,(int)(total/numLaunches)));
+      currentPlan = { samplesPerLaunch,numLaunches };
+    }
+    return currentPlan;
+  }
+
+  void SampleCountController::endFrame(const SamplePlan &plan, int numPixels,
+                                       double launchSeconds, double frameSeconds)
+  {
+    if (launchSeconds <= 0. || numPixels <= 0) return;
+    const double numSamples
+      = double(plan.samplesPerLaunch)*plan.numLaunches*numPixels;
+    const double sampleTime = launchSeconds/numSamples;
+    const double overhead   = std::max(0.,frameSeconds-launchSeconds);
+    if (pixelSampleTime <= 0.) {
+      pixelSampleTime = sampleTime;
+      overheadTime    = overhead;
+      frameSamples    = (float)minSamples;
+    } else {
+      pixelSampleTime = .5*(pixelSampleTime+sampleTime);
+      overheadTime    = .5*(overheadTime+overhead);
+    }
+    if (frameBudget <= 0.) return;
+
+    // the samples per pixel that would have filled the budget exactly
+    const float ideal
+      = (float)(std::max(0.,frameBudget-overheadTime)/(pixelSampleTime*numPixels));
+    frameSamples = dampedStep(frameSamples,ideal,(float)minSamples,
+                              float(maxSamples*maxLaunches),gain,deadBand);
+  }
+
+  /*! a simulated gpu: every launch costs a fixed time plus a time per
+      pixel-sample, every frame a fixed time on top (denoising,
+      display); all with up to +-noise relative jitter */
+  struct SimulatedSampleGPU {
+    double launchTime, pixelSampleTime, frameTime;
+    SimulatedNoise noise;
+    SimulatedSampleGPU(double launchTime, double pixelSampleTime,
+                       double frameTime, double noise)
+      : launchTime(launchTime), pixelSampleTime(pixelSampleTime),
+        frameTime(frameTime), noise(noise,3,5)
+    {}
+    /*! renders 'plan', returns its launch time, and the frame time in 'total' */
+    double render(const SamplePlan &plan, int numPixels, double &total)
+    {
+      const double launches
+        = plan.numLaunches*(launchTime + pixelSampleTime*numPixels*plan.samplesPerLaunch)
+        * noise.jitter();
+      total = launches + frameTime*noise.jitter();
+      return launches;
+    }
+  };
+
+  /*! run 'numFrames' frames, and return the average frame time of the last ten */
+  static double runFrames(SampleCountController &controller, SimulatedSampleGPU &gpu,
+                          int numPixels, int numFrames, bool cameraMoved = false)
+  {
+    double lastTimes = 0.;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      double total = 0.;
+      const double launch
+        = gpu.render(controller.beginFrame(cameraMoved,numPixels),numPixels,total);
+      controller.endFrame(launch,total);
+      if (frameID >= numFrames-10) lastTimes += total/10.;
+    }
+    return lastTimes;
+  }
+
+  bool checkSampleCountController()
+  {
+    beginCheck("sample count controller");
+    bool ok = true;
+    const int numPixels = 1200*800;
+
+    // room for about 12 spp in a 60hz frame: should fill - but not
+    // overrun - the budget, in a single launch
+    {
+      SampleCountController controller;
+      const double budget = controller.frameBudget;
+      SimulatedSampleGPU gpu(1e-4,.7*budget/12./numPixels,.2*budget,.05);
+      const double frameTime = runFrames(controller,gpu,numPixels,60);
+      const SamplePlan plan = controller.plan();
+      std::cout << "  steady gpu: " << plan.samplesPerLaunch << " spp x "
+                << plan.numLaunches << " launches, frame time "
+                << frameTime*1000. << "ms" << std::endl;
+      ok &= checkResult("fills 80-110% of the frame budget",
+                        frameTime > .8*budget && frameTime < 1.1*budget);
+      ok &= checkResult("uses a single launch while that fits",
+                        plan.numLaunches == 1);
+
+      // camera moves drop to the interactive plan at once ...
+      const SamplePlan steady = plan;
+      const SamplePlan moving = controller.beginFrame(true,numPixels);
+      double total = 0.;
+      controller.endFrame(gpu.render(moving,numPixels,total),total);
+      ok &= checkResult("moving camera gets minSamples in one launch",
+                        moving.samplesPerLaunch == controller.minSamples
+                        && moving.numLaunches == 1);
+      // ... and come back to (nearly) the learned one right after
+      const SamplePlan after = controller.beginFrame(false,numPixels);
+      ok &= checkResult("returns to its plan once the camera stops",
+                        std::abs(after.samplesPerLaunch-steady.samplesPerLaunch)
+                        <= std::max(1,steady.samplesPerLaunch/4));
+    }
+
+    // a fast gpu runs out of samples per launch, and adds launches
+    {
+      SampleCountController controller;
+      const double budget = controller.frameBudget;
+      SimulatedSampleGPU gpu(1e-4,.5*budget/50./numPixels,.1*budget,.05);
+      const double frameTime = runFrames(controller,gpu,numPixels,60);
+      const SamplePlan plan = controller.plan();
+      std::cout << "  fast gpu: " << plan.samplesPerLaunch << " spp x "
+                << plan.numLaunches << " launches, frame time "
+                << frameTime*1000. << "ms" << std::endl;
+      ok &= checkResult("fast gpu launches several times per frame",
+                        plan.numLaunches > 1
+                        && plan.samplesPerLaunch*plan.numLaunches > controller.maxSamples
+                        && frameTime < 1.1*budget);
+    }
+
+    // one that can't even afford minSamples clamps there
+    {
+      SampleCountController controller;
+      SimulatedSampleGPU gpu(0.,2.*controller.frameBudget/numPixels,0.,0.);
+      runFrames(controller,gpu,numPixels,60);
+      const SamplePlan plan = controller.plan();
+      ok &= checkResult("slow gpu clamps to minSamples",
+                        plan.samplesPerLaunch == controller.minSamples
+                        && plan.numLaunches == 1);
+    }
+
+    // no budget: always the largest plan
+    {
+      SampleCountController controller;
+      controller.frameBudget = 0.;
+      SimulatedSampleGPU gpu(1e-4,1e-9,1e-3,0.);
+      runFrames(controller,gpu,numPixels,3);
+      const SamplePlan plan = controller.plan();
+      ok &= checkResult("offline mode uses the largest plan",
+                        plan.samplesPerLaunch == controller.maxSamples
+                        && plan.numLaunches == controller.maxLaunches);
+    }
+
+    // with noise but a steady load, the plan shouldn't keep changing
+    {
+      SampleCountController controller;
+      const double budget = controller.frameBudget;
+      SimulatedSampleGPU gpu(1e-4,.7*budget/6./numPixels,.2*budget,.05);
+      ok &= checkNoFlicker("sample count",[&]{
+          const SamplePlan plan = controller.beginFrame(false,numPixels);
+          double total = 0.;
+          controller.endFrame(gpu.render(plan,numPixels,total),total);
+          return plan;
+        });
+    }
+
+    return endCheck("sample count controller",ok);
+  }
+  
+} // ::opz
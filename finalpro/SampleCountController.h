@@ -0,0 +1,97 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! how one displayed frame gets rendered: numLaunches accumulation
+      launches of samplesPerLaunch samples per pixel each */
+  struct SamplePlan {
+    int samplesPerLaunch;
+    int numLaunches;
+  };
+  inline bool operator!=(const SamplePlan &a, const SamplePlan &b)
+  { return a.samplesPerLaunch != b.samplesPerLaunch || a.numLaunches != b.numLaunches; }
+  
+  /*! picks the samples per pixel (and launches) of each displayed
+      frame so it fills a frame-time budget. launch time is taken to
+      grow with pixels times samples, so from the measured (gpu) launch
+      time the controller knows what one pixel-sample costs, and from
+      the rest of the frame (denoising, display) what's left of the
+      budget for launching. it then picks the largest samplesPerLaunch
+      that fits - one big launch has the best throughput - and only
+      once that hits maxSamples adds further launches. while the
+      camera moves it falls back to minSamples in a single launch, so
+      interaction stays responsive (and dynamic resolution has the
+      frame to itself). pure host logic, no cuda - see
+      checkSampleCountController() */
+  class SampleCountController {
+  public:
+    /*! time one displayed frame may take, in seconds; 0 means no
+        limit (offline), where every frame gets the largest plan */
+    double frameBudget = 1./60.;
+    /*! @{ limits of the plan */
+    int    minSamples  = 1;
+    int    maxSamples  = 16;
+    int    maxLaunches = 8;
+    /*! @} */
+    /*! fraction of the way to the ideal sample count taken per frame */
+    float  gain        = .5f;
+    /*! relative changes smaller than this are ignored, so the sample
+        count doesn't flicker with measurement noise */
+    float  deadBand    = .1f;
+
+    /*! plan for the next displayed frame of numPixels pixels, given
+        whether the camera moved since the last one */
+    SamplePlan beginFrame(bool cameraMoved, int numPixels);
+
+    /*! report how long the planned launches took on the gpu, and how
+        long the whole frame took */
+    inline void endFrame(double launchSeconds, double frameSeconds)
+    { endFrame(currentPlan,numPixels,launchSeconds,frameSeconds); }
+    /*! same, for a frame of given plan and size - for frames that
+        finish only after later ones already began */
+    void endFrame(const SamplePlan &plan, int numPixels,
+                  double launchSeconds, double frameSeconds);
+
+    /*! the current frame's plan */
+    inline SamplePlan plan() const { return currentPlan; }
+    /*! estimated pixel-samples per second, 0 until measured */
+    inline double samplesPerSecond() const
+    { return pixelSampleTime > 0. ? 1./pixelSampleTime : 0.; }
+    
+  private:
+    SamplePlan currentPlan     { 1,1 };
+    int        numPixels       = 0;
+    /*! smoothed cost of one pixel-sample, and of the rest of a frame */
+    double     pixelSampleTime = 0.;
+    double     overheadTime    = 0.;
+    /*! damped samples per pixel per displayed frame we're aiming for */
+    float      frameSamples    = 0.f;
+  };
+
+  /*! deterministic host-side checks of the controller against a
+      simulated gpu with a per-launch, a per-pixel-sample and a per-frame
+      cost (plus some seeded noise); prints what it finds, and returns
+      true if all pass */
+  bool checkSampleCountController();
+  
+} // ::opz
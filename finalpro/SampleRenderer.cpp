@@ -17,8 +17,14 @@
 
 #include "SampleRenderer.h"
 #include "LaunchParams.h"
+#include "ThreadPool.h"
+#include "WavefrontQueues.h"
+#include "LightList.h"
 // this include may only appear in a single source file:
 #include <optix_function_table_definition.h>
+// std
+#include <algorithm>
+#include <cstring>
 
 /*! \namespace opz - Optix ZYM-PKU */
 namespace opz {
@@ -43,31 +49,34 @@ namespace opz {
     void *data;
   };
 
-  /*! SBT record for a hitgroup program */
+  /*! SBT record for a hitgroup program; all the actual mesh and
+      material data lives in the tables in LaunchParams */
   struct __align__( OPTIX_SBT_RECORD_ALIGNMENT ) HitgroupRecord
   {
     __align__( OPTIX_SBT_RECORD_ALIGNMENT ) char header[OPTIX_SBT_RECORD_HEADER_SIZE];
-    TriangleMeshSBTData data;
+    HitgroupData data;
   };
 
 
   /*! constructor - performs all setup, including initializing
     optix, creates module, pipeline, programs, SBT, etc. */
-  SampleRenderer::SampleRenderer(const Model *model, const QuadLight &light)
-    : model(model)
+  SampleRenderer::SampleRenderer(const Model *model,
+                                 const std::vector<QuadLight> &quadLights,
+                                 const CompileConfig &compileConfig)
+    : model(model), quadLights(quadLights), compileConfig(compileConfig)
   {
     initOptix();
 
-    launchParams.light.origin = light.origin;
-    launchParams.light.du     = light.du;
-    launchParams.light.dv     = light.dv;
-    launchParams.light.power  = light.power;
-
+    double t0 = getCurrentTime();
     std::cout << "#osc: creating optix context ..." << std::endl;
     createContext();
+    double t1 = getCurrentTime();
+    startupReport.contextTime = t1-t0;
       
     std::cout << "#osc: setting up module ..." << std::endl;
     createModule();
+    t0 = getCurrentTime();
+    startupReport.moduleTime = t0-t1;
 
     std::cout << "#osc: creating raygen programs ..." << std::endl;
     createRaygenPrograms();
@@ -75,13 +84,24 @@ namespace opz {
     createMissPrograms();
     std::cout << "#osc: creating hitgroup programs ..." << std::endl;
     createHitgroupPrograms();
+    t1 = getCurrentTime();
+    startupReport.programsTime = t1-t0;
 
     launchParams.traversable = buildAccel();
+    t0 = getCurrentTime();
+    startupReport.accelTime = t0-t1;
     
     std::cout << "#osc: setting up optix pipeline ..." << std::endl;
     createPipeline();
+    t1 = getCurrentTime();
+    startupReport.pipelineTime = t1-t0;
 
     createTextures();
+    t0 = getCurrentTime();
+    startupReport.texturesTime = t0-t1;
+
+    buildLights();
+    buildSceneTables();
 
     
     std::cout << "#osc: building SBT ..." << std::endl;
@@ -90,11 +110,42 @@ namespace opz {
     launchParamsBuffer.alloc(sizeof(launchParams));
     std::cout << "#osc: context, module, pipeline, etc, all set up ..." << std::endl;
 
+    printStartupReport();
+
     std::cout << GDT_TERMINAL_GREEN;
     std::cout << "#osc: Optix 7 Sample fully set up" << std::endl;
     std::cout << GDT_TERMINAL_DEFAULT;
   }
 
+  /*! print the startup timings gathered in the constructor */
+  void SampleRenderer::printStartupReport() const
+  {
+    const StartupReport &r = startupReport;
+    std::cout << "#osc: startup times:" << std::endl
+              << "  context  : " << prettyDouble(r.contextTime)  << "s" << std::endl
+              << "  module   : " << prettyDouble(r.moduleTime)   << "s"
+              << " (" << r.compileThreads << " compile threads)" << std::endl
+              << "  programs : " << prettyDouble(r.programsTime) << "s" << std::endl
+              << "  accel    : " << prettyDouble(r.accelTime)    << "s" << std::endl
+              << "  pipeline : " << prettyDouble(r.pipelineTime) << "s" << std::endl
+              << "  textures : " << prettyDouble(r.texturesTime) << "s" << std::endl;
+    if (!compileConfig.cacheEnabled)
+      std::cout << "  module cache disabled - everything was compiled" << std::endl;
+    // (the counts come from matching optix' free-form log text, which
+    // isn't documented and differs between drivers - so best-effort)
+    else if (r.cacheHits == 0 && r.cacheMisses == 0)
+      std::cout << "  module cache: no hits or misses logged"
+                << " (best-effort; this driver may not report them)" << std::endl;
+    else if (r.cacheMisses == 0)
+      std::cout << "  module cache: " << r.cacheHits
+                << " hit(s) - nothing was compiled (best-effort, from the optix log)"
+                << std::endl;
+    else
+      std::cout << "  module cache: " << r.cacheHits << " hit(s), "
+                << r.cacheMisses << " miss(es) that had to be compiled"
+                << " (best-effort, from the optix log)" << std::endl;
+  }
+
   void SampleRenderer::createTextures()
   {
     int numTextures = (int)model->textures.size();
@@ -312,11 +363,23 @@ namespace opz {
               << GDT_TERMINAL_DEFAULT << std::endl;
   }
 
+  /*! the log callback may get called from all compile threads at
+      once, so both printing and counting go through this lock */
+  static std::mutex logMutex;
+
   static void context_log_cb(unsigned int level,
                              const char *tag,
                              const char *message,
-                             void *)
+                             void *userData)
   {
+    std::lock_guard<std::mutex> lock(logMutex);
+    // the disk cache reports lookups at the 'print' level; that's the
+    // only way for us to tell compile time from cache hits. the text
+    // isn't documented, so a driver that words it differently just
+    // leaves both counts at zero
+    StartupReport *report = (StartupReport *)userData;
+    if (report && strstr(message,"Cache hit"))  report->cacheHits++;
+    if (report && strstr(message,"Cache miss")) report->cacheMisses++;
     fprintf( stderr, "[%2d][%12s]: %s\n", (int)level, tag, message );
   }
 
@@ -328,6 +391,17 @@ namespace opz {
     const int deviceID = 0;
     CUDA_CHECK(SetDevice(deviceID));
     CUDA_CHECK(StreamCreate(&stream));
+    for (auto &slot : frameSlots) {
+      CUDA_CHECK(EventCreate(&slot.start));
+      CUDA_CHECK(EventCreate(&slot.launchStart));
+      CUDA_CHECK(EventCreate(&slot.launchEnd));
+      CUDA_CHECK(EventCreate(&slot.done));
+      CUDA_CHECK(MallocHost((void**)&slot.hostActivePixels,sizeof(int)));
+    }
+    CUDA_CHECK(MallocHost((void**)&pinnedLaunchParams,
+                          LAUNCH_PARAMS_RING_SIZE*sizeof(LaunchParams)));
+    for (auto &event : launchParamsCopied)
+      CUDA_CHECK(EventCreateWithFlags(&event,cudaEventDisableTiming));
       
     cudaGetDeviceProperties(&deviceProps, deviceID);
     std::cout << "#osc: running on device: " << deviceProps.name << std::endl;
@@ -338,7 +412,24 @@ namespace opz {
       
     OPTIX_CHECK(optixDeviceContextCreate(cudaContext, 0, &optixContext));
     OPTIX_CHECK(optixDeviceContextSetLogCallback
-                (optixContext,context_log_cb,nullptr,4));
+                (optixContext,context_log_cb,&startupReport,4));
+
+    // ------------------------------------------------------------------
+    // configure the disk cache of compiled modules; note that the
+    // OPTIX_CACHE_PATH/OPTIX_CACHE_MAXSIZE environment variables, if
+    // set, still take precedence over what we set here
+    // ------------------------------------------------------------------
+    OPTIX_CHECK(optixDeviceContextSetCacheEnabled(optixContext,
+                                                  compileConfig.cacheEnabled));
+    if (compileConfig.cacheEnabled && !compileConfig.cacheLocation.empty())
+      OPTIX_CHECK(optixDeviceContextSetCacheLocation(optixContext,
+                                                     compileConfig.cacheLocation.c_str()));
+    if (compileConfig.cacheEnabled && compileConfig.cacheSizeInBytes > 0)
+      // garbage collection kicks in at the high water mark, and trims
+      // the cache down to the low one
+      OPTIX_CHECK(optixDeviceContextSetCacheDatabaseSizes(optixContext,
+                                                          compileConfig.cacheSizeInBytes/2,
+                                                          compileConfig.cacheSizeInBytes));
   }
 
 
@@ -355,17 +446,56 @@ namespace opz {
     pipelineCompileOptions = {};
     pipelineCompileOptions.traversableGraphFlags = OPTIX_TRAVERSABLE_GRAPH_FLAG_ALLOW_SINGLE_GAS;
     pipelineCompileOptions.usesMotionBlur     = false;
-    pipelineCompileOptions.numPayloadValues   = 2;
+    pipelineCompileOptions.numPayloadValues   = NUM_PAYLOAD_VALUES;
     pipelineCompileOptions.numAttributeValues = 2;
     pipelineCompileOptions.exceptionFlags     = OPTIX_EXCEPTION_FLAG_NONE;
     pipelineCompileOptions.pipelineLaunchParamsVariableName = "optixLaunchParams";
       
+    // (set per pipeline in linkPipeline)
     pipelineLinkOptions.maxTraceDepth          = 2;
       
     const std::string ptxCode = embedded_ptx_code;
       
     char log[2048];
     size_t sizeof_log = sizeof( log );
+#if OPTIX_VERSION >= 70400
+    // ------------------------------------------------------------------
+    // split the compile into optix tasks, and run those on a pool of
+    // host threads; every executed task may hand back more tasks,
+    // which go straight back into the pool
+    // ------------------------------------------------------------------
+    OptixTask firstTask;
+    OPTIX_CHECK(optixModuleCreateFromPTXWithTasks(optixContext,
+                                                  &moduleCompileOptions,
+                                                  &pipelineCompileOptions,
+                                                  ptxCode.c_str(),
+                                                  ptxCode.size(),
+                                                  log,&sizeof_log,
+                                                  &module,
+                                                  &firstTask
+                                                  ));
+    if (sizeof_log > 1) PRINT(log);
+
+    ThreadPool pool(compileConfig.numThreads);
+    startupReport.compileThreads = pool.size();
+    std::function<void(OptixTask)> executeTask = [&](OptixTask task) {
+      const unsigned int maxNewTasks = 4;
+      OptixTask newTasks[maxNewTasks];
+      unsigned int numNewTasks = 0;
+      OPTIX_CHECK(optixTaskExecute(task,newTasks,maxNewTasks,&numNewTasks));
+      for (unsigned int i=0;i<numNewTasks;i++) {
+        OptixTask newTask = newTasks[i];
+        pool.enqueue([&executeTask,newTask]{ executeTask(newTask); });
+      }
+    };
+    pool.enqueue([&executeTask,firstTask]{ executeTask(firstTask); });
+    pool.wait();
+
+    OptixModuleCompileState compileState;
+    OPTIX_CHECK(optixModuleGetCompilationState(module,&compileState));
+    if (compileState != OPTIX_MODULE_COMPILE_STATE_COMPLETED)
+      throw std::runtime_error("#osc: parallel module compilation failed");
+#else
     OPTIX_CHECK(optixModuleCreateFromPTX(optixContext,
                                          &moduleCompileOptions,
                                          &pipelineCompileOptions,
@@ -375,6 +505,7 @@ namespace opz {
                                          &module
                                          ));
     if (sizeof_log > 1) PRINT(log);
+#endif
   }
     
 
@@ -382,26 +513,34 @@ namespace opz {
   /*! does all setup for the raygen program(s) we are going to use */
   void SampleRenderer::createRaygenPrograms()
   {
-    // we do a single ray gen program in this example:
-    raygenPGs.resize(1);
+    // the megakernel, plus one program per wavefront stage
+    const char *raygenNames[RAYGEN_COUNT] = {
+      "__raygen__renderFrame",
+      "__raygen__wfGenerate",
+      "__raygen__wfExtend",
+      "__raygen__wfShade",
+      "__raygen__wfConnect"
+    };
+    raygenPGs.resize(RAYGEN_COUNT);
       
     OptixProgramGroupOptions pgOptions = {};
     OptixProgramGroupDesc pgDesc    = {};
     pgDesc.kind                     = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
     pgDesc.raygen.module            = module;           
-    pgDesc.raygen.entryFunctionName = "__raygen__renderFrame";
 
-    // OptixProgramGroup raypg;
     char log[2048];
-    size_t sizeof_log = sizeof( log );
-    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
-                                        &pgDesc,
-                                        1,
-                                        &pgOptions,
-                                        log,&sizeof_log,
-                                        &raygenPGs[0]
-                                        ));
-    if (sizeof_log > 1) PRINT(log);
+    for (int raygenID=0;raygenID<RAYGEN_COUNT;raygenID++) {
+      pgDesc.raygen.entryFunctionName = raygenNames[raygenID];
+      size_t sizeof_log = sizeof( log );
+      OPTIX_CHECK(optixProgramGroupCreate(optixContext,
+                                          &pgDesc,
+                                          1,
+                                          &pgOptions,
+                                          log,&sizeof_log,
+                                          &raygenPGs[raygenID]
+                                          ));
+      if (sizeof_log > 1) PRINT(log);
+    }
   }
     
   /*! does all setup for the miss program(s) we are going to use */
@@ -445,6 +584,21 @@ namespace opz {
                                         &missPGs[SHADOW_RAY_TYPE]
                                         ));
     if (sizeof_log > 1) PRINT(log);
+
+    // ------------------------------------------------------------------
+    // extend rays (wavefront mode)
+    // ------------------------------------------------------------------
+    pgDesc.miss.entryFunctionName = "__miss__extend";
+    sizeof_log = sizeof( log );
+
+    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
+                                        &pgDesc,
+                                        1,
+                                        &pgOptions,
+                                        log,&sizeof_log,
+                                        &missPGs[EXTEND_RAY_TYPE]
+                                        ));
+    if (sizeof_log > 1) PRINT(log);
   }
     
   /*! does all setup for the hitgroup program(s) we are going to use */
@@ -463,9 +617,10 @@ namespace opz {
     pgDesc.hitgroup.moduleAH            = module;           
 
     // -------------------------------------------------------
-    // radiance rays
+    // radiance rays: the general program that checks for normals
+    // and textures at runtime ...
     // -------------------------------------------------------
-    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__radiance";
+    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__radiance_dynamic";
     pgDesc.hitgroup.entryFunctionNameAH = "__anyhit__radiance";
 
     OPTIX_CHECK(optixProgramGroupCreate(optixContext,
@@ -477,6 +632,27 @@ namespace opz {
                                         ));
     if (sizeof_log > 1) PRINT(log);
 
+    // ... and one specialized program per material feature set
+    const char *variantNames[RADIANCE_HIT_VARIANT_COUNT] = {
+      "__closesthit__radiance",
+      "__closesthit__radiance_normals",
+      "__closesthit__radiance_texture",
+      "__closesthit__radiance_normals_texture"
+    };
+    radianceVariantPGs.resize(RADIANCE_HIT_VARIANT_COUNT);
+    for (int variant=0;variant<RADIANCE_HIT_VARIANT_COUNT;variant++) {
+      pgDesc.hitgroup.entryFunctionNameCH = variantNames[variant];
+      sizeof_log = sizeof( log );
+      OPTIX_CHECK(optixProgramGroupCreate(optixContext,
+                                          &pgDesc,
+                                          1,
+                                          &pgOptions,
+                                          log,&sizeof_log,
+                                          &radianceVariantPGs[variant]
+                                          ));
+      if (sizeof_log > 1) PRINT(log);
+    }
+
     // -------------------------------------------------------
     // shadow rays: technically we don't need this hit group,
     // since we just use the miss shader to check if we were not
@@ -484,6 +660,7 @@ namespace opz {
     // -------------------------------------------------------
     pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__shadow";
     pgDesc.hitgroup.entryFunctionNameAH = "__anyhit__shadow";
+    sizeof_log = sizeof( log );
 
     OPTIX_CHECK(optixProgramGroupCreate(optixContext,
                                         &pgDesc,
@@ -493,6 +670,24 @@ namespace opz {
                                         &hitgroupPGs[SHADOW_RAY_TYPE]
                                         ));
     if (sizeof_log > 1) PRINT(log);
+
+    // -------------------------------------------------------
+    // extend rays: closest hit only reports mesh, primitive and
+    // barycentrics; shading happens in a separate launch
+    // -------------------------------------------------------
+    pgDesc.hitgroup.entryFunctionNameCH = "__closesthit__extend";
+    pgDesc.hitgroup.moduleAH            = nullptr;
+    pgDesc.hitgroup.entryFunctionNameAH = nullptr;
+    sizeof_log = sizeof( log );
+
+    OPTIX_CHECK(optixProgramGroupCreate(optixContext,
+                                        &pgDesc,
+                                        1,
+                                        &pgOptions,
+                                        log,&sizeof_log,
+                                        &hitgroupPGs[EXTEND_RAY_TYPE]
+                                        ));
+    if (sizeof_log > 1) PRINT(log);
   }
     
 
@@ -504,9 +699,32 @@ namespace opz {
       programGroups.push_back(pg);
     for (auto pg : hitgroupPGs)
       programGroups.push_back(pg);
+    for (auto pg : radianceVariantPGs)
+      programGroups.push_back(pg);
     for (auto pg : missPGs)
       programGroups.push_back(pg);
+
+    // the path tracer bounces in raygen, so radiance->shadow is as
+    // deep as it gets ...
+    pipeline = linkPipeline(programGroups,2,pipelineStackSize);
+    // ... but the recursive variant (same programs, same SBT) needs
+    // one level per bounce
+    recursivePipeline = linkPipeline(programGroups,MAX_PATH_DEPTH+1,
+                                     recursivePipelineStackSize);
+    std::cout << "#osc: continuation stack: "
+              << pipelineStackSize << " bytes (iterative), "
+              << recursivePipelineStackSize << " bytes (recursive)" << std::endl;
+  }
+
+  /*! links the given programs into a pipeline for the given trace
+      depth, with a continuation stack just big enough for it */
+  OptixPipeline SampleRenderer::linkPipeline(const std::vector<OptixProgramGroup> &programGroups,
+                                             int maxTraceDepth,
+                                             unsigned int &continuationStackSize)
+  {
+    pipelineLinkOptions.maxTraceDepth = maxTraceDepth;
       
+    OptixPipeline linked;
     char log[2048];
     size_t sizeof_log = sizeof( log );
     PING;
@@ -517,25 +735,43 @@ namespace opz {
                                     programGroups.data(),
                                     (int)programGroups.size(),
                                     log,&sizeof_log,
-                                    &pipeline
+                                    &linked
                                     ));
     if (sizeof_log > 1) PRINT(log);
 
+    // we don't have any callables, so only the continuation stack
+    // matters: raygen, plus one hit or miss program per trace level
+    OptixStackSizes stackSizes = {};
+    for (auto pg : programGroups) {
+      OptixStackSizes pgStackSizes;
+      OPTIX_CHECK(optixProgramGroupGetStackSize(pg,&pgStackSizes));
+      stackSizes.cssRG = std::max(stackSizes.cssRG,pgStackSizes.cssRG);
+      stackSizes.cssCH = std::max(stackSizes.cssCH,pgStackSizes.cssCH);
+      stackSizes.cssMS = std::max(stackSizes.cssMS,pgStackSizes.cssMS);
+      stackSizes.cssAH = std::max(stackSizes.cssAH,pgStackSizes.cssAH);
+      stackSizes.cssIS = std::max(stackSizes.cssIS,pgStackSizes.cssIS);
+    }
+    const unsigned int cssHitOrMiss = std::max(stackSizes.cssCH,stackSizes.cssMS);
+    continuationStackSize
+      = stackSizes.cssRG
+      + (maxTraceDepth-1) * cssHitOrMiss
+      + std::max(cssHitOrMiss,stackSizes.cssIS+stackSizes.cssAH);
+
     OPTIX_CHECK(optixPipelineSetStackSize
                 (/* [in] The pipeline to configure the stack size for */
-                 pipeline, 
+                 linked, 
                  /* [in] The direct stack size requirement for direct
                     callables invoked from IS or AH. */
-                 2*1024,
+                 0,
                  /* [in] The direct stack size requirement for direct
                     callables invoked from RG, MS, or CH.  */                 
-                 2*1024,
+                 0,
                  /* [in] The continuation stack requirement. */
-                 2*1024,
+                 continuationStackSize,
                  /* [in] The maximum depth of a traversable graph
                     passed to trace. */
                  1));
-    if (sizeof_log > 1) PRINT(log);
+    return linked;
   }
 
 
@@ -573,28 +809,99 @@ namespace opz {
     // ------------------------------------------------------------------
     // build hitgroup records
     // ------------------------------------------------------------------
+    buildHitgroupRecords();
+  }
+
+  /*! packs and uploads the mesh and material tables the hit
+      programs index into */
+  void SampleRenderer::buildSceneTables()
+  {
+    sceneTables = packSceneTables(model,(int)textureObjects.size());
+
+    std::vector<MaterialData> materials;
+    for (auto &packed : sceneTables.materials) {
+      MaterialData material;
+      material.diffuseColor   = packed.diffuse;
+      material.emission       = packed.emission;
+      material.diffuseTexture
+        = (packed.diffuseTextureID >= 0)
+        ? textureObjects[packed.diffuseTextureID]
+        : 0;
+      materials.push_back(material);
+    }
+
+    std::vector<MeshData> meshes;
+    for (int meshID=0;meshID<(int)model->meshes.size();meshID++) {
+      MeshData mesh;
+      mesh.index      = (vec3i*)indexBuffer[meshID].d_pointer();
+      mesh.vertex     = (vec3f*)vertexBuffer[meshID].d_pointer();
+      mesh.normal     = (vec3f*)normalBuffer[meshID].d_pointer();
+      mesh.texcoord   = (vec2f*)texcoordBuffer[meshID].d_pointer();
+      mesh.materialID = sceneTables.meshMaterialIDs[meshID];
+      mesh.firstLightID = meshFirstLightID[meshID];
+      meshes.push_back(mesh);
+    }
+
+    std::cout << "#osc: packed " << meshes.size() << " meshes into "
+              << materials.size() << " unique materials" << std::endl;
+    materialTableBuffer.alloc_and_upload(materials);
+    meshTableBuffer.alloc_and_upload(meshes);
+    launchParams.materials = (const MaterialData*)materialTableBuffer.d_pointer();
+    launchParams.meshes    = (const MeshData*)meshTableBuffer.d_pointer();
+  }
+
+  /*! collects quad and emissive-mesh lights, and uploads them with
+      their alias table */
+  void SampleRenderer::buildLights()
+  {
+    const LightList lightList = buildLightList(model,quadLights);
+    meshFirstLightID = lightList.meshFirstLightID;
+    
+    std::cout << "#osc: " << lightList.lights.size() << " lights ("
+              << lightList.numQuadLights << " quads, "
+              << (lightList.lights.size()-lightList.numQuadLights)
+              << " emissive triangles)" << std::endl;
+    launchParams.lights.numLights     = (int)lightList.lights.size();
+    launchParams.lights.numQuadLights = lightList.numQuadLights;
+    if (lightList.lights.empty()) return;
+    lightsBuffer.alloc_and_upload(lightList.lights);
+    lightAliasTableBuffer.alloc_and_upload(lightList.aliasTable);
+    launchParams.lights.lights     = (const LightData*)lightsBuffer.d_pointer();
+    launchParams.lights.aliasTable = (const AliasEntry*)lightAliasTableBuffer.d_pointer();
+  }
+
+  /*! (re-)builds the hitgroup part of the SBT, picking one radiance
+      closest-hit variant per mesh */
+  void SampleRenderer::buildHitgroupRecords()
+  {
     int numObjects = (int)model->meshes.size();
     std::vector<HitgroupRecord> hitgroupRecords;
     for (int meshID=0;meshID<numObjects;meshID++) {
+      auto mesh = model->meshes[meshID];
+      const PackedMaterial &material
+        = sceneTables.materials[sceneTables.meshMaterialIDs[meshID]];
+      const bool hasNormals = !mesh->normal.empty();
+      const bool hasTexture
+        =  material.diffuseTextureID >= 0
+        && !mesh->texcoord.empty();
+      const int variant
+        = (hasNormals ? RADIANCE_HIT_NORMALS : 0)
+        | (hasTexture ? RADIANCE_HIT_TEXTURE : 0);
+
       for (int rayID=0;rayID<RAY_TYPE_COUNT;rayID++) {
-        auto mesh = model->meshes[meshID];
+        OptixProgramGroup pg = hitgroupPGs[rayID];
+        if (rayID == RADIANCE_RAY_TYPE && specializedHitPrograms)
+          pg = radianceVariantPGs[variant];
       
         HitgroupRecord rec;
-        OPTIX_CHECK(optixSbtRecordPackHeader(hitgroupPGs[rayID],&rec));
-        rec.data.color   = mesh->diffuse;
-        if (mesh->diffuseTextureID >= 0 && mesh->diffuseTextureID < textureObjects.size()) {
-          rec.data.hasTexture = true;
-          rec.data.texture    = textureObjects[mesh->diffuseTextureID];
-        } else {
-          rec.data.hasTexture = false;
-        }
-        rec.data.index    = (vec3i*)indexBuffer[meshID].d_pointer();
-        rec.data.vertex   = (vec3f*)vertexBuffer[meshID].d_pointer();
-        rec.data.normal   = (vec3f*)normalBuffer[meshID].d_pointer();
-        rec.data.texcoord = (vec2f*)texcoordBuffer[meshID].d_pointer();
+        OPTIX_CHECK(optixSbtRecordPackHeader(pg,&rec));
+        // shadow rays never run a hit program, so only radiance and
+        // extend records need to know their mesh
+        rec.data.meshID = (rayID == SHADOW_RAY_TYPE) ? -1 : meshID;
         hitgroupRecords.push_back(rec);
       }
     }
+    if (hitgroupRecordsBuffer.d_ptr) hitgroupRecordsBuffer.free();
     hitgroupRecordsBuffer.alloc_and_upload(hitgroupRecords);
     sbt.hitgroupRecordBase          = hitgroupRecordsBuffer.d_pointer();
     sbt.hitgroupRecordStrideInBytes = sizeof(HitgroupRecord);
@@ -603,38 +910,162 @@ namespace opz {
 
 
 
-  /*! render one frame */
-  void SampleRenderer::render()
+  /*! the optix denoiser's name for one of our PIXEL_* formats */
+  static OptixPixelFormat optixPixelFormat(int format)
+  {
+    return format == PIXEL_HALF3 ? OPTIX_PIXEL_FORMAT_HALF3
+      :    format == PIXEL_HALF4 ? OPTIX_PIXEL_FORMAT_HALF4
+      :                            OPTIX_PIXEL_FORMAT_FLOAT4;
+  }
+
+  /*! the part of 'image' at 'origin' of given size - the same rows,
+      just starting further in */
+  static OptixImage2D subImage(const OptixImage2D &image,
+                               const vec2i &origin, const vec2i &size)
+  {
+    OptixImage2D sub = image;
+    sub.data  += origin.y*size_t(image.rowStrideInBytes)
+      + origin.x*size_t(image.pixelStrideInBytes);
+    sub.width  = size.x;
+    sub.height = size.y;
+    return sub;
+  }
+
+  /*! queue up one frame */
+  void SampleRenderer::render(bool present)
   {
     // sanity check: make sure we launch only after first resize is
     // already done:
     if (launchParams.frame.size.x == 0) return;
+    // a different denoiser model means a new denoiser, with buffers
+    // of its own - as does a different aov precision
+    if (denoiserModel != createdDenoiserModel || aovPrecision != createdAovPrecision)
+      resize(displaySize);
+
+    auto &tracker = AllocationTracker::get();
+    allocsLastFrame   = tracker.numAllocs - allocsBeforeFrame;
+    allocsBeforeFrame = tracker.numAllocs;
+
+    // take in what earlier frames finished meanwhile, and wait for
+    // the oldest one only if all slots are taken
+    collectFrames();
+    // (skipping the one the display holds on to, if it's one of them)
+    const int numSlots = std::max(heldSlot >= 0 ? 2 : 1,
+                                  std::min(framesInFlight,(int)MAX_FRAMES_IN_FLIGHT));
+    currentSlot = (currentSlot+1) % numSlots;
+    if (currentSlot == heldSlot)
+      currentSlot = (currentSlot+1) % numSlots;
+    FrameSlot &slot = frameSlots[currentSlot];
+    collectFrames(&slot);
+    beginDisplayPixels(slot);
+    slot.ready           = false;
+    slot.presented       = present;
+    slot.countsActive    = false;
+    slot.feedsSamples    = false;
+    slot.feedsResolution = false;
+    CUDA_CHECK(EventRecord(slot.start,stream));
+
+    const bool tiled = tiledLaunches && !wavefront;
+    // (a tile pass in progress is still the same frame)
+    if (!accumulate && !(tiled && tileScheduler.passActive()))
+      launchParams.frame.frameID = 0;
+    if (adaptiveConverged()) {
+      // nothing left worth sampling; keep showing what we have
+      computeDisplayPixels();
+      submitFrame(slot);
+      return;
+    }
 
-    if (!accumulate)
+    // dynamic resolution: pick this frame's render size. all frame
+    // buffers are allocated for the display size, and used densely
+    // packed at whatever size we actually render
+    const bool  moved = cameraMoved;
+    const float scale
+      = dynamicResolution ? resolutionController.beginFrame(moved) : 1.f;
+    cameraMoved = false;
+    const vec2i renderSize(std::max(1,int(displaySize.x*scale+.5f)),
+                           std::max(1,int(displaySize.y*scale+.5f)));
+    if (renderSize != launchParams.frame.size) {
+      // a new resolution is just another view to reproject from
+      if (temporalReprojection && launchParams.frame.frameID > 0
+          && !reprojectionPending) {
+        reprojectionCamera  = launchParams.camera;
+        reprojectionPending = true;
+      }
       launchParams.frame.frameID = 0;
-    launchParamsBuffer.upload(&launchParams,1);
-    launchParams.frame.frameID++;
+    }
     
-    OPTIX_CHECK(optixLaunch(/*! pipeline we're launching launch: */
-                            pipeline,stream,
-                            /*! parameters and SBT */
-                            launchParamsBuffer.d_pointer(),
-                            launchParamsBuffer.sizeInBytes,
-                            &sbt,
-                            /*! dimensions of the launch: */
-                            launchParams.frame.size.x,
-                            launchParams.frame.size.y,
-                            1
-                            ));
-
-    denoiserIntensity.resize(sizeof(float));
+    // keep the last frame's buffers around to reproject from
+    const bool reproject
+      = reprojectionPending && temporalReprojection
+      && launchParams.frame.frameID == 0
+      && !wavefront && !launchParams.adaptive.enabled;
+    reprojectionPending = false;
+    if (reproject) {
+      reprojectionSize = launchParams.frame.size;
+      const size_t numPixels = launchParams.frame.size.x*launchParams.frame.size.y;
+      CUDA_CHECK(MemcpyAsync((void*)prevColor.d_pointer(),(void*)fbColor.d_pointer(),
+                             numPixels*sizeof(float4),cudaMemcpyDeviceToDevice,stream));
+      CUDA_CHECK(MemcpyAsync((void*)prevNormal.d_pointer(),(void*)fbNormal.d_pointer(),
+                             numPixels*pixelSize(guideFormat),cudaMemcpyDeviceToDevice,stream));
+      CUDA_CHECK(MemcpyAsync((void*)prevPosition.d_pointer(),(void*)fbPosition.d_pointer(),
+                             numPixels*sizeof(float4),cudaMemcpyDeviceToDevice,stream));
+      CUDA_CHECK(MemcpyAsync((void*)prevHistory.d_pointer(),(void*)fbHistory.d_pointer(),
+                             numPixels*sizeof(float),cudaMemcpyDeviceToDevice,stream));
+    }
+    launchParams.frame.size = renderSize;
+    // (accumulation starting over makes the last denoised image stale)
+    const bool restarted = launchParams.frame.frameID == 0;
+    // motion vectors lead back to the last denoised frame, since
+    // that's what the temporal denoiser warps
+    launchParams.frame.motionCamera
+      = haveDenoised && denoisedSize == renderSize ? denoisedCamera : launchParams.camera;
+    if (wavefront && launchParams.frame.motionBuffer)
+      // (only the megakernel writes them)
+      CUDA_CHECK(MemsetAsync((void*)launchParams.frame.motionBuffer,0,
+                             renderSize.x*renderSize.y*sizeof(float2),stream));
+
+    // how many samples - in how many launches - this frame gets
+    const bool autoSamples = autoSampleCount && !tiled;
+    const SamplePlan plan
+      = autoSamples
+      ? sampleController.beginFrame(moved,renderSize.x*renderSize.y)
+      : SamplePlan{ launchParams.numPixelSamples,1 };
+    launchParams.numPixelSamples = plan.samplesPerLaunch;
+    // (the only thing in here that may need more memory, and only
+    // when the frame or batch grows)
+    if (wavefront)
+      resizeWavefrontQueues(wavefrontBatchPixels()*plan.samplesPerLaunch);
+
+    // from here on, nothing may allocate (see AllocationTracker)
+    HotPathScope hotPath;
+    CUDA_CHECK(EventRecord(slot.launchStart,stream));
+    if (tiled)
+      renderTiles(reproject);
+    else
+      for (int launchID=0;launchID<plan.numLaunches;launchID++) {
+        if (launchParams.frame.frameID == 0)
+          launchParams.frame.firstSampleIndex = 0;
+        if (wavefront)
+          renderWavefront();
+        else {
+          if (launchParams.adaptive.enabled)
+            CUDA_CHECK(MemsetAsync((void*)adaptiveActiveCounter.d_pointer(),0,
+                                   sizeof(int),stream));
+          uploadLaunchParams(launchParams);
+          launchRaygen(RAYGEN_RENDER_FRAME,
+                       launchParams.frame.size.x,
+                       launchParams.frame.size.y);
+          if (reproject && launchID == 0)
+            reprojectHistory();
+        }
+        launchParams.frame.firstSampleIndex += launchParams.numPixelSamples;
+        launchParams.frame.frameID++;
+      }
+    CUDA_CHECK(EventRecord(slot.launchEnd,stream));
 
-    OptixDenoiserParams denoiserParams;
+    OptixDenoiserParams denoiserParams = {};
     denoiserParams.denoiseAlpha = 1;
-#if OPTIX_VERSION >= 70300
-    if (denoiserIntensity.sizeInBytes != sizeof(float))
-        denoiserIntensity.alloc(sizeof(float));
-#endif
     denoiserParams.hdrIntensity = denoiserIntensity.d_pointer();
     if(accumulate)
         denoiserParams.blendFactor  = 1.f/(launchParams.frame.frameID);
@@ -663,12 +1094,12 @@ namespace opz {
     /// Height of the image (in pixels)
     inputLayer[2].height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    inputLayer[2].rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    inputLayer[2].rowStrideInBytes = launchParams.frame.size.x * pixelSize(guideFormat);
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    inputLayer[2].pixelStrideInBytes = sizeof(float4);
+    inputLayer[2].pixelStrideInBytes = pixelSize(guideFormat);
     /// Pixel format.
-    inputLayer[2].format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    inputLayer[2].format = optixPixelFormat(guideFormat);
 
     // ..................................................................
     inputLayer[1].data = fbAlbedo.d_pointer();
@@ -677,12 +1108,12 @@ namespace opz {
     /// Height of the image (in pixels)
     inputLayer[1].height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    inputLayer[1].rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    inputLayer[1].rowStrideInBytes = launchParams.frame.size.x * pixelSize(guideFormat);
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    inputLayer[1].pixelStrideInBytes = sizeof(float4);
+    inputLayer[1].pixelStrideInBytes = pixelSize(guideFormat);
     /// Pixel format.
-    inputLayer[1].format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    inputLayer[1].format = optixPixelFormat(guideFormat);
 
     // -------------------------------------------------------
     OptixImage2D outputLayer;
@@ -692,82 +1123,714 @@ namespace opz {
     /// Height of the image (in pixels)
     outputLayer.height = launchParams.frame.size.y;
     /// Stride between subsequent rows of the image (in bytes).
-    outputLayer.rowStrideInBytes = launchParams.frame.size.x * sizeof(float4);
+    outputLayer.rowStrideInBytes = launchParams.frame.size.x * pixelSize(denoisedFormat);
     /// Stride between subsequent pixels of the image (in bytes).
     /// For now, only 0 or the value that corresponds to a dense packing of pixels (no gaps) is supported.
-    outputLayer.pixelStrideInBytes = sizeof(float4);
+    outputLayer.pixelStrideInBytes = pixelSize(denoisedFormat);
     /// Pixel format.
-    outputLayer.format = OPTIX_PIXEL_FORMAT_FLOAT4;
+    outputLayer.format = optixPixelFormat(denoisedFormat);
+
+    // -------------------------------------------------------
+    // temporal model only: the motion vectors, and what to warp along
+    // them - the last denoised image, or if there's none that fits,
+    // this frame's input
+    OptixImage2D flowLayer = {};
+    flowLayer.data               = motionBuffer.d_pointer();
+    flowLayer.width              = launchParams.frame.size.x;
+    flowLayer.height             = launchParams.frame.size.y;
+    flowLayer.rowStrideInBytes   = launchParams.frame.size.x * sizeof(float2);
+    flowLayer.pixelStrideInBytes = sizeof(float2);
+    flowLayer.format             = OPTIX_PIXEL_FORMAT_FLOAT2;
+    const bool temporal = createdDenoiserModel == DENOISER_MODEL_TEMPORAL;
+    OptixImage2D previousOutputLayer = inputLayer[0];
+    if (haveDenoised && denoisedSize == launchParams.frame.size) {
+      previousOutputLayer      = outputLayer;
+      previousOutputLayer.data = prevDenoised.d_pointer();
+    }
 
     // -------------------------------------------------------
-    if (denoiserOn) {
+    // denoise only what gets shown - and once converged, only now
+    // and then (see DenoiserScheduler); skipped frames keep showing
+    // the last denoised image
+    if (restarted || !denoiserOn)
+      denoiserScheduler.invalidate();
+    denoisedLastFrame
+      = denoiserOn && denoiserScheduler.shouldDenoise(present,launchParams.frame.firstSampleIndex);
+    if (denoisedLastFrame && denoiserBackend == DENOISER_BACKEND_CPU) {
+      denoiseOnCPU();
+    } else if (denoisedLastFrame) {
+      const vec2i size = launchParams.frame.size;
+      if (size != denoiserTilesFor) {
+        denoiserTiles = planDenoiserTiles(size,
+                                          denoiserTiled ? vec2i(denoiserTileSize) : size,
+                                          denoiserOverlap);
+        denoiserTilesFor = size;
+      }
+
+      // one intensity for all tiles, or they'd come out in different
+      // exposures; when tiling, it's estimated from the middle of the
+      // frame, since its scratch grows with the pixels it looks at
+      const vec2i intensitySize = denoiserTiled ? denoiserTiles[0].inputSize : size;
+      const OptixImage2D intensityInput
+        = subImage(inputLayer[0],(size-intensitySize)/2,intensitySize);
       OPTIX_CHECK(optixDenoiserComputeIntensity
                   (denoiser,
-                   /*stream*/0,
-                   &inputLayer[0],
+                   stream,
+                   &intensityInput,
                    (CUdeviceptr)denoiserIntensity.d_pointer(),
                    (CUdeviceptr)denoiserScratch.d_pointer(),
-                   denoiserScratch.size()));
-      
+                   denoiserScratchSize));
+
+      // each tile reads its input window, and writes only its part of
+      // the output - the same as optixUtilDenoiserInvokeTiled() does
+      for (const DenoiserTile &tile : denoiserTiles) {
+        OptixImage2D tileInput[3];
+        for (int i=0;i<3;i++)
+          tileInput[i] = subImage(inputLayer[i],tile.inputOrigin,tile.inputSize);
+        OptixImage2D tileOutput
+          = subImage(outputLayer,tile.outputOrigin,tile.outputSize);
+        const vec2i inputOffset = tile.inputOffset();
 #if OPTIX_VERSION >= 70300
-    OptixDenoiserGuideLayer denoiserGuideLayer = {};
-    denoiserGuideLayer.albedo = inputLayer[1];
-    denoiserGuideLayer.normal = inputLayer[2];
-
-    OptixDenoiserLayer denoiserLayer = {};
-    denoiserLayer.input = inputLayer[0];
-    denoiserLayer.output = outputLayer;
-
-      OPTIX_CHECK(optixDenoiserInvoke(denoiser,
-                                      /*stream*/0,
-                                      &denoiserParams,
-                                      denoiserState.d_pointer(),
-                                      denoiserState.size(),
-                                      &denoiserGuideLayer,
-                                      &denoiserLayer,1,
-                                      /*inputOffsetX*/0,
-                                      /*inputOffsetY*/0,
-                                      denoiserScratch.d_pointer(),
-                                      denoiserScratch.size()));
+        OptixDenoiserGuideLayer denoiserGuideLayer = {};
+        denoiserGuideLayer.albedo = tileInput[1];
+        denoiserGuideLayer.normal = tileInput[2];
+
+        OptixDenoiserLayer denoiserLayer = {};
+        denoiserLayer.input = tileInput[0];
+        denoiserLayer.output = tileOutput;
+        if (temporal) {
+          denoiserGuideLayer.flow
+            = subImage(flowLayer,tile.inputOrigin,tile.inputSize);
+          denoiserLayer.previousOutput
+            = subImage(previousOutputLayer,tile.inputOrigin,tile.inputSize);
+        }
+
+        OPTIX_CHECK(optixDenoiserInvoke(denoiser,
+                                        stream,
+                                        &denoiserParams,
+                                        denoiserState.d_pointer(),
+                                        denoiserStateSize,
+                                        &denoiserGuideLayer,
+                                        &denoiserLayer,1,
+                                        inputOffset.x,
+                                        inputOffset.y,
+                                        denoiserScratch.d_pointer(),
+                                        denoiserScratchSize));
 #else
-      OPTIX_CHECK(optixDenoiserInvoke(denoiser,
-                                      /*stream*/0,
-                                      &denoiserParams,
-                                      denoiserState.d_pointer(),
-                                      denoiserState.size(),
-                                      &inputLayer[0],2,
-                                      /*inputOffsetX*/0,
-                                      /*inputOffsetY*/0,
-                                      &outputLayer,
-                                      denoiserScratch.d_pointer(),
-                                      denoiserScratch.size()));
+        OPTIX_CHECK(optixDenoiserInvoke(denoiser,
+                                        stream,
+                                        &denoiserParams,
+                                        denoiserState.d_pointer(),
+                                        denoiserStateSize,
+                                        &tileInput[0],2,
+                                        inputOffset.x,
+                                        inputOffset.y,
+                                        &tileOutput,
+                                        denoiserScratch.d_pointer(),
+                                        denoiserScratchSize));
 #endif
+      }
+      if (temporal) {
+        // (the output can't be the next frame's previous output in
+        // place, the denoiser would overwrite what it still reads)
+        CUDA_CHECK(MemcpyAsync((void*)prevDenoised.d_pointer(),(void*)outputLayer.data,
+                               size.x*size.y*pixelSize(denoisedFormat),
+                               cudaMemcpyDeviceToDevice,stream));
+        denoisedSize   = size;
+        denoisedCamera = launchParams.camera;
+        haveDenoised   = true;
+      }
+    }
+    // (without the denoiser, the display reads the accumulation)
+    computeDisplayPixels();
+
+    // no sync here: all of the above is ordered on the stream, and
+    // what the host needs to know comes back through collectFrames()
+    if (!launchParams.adaptive.enabled || wavefront)
+      adaptiveActivePixels = -1;
+    else
+      // (mid-pass, the counter only knows part of the frame)
+      slot.countsActive = !tiled || tilePassCompleted;
+    slot.feedsSamples    = autoSamples;
+    slot.plan            = plan;
+    slot.numPixels       = renderSize.x*renderSize.y;
+    // (frames that fill the sample budget say nothing about the
+    // resolution we can afford while moving)
+    slot.feedsResolution = dynamicResolution && (moved || !autoSamples);
+    slot.scale           = scale;
+    submitFrame(slot);
+  }
+
+  /*! the host backend of render()'s denoising: the frame and its
+      guides come down, get filtered on the host's threads, and the
+      result goes back up. the host has to wait for the frame's
+      launches for that, so with this backend, frames don't overlap */
+  void SampleRenderer::denoiseOnCPU()
+  {
+    const vec2i  size      = launchParams.frame.size;
+    const size_t numPixels = size_t(size.x)*size.y;
+    // (grow-only, like the device buffers)
+    if (cpuColor.size() < numPixels) {
+      cpuColor.resize(numPixels);
+      cpuAlbedo.resize(numPixels);
+      cpuNormal.resize(numPixels);
+      cpuStaging[0].resize(numPixels*sizeof(vec4f));
+      cpuStaging[1].resize(numPixels*sizeof(vec4f));
+    }
+    if (!cpuDenoiserPool)
+      cpuDenoiserPool.reset(new ThreadPool());
+
+    // (the guides come down in whatever format they're in)
+    CUDA_CHECK(MemcpyAsync(cpuColor.data(),(void*)fbColor.d_pointer(),
+                           numPixels*sizeof(vec4f),cudaMemcpyDeviceToHost,stream));
+    CUDA_CHECK(MemcpyAsync(cpuStaging[0].data(),(void*)fbAlbedo.d_pointer(),
+                           numPixels*pixelSize(guideFormat),cudaMemcpyDeviceToHost,stream));
+    CUDA_CHECK(MemcpyAsync(cpuStaging[1].data(),(void*)fbNormal.d_pointer(),
+                           numPixels*pixelSize(guideFormat),cudaMemcpyDeviceToHost,stream));
+    CUDA_CHECK(StreamSynchronize(stream));
+    const PixelBuffer albedo = { cpuStaging[0].data(),guideFormat };
+    const PixelBuffer normal = { cpuStaging[1].data(),guideFormat };
+    for (size_t i=0;i<numPixels;i++) {
+      cpuAlbedo[i] = albedo.read(i);
+      cpuNormal[i] = normal.read(i);
+    }
+    cpuDenoiser.denoise(cpuColor.data(),cpuAlbedo.data(),cpuNormal.data(),
+                        size,cpuColor.data(),cpuDenoiserPool.get());
+    const PixelBuffer denoised = { cpuStaging[0].data(),denoisedFormat };
+    for (size_t i=0;i<numPixels;i++)
+      denoised.write(i,cpuColor[i]);
+    CUDA_CHECK(MemcpyAsync((void*)denoisedBuffer.d_pointer(),cpuStaging[0].data(),
+                           numPixels*pixelSize(denoisedFormat),cudaMemcpyHostToDevice,stream));
+  }
+
+  /*! queue the current slot's downloads and its 'done' event */
+  void SampleRenderer::submitFrame(FrameSlot &slot)
+  {
+    slot.size = displaySize;
+    if (slot.displayResource) {
+      // (stream-ordered: the display's next use of it waits for us)
+      CUDA_CHECK(GraphicsUnmapResources(1,&slot.displayResource,stream));
     } else {
-      cudaMemcpy((void*)outputLayer.data,(void*)inputLayer[0].data,
-                 outputLayer.width*outputLayer.height*sizeof(float4),
-                 cudaMemcpyDeviceToDevice);
+      CUDA_CHECK(MemcpyAsync(slot.hostPixels,slot.finalColorBuffer.d_ptr,
+                             displaySize.x*displaySize.y*sizeof(uint32_t),
+                             cudaMemcpyDeviceToHost,stream));
+    }
+    slot.hasLinear = onLinearFrameDone && slot.presented;
+    if (slot.hasLinear) {
+      const PixelBuffer color = linearColor();
+      const size_t bytes = size_t(launchParams.frame.size.x)*launchParams.frame.size.y
+        * pixelSize(color.format);
+      if (slot.hostLinearCapacity < bytes) {
+        // (this slot's last download got collected before it came back)
+        if (slot.hostLinear) CUDA_CHECK(FreeHost(slot.hostLinear));
+        CUDA_CHECK(MallocHost(&slot.hostLinear,bytes));
+        slot.hostLinearCapacity = bytes;
+      }
+      CUDA_CHECK(MemcpyAsync(slot.hostLinear,color.data,bytes,
+                             cudaMemcpyDeviceToHost,stream));
+      slot.linearFormat = color.format;
+      slot.linearSize   = launchParams.frame.size;
+    }
+    if (slot.countsActive)
+      CUDA_CHECK(MemcpyAsync(slot.hostActivePixels,adaptiveActiveCounter.d_ptr,
+                             sizeof(int),cudaMemcpyDeviceToHost,stream));
+    CUDA_CHECK(EventRecord(slot.done,stream));
+    slot.frameNumber = numFramesSubmitted++;
+    slot.pending     = true;
+  }
+
+  /*! take in all frames that are done, oldest first - they finish
+      in order, since they all run on the one stream */
+  void SampleRenderer::collectFrames(const FrameSlot *until)
+  {
+    while (!until || until->pending) {
+      FrameSlot *oldest = nullptr;
+      for (auto &slot : frameSlots)
+        if (slot.pending && (!oldest || slot.frameNumber < oldest->frameNumber))
+          oldest = &slot;
+      if (!oldest) return;
+      if (!until && cudaEventQuery(oldest->done) == cudaErrorNotReady) return;
+      CUDA_CHECK(EventSynchronize(oldest->done));
+
+      oldest->pending = false;
+      oldest->ready   = true;
+      if (onFrameDone && oldest->presented && !oldest->displayResource)
+        onFrameDone(oldest->hostPixels,oldest->size);
+      if (onLinearFrameDone && oldest->hasLinear)
+        onLinearFrameDone(PixelBuffer{ oldest->hostLinear,oldest->linearFormat },
+                          oldest->linearSize);
+      if (oldest->countsActive)
+        adaptiveActivePixels = *oldest->hostActivePixels;
+      float frameTime = 0.f;
+      CUDA_CHECK(EventElapsedTime(&frameTime,oldest->start,oldest->done));
+      if (oldest->feedsSamples) {
+        float launchTime = 0.f;
+        CUDA_CHECK(EventElapsedTime(&launchTime,oldest->launchStart,oldest->launchEnd));
+        sampleController.endFrame(oldest->plan,oldest->numPixels,
+                                  1e-3*launchTime,1e-3*frameTime);
+      }
+      if (oldest->feedsResolution)
+        resolutionController.endFrame(oldest->scale,1e-3*frameTime);
+    }
+  }
+
+  /*! point the slot's displayPixels at where it renders to: the
+      display's buffer, mapped until submitFrame(), or our own */
+  void SampleRenderer::beginDisplayPixels(FrameSlot &slot)
+  {
+    if (!slot.displayResource) {
+      slot.displayPixels = (uint32_t*)slot.finalColorBuffer.d_pointer();
+      return;
+    }
+    CUDA_CHECK(GraphicsMapResources(1,&slot.displayResource,stream));
+    size_t size = 0;
+    CUDA_CHECK(GraphicsResourceGetMappedPointer((void**)&slot.displayPixels,&size,
+                                                slot.displayResource));
+    if (size < displaySize.x*displaySize.y*sizeof(uint32_t))
+      throw std::runtime_error("display buffer is smaller than the frame");
+  }
+
+  /*! hand the frame slots the display's buffers (or take them back,
+      with nullptr); frames done in the old ones can't be shown */
+  void SampleRenderer::setDisplayBuffers(const cudaGraphicsResource_t *resources)
+  {
+    CUDA_CHECK(StreamSynchronize(stream));
+    collectFrames();
+    for (int i=0;i<MAX_FRAMES_IN_FLIGHT;i++) {
+      frameSlots[i].displayResource = resources ? resources[i] : nullptr;
+      frameSlots[i].ready = false;
+    }
+  }
+
+  /*! stream-ordered upload of 'params': goes through the next pinned
+      staging slot, once the copy that last used it has run */
+  void SampleRenderer::uploadLaunchParams(const LaunchParams &params)
+  {
+    const int ringSlot = nextLaunchParams;
+    nextLaunchParams = (nextLaunchParams+1) % LAUNCH_PARAMS_RING_SIZE;
+    CUDA_CHECK(EventSynchronize(launchParamsCopied[ringSlot]));
+    pinnedLaunchParams[ringSlot] = params;
+    CUDA_CHECK(MemcpyAsync(launchParamsBuffer.d_ptr,&pinnedLaunchParams[ringSlot],
+                           sizeof(LaunchParams),cudaMemcpyHostToDevice,stream));
+    CUDA_CHECK(EventRecord(launchParamsCopied[ringSlot],stream));
+  }
+
+  /*! global stop criterion of adaptive sampling: true once (nearly)
+      every pixel has converged */
+  bool SampleRenderer::adaptiveConverged() const
+  {
+    const vec2i size = launchParams.frame.size;
+    return launchParams.adaptive.enabled
+      && !wavefront
+      && launchParams.frame.frameID > 0
+      && adaptiveActivePixels >= 0
+      && adaptiveActivePixels <= adaptiveStopFraction*size.x*size.y;
+  }
+
+  /*! fills the final color buffer with the (denoised) image, or the
+      sample heatmap */
+  void SampleRenderer::computeDisplayPixels()
+  {
+    if (showSampleHeatmap && launchParams.adaptive.enabled && !wavefront)
+      computeSampleHeatmap();
+    else
+      computeFinalPixelColors();
+  }
+
+  /*! launch a single raygen program (one of RAYGEN_*) */
+  void SampleRenderer::launchRaygen(int raygenID, int width, int height)
+  {
+    // all raygen records live in one buffer; optix only ever looks at
+    // the one the SBT points to
+    OptixShaderBindingTable launchSBT = sbt;
+    launchSBT.raygenRecord
+      = raygenRecordsBuffer.d_pointer() + raygenID*sizeof(RaygenRecord);
+    
+    // only the megakernel ever recurses
+    OptixPipeline launchPipeline
+      = (raygenID == RAYGEN_RENDER_FRAME && launchParams.path.recursive)
+      ? recursivePipeline
+      : pipeline;
+    
+    OPTIX_CHECK(optixLaunch(/*! pipeline we're launching launch: */
+                            launchPipeline,stream,
+                            /*! parameters and SBT */
+                            launchParamsBuffer.d_pointer(),
+                            launchParamsBuffer.sizeInBytes,
+                            &launchSBT,
+                            /*! dimensions of the launch: */
+                            width,
+                            height,
+                            1
+                            ));
+  }
+
+  /*! as many whole pixels as wavefrontBatchRays has room for - but
+      at least one, and no more than the frame has */
+  int SampleRenderer::wavefrontBatchPixels() const
+  {
+    const int numPixels = launchParams.frame.size.x*launchParams.frame.size.y;
+    const int numPixelSamples = std::max(1,launchParams.numPixelSamples);
+    return std::max(1,std::min(numPixels,wavefrontBatchRays/numPixelSamples));
+  }
+
+  /*! (re-)allocates the wavefront queues if the frame buffer or
+      the batch grew */
+  void SampleRenderer::resizeWavefrontQueues(int numRays)
+  {
+    const int numPixels = launchParams.frame.size.x*launchParams.frame.size.y;
+    if (wfColorSum.sizeInBytes < numPixels*sizeof(float4)) {
+      wfColorSum.resize(numPixels*sizeof(float4));
+      wfNormalSum.resize(numPixels*sizeof(float4));
+      wfAlbedoSum.resize(numPixels*sizeof(float4));
     }
-    computeFinalPixelColors();
+    if (numRays > wfRayCapacity) {
+      wfRays.resize(numRays*sizeof(WavefrontRay));
+      wfHitFlags.resize(numRays*sizeof(int));
+      wfHits.resize(numRays*sizeof(WavefrontHit));
+      wfSortedHits.resize(numRays*sizeof(WavefrontHit));
+      wfShadowRays.resize(numRays*NUM_LIGHT_SAMPLES*sizeof(WavefrontShadowRay));
+      wfRayCapacity = numRays;
+    }
+    if (!wfCounters.d_ptr)
+      wfCounters.alloc(WF_COUNTER_COUNT*sizeof(int));
+    if (!wfMaterialOffsets.d_ptr)
+      wfMaterialOffsets.alloc(std::max(size_t(1),sceneTables.materials.size())*sizeof(int));
+
+    WavefrontQueues &wf = launchParams.wavefront;
+    wf.rays       = (WavefrontRay*)wfRays.d_pointer();
+    wf.hitFlags   = (int*)wfHitFlags.d_pointer();
+    wf.hits       = (WavefrontHit*)wfHits.d_pointer();
+    wf.sortedHits = (WavefrontHit*)wfSortedHits.d_pointer();
+    wf.shadowRays = (WavefrontShadowRay*)wfShadowRays.d_pointer();
+    wf.counters   = (int*)wfCounters.d_pointer();
+    wf.colorSum   = (float4*)wfColorSum.d_pointer();
+    wf.normalSum  = (float4*)wfNormalSum.d_pointer();
+    wf.albedoSum  = (float4*)wfAlbedoSum.d_pointer();
+  }
+
+  /*! the wavefront version of the optix launch in render(): each
+      stage is its own launch, over the queue the previous one wrote.
+      the queues only hold wavefrontBatchPixels() pixels' rays, so
+      the stages run once per batch, all into the same pixel sums */
+  void SampleRenderer::renderWavefront()
+  {
+    const vec2i size        = launchParams.frame.size;
+    const int   numPixels   = size.x*size.y;
+    const int   batchPixels = wavefrontBatchPixels();
+    resizeWavefrontQueues(batchPixels*launchParams.numPixelSamples);
+
+    CUDA_CHECK(MemsetAsync((void*)wfColorSum.d_pointer(),0,
+                           numPixels*sizeof(float4),stream));
+    CUDA_CHECK(MemsetAsync((void*)wfNormalSum.d_pointer(),0,
+                           numPixels*sizeof(float4),stream));
+    CUDA_CHECK(MemsetAsync((void*)wfAlbedoSum.d_pointer(),0,
+                           numPixels*sizeof(float4),stream));
+
+    for (int firstPixel=0;firstPixel<numPixels;firstPixel+=batchPixels) {
+      const int numBatchPixels = std::min(batchPixels,numPixels-firstPixel);
+      const int numRays = numBatchPixels*launchParams.numPixelSamples;
+      CUDA_CHECK(MemsetAsync((void*)wfCounters.d_pointer(),0,
+                             wfCounters.sizeInBytes,stream));
+      launchParams.wavefront.firstPixel = firstPixel;
+      uploadLaunchParams(launchParams);
+
+      launchRaygen(RAYGEN_WF_GENERATE,numBatchPixels,1);
+      launchRaygen(RAYGEN_WF_EXTEND,numRays,1);
+      sortHitsByMaterial(numRays);
+      launchRaygen(RAYGEN_WF_SHADE,numRays,1);
+      launchRaygen(RAYGEN_WF_CONNECT,numRays*NUM_LIGHT_SAMPLES,1);
+      wfLastBatchRays = numRays;
+    }
+    resolveWavefrontFrame();
+  }
+
+  /*! the tiled version of render()'s launch: renders tiles of the
+      current pass until tileScheduler says the frame's time is up */
+  void SampleRenderer::renderTiles(bool reproject)
+  {
+    tileScheduler.setFrame(launchParams.frame.size);
+    // a new pass if there's none - or if anybody reset the
+    // accumulation since it started, since the host's frameID runs
+    // one ahead of the pass' while it's in progress
+    if (!tileScheduler.passActive()
+        || launchParams.frame.frameID != tilePassFrameID+1) {
+      if (launchParams.frame.frameID == 0)
+        launchParams.frame.firstSampleIndex = 0;
+      tilePassFrameID      = launchParams.frame.frameID++;
+      tileReprojectPending = reproject;
+      tileScheduler.beginPass();
+      if (launchParams.adaptive.enabled)
+        CUDA_CHECK(MemsetAsync((void*)adaptiveActiveCounter.d_pointer(),0,
+                               sizeof(int),stream));
+    }
+
+    LaunchParams tileParams = launchParams;
+    tileParams.frame.frameID = tilePassFrameID;
+    tileScheduler.beginFrame();
+    do {
+      const Tile &tile = tileScheduler.currentTile();
+      const double t0 = getCurrentTime();
+      tileParams.frame.tileOrigin = tile.origin;
+      uploadLaunchParams(tileParams);
+      launchRaygen(RAYGEN_RENDER_FRAME,tile.size.x,tile.size.y);
+      // (waiting for each tile is what keeps the frame in its slice)
+      CUDA_CHECK(StreamSynchronize(stream));
+      tilePassCompleted = tileScheduler.tileDone(getCurrentTime()-t0);
+    } while (tileScheduler.timeLeft());
+
+    if (tilePassCompleted) {
+      // only now is every pixel fresh enough to blend with its history
+      if (tileReprojectPending)
+        reprojectHistory();
+      tileReprojectPending = false;
+      launchParams.frame.firstSampleIndex += launchParams.numPixelSamples;
+    }
+  }
+
+  /*! render one wavefront frame, and check its queues - which hold
+      its last batch - against the CPU reference compaction and sort */
+  bool SampleRenderer::validateWavefront()
+  {
+    const bool wasWavefront = wavefront;
+    wavefront = true;
+    render();
+    wavefront = wasWavefront;
+
+    const int numRays = wfLastBatchRays;
+    if (numRays == 0) return false;
+
+    // download everything; the buffers may be larger than this frame
+    // needs, so copy only the part that's in use
+    std::vector<int> counters(WF_COUNTER_COUNT);
+    wfCounters.download(counters.data(),WF_COUNTER_COUNT);
+    const int numHits = counters[WF_NUM_HITS];
+    std::vector<int>          hitFlags(numRays);
+    std::vector<WavefrontHit> hits(numHits), sortedHits(numHits);
+    CUDA_CHECK(Memcpy(hitFlags.data(),wfHitFlags.d_ptr,
+                      numRays*sizeof(int),cudaMemcpyDeviceToHost));
+    CUDA_CHECK(Memcpy(hits.data(),wfHits.d_ptr,
+                      numHits*sizeof(WavefrontHit),cudaMemcpyDeviceToHost));
+    CUDA_CHECK(Memcpy(sortedHits.data(),wfSortedHits.d_ptr,
+                      numHits*sizeof(WavefrontHit),cudaMemcpyDeviceToHost));
+
+    bool ok = true;
     
-    // sync - make sure the frame is rendered before we download and
-    // display (obviously, for a high-performance application you
-    // want to use streams and double-buffering, but for this simple
-    // example, this will have to do)
+    // compaction: the hit queue must contain exactly the active rays
+    const std::vector<int> active = compactQueue(hitFlags);
+    if ((int)active.size() != numHits) {
+      std::cout << "#osc: wavefront: " << numHits << " queued hits, but "
+                << active.size() << " rays report a hit" << std::endl;
+      ok = false;
+    }
+
+    // sort: the device order within one material is arbitrary, so
+    // compare the sequence of material IDs after the reference sort
+    const int numMaterials = (int)sceneTables.materials.size();
+    std::vector<int> keys(numHits), sortedKeys(numHits);
+    for (int i=0;i<numHits;i++) {
+      keys[i]       = sceneTables.meshMaterialIDs[hits[i].meshID];
+      sortedKeys[i] = sceneTables.meshMaterialIDs[sortedHits[i].meshID];
+    }
+    const std::vector<int> permutation = sortByMaterial(keys,numMaterials);
+    int numMismatches = 0;
+    for (int i=0;i<numHits;i++)
+      if (keys[permutation[i]] != sortedKeys[i]) numMismatches++;
+    if (numMismatches > 0) {
+      std::cout << "#osc: wavefront: " << numMismatches
+                << " sorted hits are in the wrong material bucket" << std::endl;
+      ok = false;
+    }
+
+    if (counters[WF_NUM_SHADOW_RAYS] > numHits*NUM_LIGHT_SAMPLES) {
+      std::cout << "#osc: wavefront: shadow queue overflowed" << std::endl;
+      ok = false;
+    }
+
+    std::cout << "#osc: wavefront: " << numRays << " rays in the last batch, "
+              << numHits << " hits in " << numMaterials << " materials, "
+              << counters[WF_NUM_SHADOW_RAYS] << " shadow rays - "
+              << (ok ? "queues match the CPU reference" : "MISMATCH") << std::endl;
+    return ok;
+  }
+
+  /*! time the path tracing launch alone, iterative vs recursive */
+  void SampleRenderer::benchmarkPathTracing(int numFrames)
+  {
+    const vec2i size = launchParams.frame.size;
+    if (size.x == 0) return;
+
+    const int    wasRecursive = launchParams.path.recursive;
+    const double numPaths
+      = double(size.x)*size.y*launchParams.numPixelSamples*numFrames;
+    std::cout << "#osc: path tracing throughput at " << size.x << "x" << size.y
+              << ", " << launchParams.numPixelSamples << " spp, max depth "
+              << launchParams.path.maxDepth << ":" << std::endl;
+    for (int recursive=0;recursive<2;recursive++) {
+      launchParams.path.recursive = recursive;
+      uploadLaunchParams(launchParams);
+      // warm-up
+      launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+      CUDA_SYNC_CHECK();
+      
+      const double t0 = getCurrentTime();
+      for (int frameID=0;frameID<numFrames;frameID++)
+        launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+      CUDA_SYNC_CHECK();
+      const double t1 = getCurrentTime();
+      
+      std::cout << "  " << (recursive ? "recursive" : "iterative") << ": "
+                << prettyDouble(1000.*(t1-t0)/numFrames) << "ms/frame, "
+                << prettyDouble(numPaths/(t1-t0)) << " paths/s, "
+                << (recursive ? recursivePipelineStackSize : pipelineStackSize)
+                << " bytes continuation stack" << std::endl;
+    }
+    launchParams.path.recursive = wasRecursive;
+    // the benchmark frames all used the same frame ID, so start over
+    launchParams.frame.frameID = 0;
+  }
+
+  /*! time the megakernel launch alone, with the dynamic vs the
+      specialized closest-hit programs */
+  void SampleRenderer::benchmarkHitPrograms(int numFrames)
+  {
+    const vec2i size = launchParams.frame.size;
+    if (size.x == 0) return;
+
+    const bool   wasSpecialized = specializedHitPrograms;
+    const double numPaths
+      = double(size.x)*size.y*launchParams.numPixelSamples*numFrames;
+    std::cout << "#osc: closest-hit program throughput at " << size.x << "x" << size.y
+              << ", " << launchParams.numPixelSamples << " spp, max depth "
+              << launchParams.path.maxDepth << ":" << std::endl;
+    uploadLaunchParams(launchParams);
+    for (int specialized=0;specialized<2;specialized++) {
+      setSpecializedHitPrograms(specialized);
+      // warm-up
+      launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+      CUDA_SYNC_CHECK();
+
+      const double t0 = getCurrentTime();
+      for (int frameID=0;frameID<numFrames;frameID++)
+        launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+      CUDA_SYNC_CHECK();
+      const double t1 = getCurrentTime();
+      hitProgramFrameTime[specialized] = (t1-t0)/numFrames;
+
+      std::cout << "  " << (specialized ? "specialized" : "dynamic    ") << ": "
+                << prettyDouble(1000.*(t1-t0)/numFrames) << "ms/frame, "
+                << prettyDouble(numPaths/(t1-t0)) << " paths/s" << std::endl;
+    }
+    std::cout << "  specialized programs take "
+              << int(100.*hitProgramFrameTime[1]/hitProgramFrameTime[0]+.5)
+              << "% of the dynamic one's time" << std::endl;
+    setSpecializedHitPrograms(wasSpecialized);
+    // the benchmark frames all used the same frame ID, so start over
+    launchParams.frame.frameID = 0;
+  }
+
+  /*! relative RMS difference of the current color buffer to 'reference' */
+  static double relativeError(CUDABuffer &fbColor, const std::vector<vec4f> &reference)
+  {
+    std::vector<vec4f> current(reference.size());
+    fbColor.download(current.data(),current.size());
+    double sumDiff2 = 0., sumRef2 = 0.;
+    for (size_t i=0;i<reference.size();i++) {
+      const vec3f diff = vec3f(current[i]) - vec3f(reference[i]);
+      sumDiff2 += dot(diff,diff);
+      sumRef2  += dot(vec3f(reference[i]),vec3f(reference[i]));
+    }
+    return sumRef2 > 0. ? sqrt(sumDiff2/sumRef2) : 0.;
+  }
+
+  /*! accumulate frames with and without mis until the image is within
+      'targetError' (relative RMS) of a long-run reference, and print
+      how long each took */
+  void SampleRenderer::measureTimeToError(float targetError,
+                                          int referenceFrames,
+                                          int maxFrames)
+  {
+    const vec2i size = launchParams.frame.size;
+    if (size.x == 0) return;
+    const int wasMIS = launchParams.misEnabled;
+
+    // the reference: both estimators converge to the same image, so
+    // which one renders it doesn't matter
+    std::cout << "#osc: rendering " << referenceFrames
+              << "-frame reference ..." << std::endl;
+    launchParams.misEnabled = 1;
+    for (launchParams.frame.frameID=0;
+         launchParams.frame.frameID<referenceFrames;
+         launchParams.frame.frameID++) {
+      launchParams.frame.firstSampleIndex
+        = launchParams.frame.frameID*launchParams.numPixelSamples;
+      uploadLaunchParams(launchParams);
+      launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+    }
     CUDA_SYNC_CHECK();
+    std::vector<vec4f> reference(size.x*size.y);
+    fbColor.download(reference.data(),reference.size());
+
+    for (int mis=0;mis<2;mis++) {
+      launchParams.misEnabled = mis;
+      double renderTime = 0.;
+      double error = 1.;
+      launchParams.frame.frameID = 0;
+      while (launchParams.frame.frameID < maxFrames && error > targetError) {
+        const double t0 = getCurrentTime();
+        launchParams.frame.firstSampleIndex
+          = launchParams.frame.frameID*launchParams.numPixelSamples;
+        uploadLaunchParams(launchParams);
+        launchRaygen(RAYGEN_RENDER_FRAME,size.x,size.y);
+        CUDA_SYNC_CHECK();
+        renderTime += getCurrentTime()-t0;
+        launchParams.frame.frameID++;
+        // (error checks don't count towards the time)
+        error = relativeError(fbColor,reference);
+      }
+      std::cout << "  " << (mis ? "mis       " : "light only") << ": "
+                << (error <= targetError ? "reached " : "did NOT reach ")
+                << targetError << " error after "
+                << launchParams.frame.frameID << " frames, "
+                << prettyDouble(renderTime) << "s" << std::endl;
+    }
+    launchParams.misEnabled    = wasMIS;
+    launchParams.frame.frameID = 0;
+  }
+
+  /*! switch between the per-material specialized closest-hit
+      programs and the general one that branches at runtime */
+  void SampleRenderer::setSpecializedHitPrograms(bool enable)
+  {
+    if (enable == specializedHitPrograms) return;
+    specializedHitPrograms = enable;
+    // make sure no launch still reads the old records
+    CUDA_SYNC_CHECK();
+    buildHitgroupRecords();
   }
 
   /*! set camera to render with */
   void SampleRenderer::setCamera(const Camera &camera)
   {
+    // remember the camera the accumulated image was rendered with,
+    // unless some earlier move since the last frame already did
+    if (temporalReprojection && launchParams.frame.frameID > 0
+        && !reprojectionPending) {
+      reprojectionCamera  = launchParams.camera;
+      reprojectionPending = true;
+    }
     lastSetCamera = camera;
-    // reset accumulation
+    cameraMoved   = true;
+    // reset accumulation (render() reprojects what it can)
     launchParams.frame.frameID = 0;
     launchParams.camera.position  = camera.from;
     launchParams.camera.direction = normalize(camera.at-camera.from);
     const float cosFovy = 0.66f;
+    // (the render size only ever scales the display size, so the
+    // display's aspect is the one that counts)
     const float aspect
-      = float(launchParams.frame.size.x)
-      / float(launchParams.frame.size.y);
+      = float(displaySize.x)
+      / float(displaySize.y);
     launchParams.camera.horizontal
       = cosFovy * aspect * normalize(cross(launchParams.camera.direction,
                                            camera.up));
@@ -779,72 +1842,231 @@ namespace opz {
   /*! resize frame buffer to given resolution */
   void SampleRenderer::resize(const vec2i &newSize)
   {
-    if (denoiser) {
-      OPTIX_CHECK(optixDenoiserDestroy(denoiser));
-    };
-
-
+    // frames still in flight use the buffers we're about to replace
+    CUDA_CHECK(StreamSynchronize(stream));
+    collectFrames();
+    
     // ------------------------------------------------------------------
-    // create the denoiser:
-    OptixDenoiserOptions denoiserOptions = {};
+    // create the denoiser - once per model; nothing about it depends
+    // on the size
+    if (denoiser && createdDenoiserModel != denoiserModel) {
+      OPTIX_CHECK(optixDenoiserDestroy(denoiser));
+      denoiser = nullptr;
+    }
+    if (!denoiser) {
+#if OPTIX_VERSION < 70300
+      if (denoiserModel == DENOISER_MODEL_TEMPORAL) {
+        std::cout << "#osc: no temporal denoiser before optix 7.3, using HDR" << std::endl;
+        denoiserModel = DENOISER_MODEL_HDR;
+      }
+#endif
+      const OptixDenoiserModelKind modelKind
+        = denoiserModel == DENOISER_MODEL_LDR
+        ? OPTIX_DENOISER_MODEL_KIND_LDR
+#if OPTIX_VERSION >= 70300
+        : denoiserModel == DENOISER_MODEL_TEMPORAL
+        ? OPTIX_DENOISER_MODEL_KIND_TEMPORAL
+#endif
+        : OPTIX_DENOISER_MODEL_KIND_HDR;
+      createdDenoiserModel = denoiserModel;
+      OptixDenoiserOptions denoiserOptions = {};
 #if OPTIX_VERSION >= 70300
-    OPTIX_CHECK(optixDenoiserCreate(optixContext,OPTIX_DENOISER_MODEL_KIND_LDR,&denoiserOptions,&denoiser));
+      OPTIX_CHECK(optixDenoiserCreate(optixContext,modelKind,&denoiserOptions,&denoiser));
 #else
-    denoiserOptions.inputKind = OPTIX_DENOISER_INPUT_RGB_ALBEDO;
+      denoiserOptions.inputKind = OPTIX_DENOISER_INPUT_RGB_ALBEDO;
 #if OPTIX_VERSION < 70100
-    // these only exist in 7.0, not 7.1
-    denoiserOptions.pixelFormat = OPTIX_PIXEL_FORMAT_FLOAT4;
+      // these only exist in 7.0, not 7.1
+      denoiserOptions.pixelFormat = OPTIX_PIXEL_FORMAT_FLOAT4;
 #endif
 
-    OPTIX_CHECK(optixDenoiserCreate(optixContext,&denoiserOptions,&denoiser));
-    OPTIX_CHECK(optixDenoiserSetModel(denoiser,OPTIX_DENOISER_MODEL_KIND_LDR,NULL,0));
+      OPTIX_CHECK(optixDenoiserCreate(optixContext,&denoiserOptions,&denoiser));
+      OPTIX_CHECK(optixDenoiserSetModel(denoiser,modelKind,NULL,0));
 #endif
-
-    // .. then compute and allocate memory resources for the denoiser
+      denoiserIntensity.reserve(sizeof(float));
+    }
+    // (whatever got denoised before is of no use to the new size - or
+    // the new denoiser)
+    haveDenoised = false;
+    denoiserScheduler.invalidate();
+
+    // .. then compute and allocate memory resources for the denoiser:
+    // for the whole frame if it fits in one tile, else for one tile
+    // plus its overlap - which is all the denoiser ever sees at once
+    // (7.0 doesn't report the overlap it'd need, so there we don't tile)
+    vec2i denoiserSetupSize = newSize;
+    denoiserOverlap = 0;
     OptixDenoiserSizes denoiserReturnSizes;
+#if OPTIX_VERSION < 70100
+    denoiserTiled = false;
     OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,newSize.x,newSize.y,
                                                     &denoiserReturnSizes));
-
-#if OPTIX_VERSION < 70100
-    denoiserScratch.resize(denoiserReturnSizes.recommendedScratchSizeInBytes);
+    denoiserScratchSize = denoiserReturnSizes.recommendedScratchSizeInBytes;
 #else
-    denoiserScratch.resize(std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
-                                    denoiserReturnSizes.withoutOverlapScratchSizeInBytes));
+    denoiserTiled = denoiserTileSize > 0
+      && (newSize.x > denoiserTileSize || newSize.y > denoiserTileSize);
+    if (denoiserTiled) {
+      OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,
+                                                      denoiserTileSize,denoiserTileSize,
+                                                      &denoiserReturnSizes));
+      denoiserOverlap   = denoiserReturnSizes.overlapWindowSizeInPixels;
+      denoiserSetupSize = min(newSize,vec2i(denoiserTileSize+2*denoiserOverlap));
+      // the intensity is computed over at most that much of the
+      // frame, too, and needs an int of scratch per pixel
+      denoiserScratchSize
+        = std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
+                   sizeof(int)*(2+size_t(denoiserSetupSize.x)*denoiserSetupSize.y));
+    } else {
+      OPTIX_CHECK(optixDenoiserComputeMemoryResources(denoiser,newSize.x,newSize.y,
+                                                      &denoiserReturnSizes));
+      denoiserScratchSize = std::max(denoiserReturnSizes.withOverlapScratchSizeInBytes,
+                                     denoiserReturnSizes.withoutOverlapScratchSizeInBytes);
+    }
 #endif
-    denoiserState.resize(denoiserReturnSizes.stateSizeInBytes);
+    denoiserStateSize = denoiserReturnSizes.stateSizeInBytes;
+    denoiserScratch.reserve(denoiserScratchSize);
+    denoiserState.reserve(denoiserStateSize);
+    // (re-planned on the next frame, for whatever size it renders at)
+    denoiserTilesFor = vec2i(0);
     
     // ------------------------------------------------------------------
-    // resize our cuda frame buffer
-    denoisedBuffer.resize(newSize.x*newSize.y*sizeof(float4));
-    fbColor.resize(newSize.x*newSize.y*sizeof(float4));
-    fbNormal.resize(newSize.x*newSize.y*sizeof(float4));
-    fbAlbedo.resize(newSize.x*newSize.y*sizeof(float4));
-    finalColorBuffer.resize(newSize.x*newSize.y*sizeof(uint32_t));
+    // resize our cuda frame buffers - which only ever grow: all of
+    // them are used densely packed at whatever the current size is,
+    // so dragging the window's border around allocates only while
+    // it gets bigger than it ever was
+    const size_t numPixels = size_t(newSize.x)*newSize.y;
+    // (accumulated color always stays float)
+    createdAovPrecision = aovPrecision;
+    guideFormat    = aovPrecision == AOV_PRECISION_HALF ? PIXEL_HALF3 : PIXEL_FLOAT4;
+    denoisedFormat = aovPrecision == AOV_PRECISION_HALF ? PIXEL_HALF4 : PIXEL_FLOAT4;
+    denoisedBuffer.reserve(numPixels*pixelSize(denoisedFormat));
+    fbColor.reserve(numPixels*sizeof(float4));
+    fbNormal.reserve(numPixels*pixelSize(guideFormat));
+    fbAlbedo.reserve(numPixels*pixelSize(guideFormat));
+    fbPosition.reserve(numPixels*sizeof(float4));
+    fbHistory.reserve(numPixels*sizeof(float));
+    prevColor.reserve(numPixels*sizeof(float4));
+    prevNormal.reserve(numPixels*pixelSize(guideFormat));
+    prevPosition.reserve(numPixels*sizeof(float4));
+    prevHistory.reserve(numPixels*sizeof(float));
+    adaptiveStats.reserve(numPixels*sizeof(float4));
+    adaptiveActiveCounter.reserve(sizeof(int));
+    if (createdDenoiserModel == DENOISER_MODEL_TEMPORAL) {
+      motionBuffer.reserve(numPixels*sizeof(float2));
+      prevDenoised.reserve(numPixels*pixelSize(denoisedFormat));
+    }
+    for (auto &slot : frameSlots) {
+      slot.finalColorBuffer.reserve(numPixels*sizeof(uint32_t));
+      if (slot.hostPixelCapacity < numPixels) {
+        if (slot.hostPixels) CUDA_CHECK(FreeHost(slot.hostPixels));
+        CUDA_CHECK(MallocHost((void**)&slot.hostPixels,numPixels*sizeof(uint32_t)));
+        slot.hostPixelCapacity = numPixels;
+      }
+      slot.ready = false;
+    }
     
     // update the launch parameters that we'll pass to the optix
     // launch:
+    displaySize                      = newSize;
     launchParams.frame.size          = newSize;
     launchParams.frame.colorBuffer   = (float4*)fbColor.d_pointer();
-    launchParams.frame.normalBuffer  = (float4*)fbNormal.d_pointer();
-    launchParams.frame.albedoBuffer  = (float4*)fbAlbedo.d_pointer();
-
-    // and re-set the camera, since aspect may have changed
+    launchParams.frame.normalBuffer  = PixelBuffer{ (void*)fbNormal.d_pointer(),guideFormat };
+    launchParams.frame.albedoBuffer  = PixelBuffer{ (void*)fbAlbedo.d_pointer(),guideFormat };
+    launchParams.frame.positionBuffer = (float4*)fbPosition.d_pointer();
+    launchParams.frame.historyBuffer  = (float*)fbHistory.d_pointer();
+    launchParams.frame.motionBuffer
+      = createdDenoiserModel == DENOISER_MODEL_TEMPORAL
+      ? (float2*)motionBuffer.d_pointer() : nullptr;
+    launchParams.adaptive.statsBuffer  = (float4*)adaptiveStats.d_pointer();
+    launchParams.adaptive.activePixels = (int*)adaptiveActiveCounter.d_pointer();
+
+    // and re-set the camera, since aspect may have changed; the old
+    // frame is gone, so there's nothing to reproject
     setCamera(lastSetCamera);
+    reprojectionPending = false;
 
     // ------------------------------------------------------------------
     OPTIX_CHECK(optixDenoiserSetup(denoiser,0,
-                                   newSize.x,newSize.y,
+                                   denoiserSetupSize.x,denoiserSetupSize.y,
                                    denoiserState.d_pointer(),
-                                   denoiserState.size(),
+                                   denoiserStateSize,
                                    denoiserScratch.d_pointer(),
-                                   denoiserScratch.size()));
+                                   denoiserScratchSize));
   }
   
-  /*! download the rendered color buffer */
+  /*! the newest frame of the current size that's done - waiting
+      for the oldest one in flight only if none is */
+  const SampleRenderer::FrameSlot *SampleRenderer::newestFrame(bool wait)
+  {
+    collectFrames();
+    while (true) {
+      const FrameSlot *newest = nullptr;
+      const FrameSlot *oldestPending = nullptr;
+      for (auto &slot : frameSlots) {
+        if (slot.ready && slot.size == displaySize
+            && (!newest || slot.frameNumber > newest->frameNumber))
+          newest = &slot;
+        if (slot.pending
+            && (!oldestPending || slot.frameNumber < oldestPending->frameNumber))
+          oldestPending = &slot;
+      }
+      if (newest || !oldestPending || !wait) return newest;
+      collectFrames(oldestPending);
+    }
+  }
+
+  /*! copy out the newest frame that's done */
   void SampleRenderer::downloadPixels(uint32_t h_pixels[])
   {
-    finalColorBuffer.download(h_pixels,
-                              launchParams.frame.size.x*launchParams.frame.size.y);
+    // (frames rendered into display buffers never come to the host)
+    if (hasDisplayBuffers()) return;
+    if (const FrameSlot *newest = newestFrame())
+      memcpy(h_pixels,newest->hostPixels,
+             displaySize.x*displaySize.y*sizeof(uint32_t));
+  }
+
+  /*! wait for all frames in flight */
+  void SampleRenderer::finishFrames()
+  {
+    CUDA_CHECK(StreamSynchronize(stream));
+    collectFrames();
+  }
+
+  /*! where the current frame's linear color is: the accumulated
+      color, or the denoiser's output (which may be half precision) */
+  PixelBuffer SampleRenderer::linearColor() const
+  {
+    if (!denoiserOn)
+      return PixelBuffer{ (void*)fbColor.d_pointer(),PIXEL_FLOAT4 };
+    return PixelBuffer{ (void*)denoisedBuffer.d_pointer(),denoisedFormat };
+  }
+
+  /*! download the last frame's linear color, from wherever the tone
+      map read it */
+  void SampleRenderer::downloadColor(vec4f h_pixels[])
+  {
+    const size_t numPixels = size_t(launchParams.frame.size.x)*launchParams.frame.size.y;
+    const PixelBuffer color = linearColor();
+    if (color.format == PIXEL_FLOAT4) {
+      CUDA_CHECK(MemcpyAsync(h_pixels,color.data,
+                             numPixels*sizeof(vec4f),cudaMemcpyDeviceToHost,stream));
+      CUDA_CHECK(StreamSynchronize(stream));
+      return;
+    }
+    std::vector<uint8_t> staging(numPixels*pixelSize(color.format));
+    CUDA_CHECK(MemcpyAsync(staging.data(),color.data,
+                           staging.size(),cudaMemcpyDeviceToHost,stream));
+    CUDA_CHECK(StreamSynchronize(stream));
+    const PixelBuffer pixels = { staging.data(),color.format };
+    for (size_t i=0;i<numPixels;i++)
+      h_pixels[i] = pixels.read(i);
+  }
+
+  /*! keep the newest frame that's done from getting rendered over */
+  int SampleRenderer::holdNewestFrame(bool wait)
+  {
+    const FrameSlot *newest = newestFrame(wait);
+    heldSlot = newest ? int(newest - frameSlots) : -1;
+    return heldSlot;
   }
   
 } // ::osc
@@ -21,6 +21,17 @@
 #include "CUDABuffer.h"
 #include "LaunchParams.h"
 #include "Model.h"
+#include "SceneTables.h"
+#include "ResolutionController.h"
+#include "SampleCountController.h"
+#include "TileScheduler.h"
+#include "DenoiserTiling.h"
+#include "DenoiserScheduler.h"
+#include "AtrousDenoiser.h"
+#include "ThreadPool.h"
+// std
+#include <functional>
+#include <memory>
 
 /*! \namespace opz - Optix ZYM-PKU */
 namespace opz {
@@ -33,7 +44,82 @@ namespace opz {
     /*! general up-vector */
     vec3f up;
   };
+
+  /*! how we compile the device programs at startup: number of host
+      threads driving the optix compile tasks, and where/how big the
+      optix disk cache of compiled modules is */
+  struct CompileConfig {
+    /*! number of compile threads; 0 means one per hardware thread */
+    int         numThreads    { 0 };
+    bool        cacheEnabled  { true };
+    /*! cache directory; empty means optix' default location */
+    std::string cacheLocation;
+    /*! cache size limit in bytes; 0 keeps optix' default limits */
+    size_t      cacheSizeInBytes { 0 };
+  };
+
+  /*! wall-clock time spent in each startup stage, in seconds, plus the
+      number of disk cache hits/misses optix reported while compiling.
+      those come from its log text, so they are best-effort: zero for
+      both just means none got logged */
+  struct StartupReport {
+    double contextTime  { 0. };
+    double moduleTime   { 0. };
+    double programsTime { 0. };
+    double pipelineTime { 0. };
+    double accelTime    { 0. };
+    double texturesTime { 0. };
+    int    cacheHits    { 0 };
+    int    cacheMisses  { 0 };
+    int    compileThreads { 1 };
+  };
   
+  /*! closest-hit variants for radiance rays: one per material feature
+      set (shading normals and/or diffuse texture), each compiled with
+      only the code it needs, indexed by those feature bits */
+  enum { RADIANCE_HIT_NORMALS=1, RADIANCE_HIT_TEXTURE=2, RADIANCE_HIT_VARIANT_COUNT=4 };
+
+  /*! raygen programs, in the order of their SBT records: the
+      megakernel, and the four stages of the wavefront renderer */
+  enum { RAYGEN_RENDER_FRAME=0,
+         RAYGEN_WF_GENERATE, RAYGEN_WF_EXTEND, RAYGEN_WF_SHADE, RAYGEN_WF_CONNECT,
+         RAYGEN_COUNT };
+
+  /*! most frames render() keeps in flight, and how many launch
+      parameter uploads can be queued up (on the pinned ring) at once */
+  enum { MAX_FRAMES_IN_FLIGHT=3, LAUNCH_PARAMS_RING_SIZE=16 };
+
+  /*! the optix denoiser models we can run */
+  typedef enum {
+    /*! expects tone-mapped input - which ours isn't */
+    DENOISER_MODEL_LDR=0,
+    /*! takes the linear accumulation we have */
+    DENOISER_MODEL_HDR,
+    /*! HDR, plus it warps its previous output along the motion
+        vectors raygen writes, so noise doesn't crawl across the
+        image while the camera moves (optix 7.3 and up) */
+    DENOISER_MODEL_TEMPORAL,
+    DENOISER_MODEL_COUNT
+  } DenoiserModel;
+
+  /*! what the frame buffers that don't accumulate - the denoiser's
+      guides and its output - are stored as: float4, or half3 guides
+      (their alpha is always 1) and half4 output, which takes the
+      bytes per pixel of all four frame buffers from 64 to 36 */
+  typedef enum {
+    AOV_PRECISION_FLOAT=0,
+    AOV_PRECISION_HALF
+  } AovPrecision;
+
+  /*! where render() denoises: with the optix denoiser, or - where
+      there is none, or to compare - with the a-trous filter on the
+      host (see AtrousDenoiser.h) */
+  typedef enum {
+    DENOISER_BACKEND_OPTIX=0,
+    DENOISER_BACKEND_CPU,
+    DENOISER_BACKEND_COUNT
+  } DenoiserBackend;
+
   /*! a sample OptiX-7 renderer that demonstrates how to set up
       context, module, programs, pipeline, SBT, etc, and perform a
       valid launch that renders some pixel (using a simple test
@@ -46,10 +132,14 @@ namespace opz {
   public:
     /*! constructor - performs all setup, including initializing
       optix, creates module, pipeline, programs, SBT, etc. */
-    SampleRenderer(const Model *model, const QuadLight &light);
+    SampleRenderer(const Model *model,
+                   const std::vector<QuadLight> &quadLights,
+                   const CompileConfig &compileConfig = CompileConfig());
 
-    /*! render one frame */
-    void render();
+    /*! queue up one frame on the stream; doesn't wait for it (nor
+        for earlier ones) unless framesInFlight are pending already.
+        frames that won't be 'present'ed don't get denoised */
+    void render(bool present = true);
 
     /*! resize frame buffer to given resolution */
     void resize(const vec2i &newSize);
@@ -57,12 +147,171 @@ namespace opz {
     /*! download the rendered color buffer */
     void downloadPixels(uint32_t h_pixels[]);
 
+    /*! wait for all frames in flight, so downloads get the last one */
+    void finishFrames();
+
+    /*! if set, gets the display pixels (rgba8, bottom row first) of
+        every presented frame once it's done and downloaded - called
+        from whichever of the above takes it in, without waiting for
+        anything more. the pixels are only valid during the call.
+        frames rendered into display buffers never come by here */
+    std::function<void(const uint32_t *pixels, const vec2i &size)> onFrameDone;
+
+    /*! if set, presented frames also bring their linear color -
+        denoised, if the denoiser is on - down to pinned memory, along
+        with the display pixels, and hand it here the same way: no
+        waiting for it, and only valid during the call */
+    std::function<void(const PixelBuffer &color, const vec2i &size)> onLinearFrameDone;
+
+    /*! download the last frame's linear color - denoised, if the
+        denoiser is on - at the size it got rendered at */
+    void downloadColor(vec4f h_pixels[]);
+
+    /*! how many frames render() may queue up before it waits for
+        the oldest one (1 to MAX_FRAMES_IN_FLIGHT); downloadPixels()
+        shows the newest one that's done, so with more than one, the
+        gpu renders the next frame while the last one is on screen */
+    int framesInFlight = 2;
+
+    /*! have each frame slot tone map straight into a buffer the
+        display owns - eg, a gl pixel buffer registered with cuda -
+        instead of one of our own, and stop downloading frames. takes
+        MAX_FRAMES_IN_FLIGHT resources of at least the display size
+        (in rgba8); nullptr goes back to downloadPixels() */
+    void setDisplayBuffers(const cudaGraphicsResource_t *resources);
+    bool hasDisplayBuffers() const { return frameSlots[0].displayResource != nullptr; }
+
+    /*! @{ keep the newest frame that's done from getting rendered
+        over until releaseFrame(), for the display to show it - from
+        the display buffer of that index, or hostFramePixels(). only
+        waits for one to get done if 'wait'; -1 if there's none */
+    int  holdNewestFrame(bool wait = true);
+    void releaseFrame() { heldSlot = -1; }
+    const uint32_t *hostFramePixels(int slot) const { return frameSlots[slot].hostPixels; }
+    /*! @} */
+
     /*! set camera to render with */
     void setCamera(const Camera &camera);
 
+    /*! switch between the per-material specialized closest-hit
+        programs and the general one that branches at runtime */
+    void setSpecializedHitPrograms(bool enable);
+    bool specializedHitPrograms = true;
+
+    /*! render numFrames frames each with the dynamic and with the
+        specialized closest-hit programs, print their throughput, and
+        keep their frame times in hitProgramFrameTime */
+    void benchmarkHitPrograms(int numFrames = 16);
+    /*! seconds per frame the last benchmarkHitPrograms() measured,
+        indexed by specializedHitPrograms; zero until it ran */
+    double hitProgramFrameTime[2] { 0., 0. };
+
+    /*! render through separate generate/extend/shade/connect launches
+        over material-sorted queues, instead of the megakernel. there
+        is no bounce stage, so this always renders what the megakernel
+        does at path.maxDepth 1 with misEnabled off: emission, direct
+        light by light sampling, and the ambient term; path.maxDepth,
+        path.recursive and misEnabled are ignored while it is on */
+    bool wavefront = false;
+
+    /*! most camera rays the wavefront queues hold at once - each
+        takes about 300 bytes of queues, with its hits and shadow
+        rays. frames with more pixels times samples get rendered in
+        batches of whole pixels that fit */
+    int wavefrontBatchRays = 1<<20;
+
+    /*! @{ path depth and mis as the current renderer actually uses
+        them (see 'wavefront') */
+    inline int  renderedMaxDepth() const
+    { return wavefront ? 1 : launchParams.path.maxDepth; }
+    inline bool renderedMIS() const
+    { return !wavefront && launchParams.misEnabled; }
+    /*! @} */
+
+    /*! render one wavefront frame, and check its queues (ie, its last
+        batch) against the CPU reference compaction and sort; returns
+        true if they match */
+    bool validateWavefront();
+
+    /*! render numFrames frames each with the iterative and the
+        recursive path tracer, and print their throughput */
+    void benchmarkPathTracing(int numFrames = 16);
+
+    /*! accumulate frames with and without mis until they are within
+        targetError (relative RMS) of a referenceFrames-frame reference,
+        and print the time each one took */
+    void measureTimeToError(float targetError = .05f,
+                            int referenceFrames = 1024,
+                            int maxFrames = 1024);
+
     
     bool denoiserOn = true;
+    /*! frames bigger than this in either dimension get denoised in
+        tiles of denoiserTileSize^2 pixels (plus overlap), so denoiser
+        memory stays bounded however large the framebuffer; takes
+        effect on the next resize() */
+    int  denoiserTileSize = 1024;
+    /*! one of DENOISER_MODEL_*; a change re-creates the denoiser on
+        the next frame */
+    int  denoiserModel = DENOISER_MODEL_HDR;
+    /*! one of AOV_PRECISION_*; a change re-allocates the frame
+        buffers on the next frame */
+    int  aovPrecision = AOV_PRECISION_HALF;
+    /*! one of DENOISER_BACKEND_* */
+    int  denoiserBackend = DENOISER_BACKEND_OPTIX;
+    /*! the host backend, and its settings */
+    AtrousDenoiser cpuDenoiser;
+    /*! which frames get denoised (see DenoiserScheduler.h) */
+    DenoiserScheduler denoiserScheduler;
+    /*! whether the last frame got denoised, or reused the last
+        denoised image */
+    bool denoisedLastFrame = false;
+    /*! how the current frame gets split for the denoiser - a single
+        tile unless it's bigger than denoiserTileSize */
+    inline int numDenoiserTiles() const { return (int)denoiserTiles.size(); }
     bool accumulate = true;
+
+    /*! on camera moves, carry over the accumulated image by
+        reprojecting it into the new view, instead of starting over
+        (megakernel without adaptive sampling only) */
+    bool temporalReprojection = true;
+    /*! most frames of history a pixel may carry over a camera move */
+    int  maxHistoryFrames = 16;
+
+    /*! render at a lower resolution while the camera moves, as picked
+        by resolutionController to hold its target frame time, and
+        upscale to the display */
+    bool dynamicResolution = true;
+    ResolutionController resolutionController;
+
+    /*! let sampleController pick numPixelSamples - and how many
+        launches to accumulate per displayed frame - from measured
+        launch times, to fill its frame budget */
+    bool autoSampleCount = true;
+    SampleCountController sampleController;
+
+    /*! render in tiles, as many per displayed frame as fit into
+        tileScheduler's time slice, so one frame never blocks the gpu
+        (and the ui) for long (megakernel only; keeps numPixelSamples
+        as it is, instead of asking sampleController) */
+    bool tiledLaunches = false;
+    TileScheduler tileScheduler;
+
+    /*! show how many samples each pixel took (adaptive mode) instead
+        of the image */
+    bool showSampleHeatmap = false;
+    /*! adaptive mode stops rendering once no more than this fraction
+        of pixels still takes samples */
+    float adaptiveStopFraction = 1e-3f;
+    /*! pixels that took samples in the last adaptive frame, or -1 */
+    int adaptiveActivePixels = -1;
+
+    /*! global stop criterion of adaptive sampling: true once (nearly)
+        every pixel has converged, and render() only redisplays */
+    bool adaptiveConverged() const;
+
+    /*! timings and cache statistics of the constructor's setup */
+    StartupReport startupReport;
   protected:
 
 
@@ -72,6 +321,20 @@ namespace opz {
 
     /*! runs a cuda kernel that performs gamma correction and float4-to-rgba conversion */
     void computeFinalPixelColors();
+
+    /*! runs a cuda kernel that color-codes each pixel's sample count
+        (relative to uniform sampling) into the final color buffer */
+    void computeSampleHeatmap();
+
+    /*! fills the final color buffer, with either of the above */
+    void computeDisplayPixels();
+
+    /*! denoises the current frame on the host, into denoisedBuffer */
+    void denoiseOnCPU();
+
+    /*! runs a cuda kernel that blends the first frame after a camera
+        move with the previous frame's history, reprojected */
+    void reprojectHistory();
     
     /*! helper function that initializes optix and checks for errors */
     void initOptix();
@@ -82,8 +345,12 @@ namespace opz {
 
     /*! creates the module that contains all the programs we are going
       to use. in this simple example, we use a single module from a
-      single .cu file, using a single embedded ptx string */
+      single .cu file, using a single embedded ptx string, compiled
+      with optix' task api on a pool of host threads */
     void createModule();
+
+    /*! print the startup timings gathered in the constructor */
+    void printStartupReport() const;
     
     /*! does all setup for the raygen program(s) we are going to use */
     void createRaygenPrograms();
@@ -97,15 +364,67 @@ namespace opz {
     /*! assembles the full pipeline of all programs */
     void createPipeline();
 
+    /*! links the programs into a pipeline for the given trace depth,
+        and returns the continuation stack size it got */
+    OptixPipeline linkPipeline(const std::vector<OptixProgramGroup> &programGroups,
+                               int maxTraceDepth,
+                               unsigned int &continuationStackSize);
+
     /*! constructs the shader binding table */
     void buildSBT();
 
+    /*! (re-)builds the hitgroup part of the SBT, picking one radiance
+        closest-hit variant per mesh */
+    void buildHitgroupRecords();
+
+    /*! packs and uploads the mesh and material tables the hit
+        programs index into */
+    void buildSceneTables();
+
+    /*! collects quad and emissive-mesh lights, and uploads them with
+        their alias table */
+    void buildLights();
+
     /*! build an acceleration structure for the given triangle mesh */
     OptixTraversableHandle buildAccel();
 
     /*! upload textures, and create cuda texture objects for them */
     void createTextures();
 
+    /*! launch a single raygen program (one of RAYGEN_*) */
+    void launchRaygen(int raygenID, int width, int height);
+
+    /*! the wavefront version of the optix launch in render() */
+    void renderWavefront();
+
+    /*! how many pixels of the current frame size and sample count
+        one wavefront batch takes (see wavefrontBatchRays) */
+    int wavefrontBatchPixels() const;
+
+    /*! (re-)allocates the wavefront queues if the frame buffer or
+        the batch grew */
+    void resizeWavefrontQueues(int numRays);
+
+    /*! runs cuda kernels that reorder the hit queue by material */
+    void sortHitsByMaterial(int numRays);
+
+    /*! runs a cuda kernel that averages the wavefront per-pixel sums
+        into the color, normal and albedo buffers */
+    void resolveWavefrontFrame();
+
+    /*! the tiled version of render()'s launch: renders tiles of the
+        current pass until tileScheduler says the frame's time is up,
+        starting a new pass first if there's none (or the accumulation
+        got reset since it started) */
+    void renderTiles(bool reproject);
+
+    /*! @{ frame ID the current tile pass renders as, whether it has to
+        reproject once it's done, and whether this frame completed it */
+    int  tilePassFrameID      = -1;
+    bool tileReprojectPending = false;
+    bool tilePassCompleted    = false;
+    /*! @} */
+
   protected:
     /*! @{ CUDA device context and stream that optix pipeline will run
         on, as well as device properties for this device */
@@ -121,6 +440,10 @@ namespace opz {
     OptixPipeline               pipeline;
     OptixPipelineCompileOptions pipelineCompileOptions = {};
     OptixPipelineLinkOptions    pipelineLinkOptions = {};
+    /*! same programs, linked for recursive path tracing */
+    OptixPipeline               recursivePipeline;
+    unsigned int                pipelineStackSize          = 0;
+    unsigned int                recursivePipelineStackSize = 0;
     /*! @} */
 
     /*! @{ the module that contains out device programs */
@@ -128,6 +451,8 @@ namespace opz {
     OptixModuleCompileOptions   moduleCompileOptions = {};
     /* @} */
 
+    CompileConfig compileConfig;
+
     /*! vector of all our program(group)s, and the SBT built around
         them */
     std::vector<OptixProgramGroup> raygenPGs;
@@ -135,6 +460,9 @@ namespace opz {
     std::vector<OptixProgramGroup> missPGs;
     CUDABuffer missRecordsBuffer;
     std::vector<OptixProgramGroup> hitgroupPGs;
+    /*! specialized radiance hitgroups, indexed by RADIANCE_HIT_* bits;
+        hitgroupPGs[RADIANCE_RAY_TYPE] is the general one */
+    std::vector<OptixProgramGroup> radianceVariantPGs;
     CUDABuffer hitgroupRecordsBuffer;
     OptixShaderBindingTable sbt = {};
 
@@ -144,29 +472,183 @@ namespace opz {
     LaunchParams launchParams;
   protected:
     CUDABuffer   launchParamsBuffer;
+    /*! pinned staging copies the uploads go through, each reusable
+        once its event says the copy has run */
+    LaunchParams *pinnedLaunchParams = nullptr;
+    cudaEvent_t   launchParamsCopied[LAUNCH_PARAMS_RING_SIZE];
+    int           nextLaunchParams = 0;
     /*! @} */
 
+    /*! stream-ordered upload of 'params' to launchParamsBuffer */
+    void uploadLaunchParams(const LaunchParams &params);
+
     /*! the color buffer we use during _rendering_, which is a bit
         larger than the actual displayed frame buffer (to account for
-        the border), and in float4 format (the denoiser requires
-        floats) */
+        the border), and in float4 format (it accumulates); normal
+        and albedo are in guideFormat */
     CUDABuffer fbColor;
     CUDABuffer fbNormal;
     CUDABuffer fbAlbedo;
     
-    /*! output of the denoiser pass, in float4 */
+    /*! output of the denoiser pass, in denoisedFormat */
     CUDABuffer denoisedBuffer;
     
-    /* the actual final color buffer used for display, in rgba8 */
-    CUDABuffer finalColorBuffer;
+    /*! one frame in flight: its display pixels (rgba8) on the device
+        and - once they're downloaded - in pinned host memory, the
+        events that time it and say it's done, and what it still has
+        to tell the controllers when it is */
+    struct FrameSlot {
+      CUDABuffer  finalColorBuffer;
+      /*! the display's buffer, if it gave us one, and where this
+          frame's pixels go - mapped from that, or finalColorBuffer */
+      cudaGraphicsResource_t displayResource = nullptr;
+      uint32_t   *displayPixels    = nullptr;
+      uint32_t   *hostPixels       = nullptr;
+      size_t      hostPixelCapacity = 0;
+      /*! @{ its linear color, if onLinearFrameDone wants it */
+      void       *hostLinear       = nullptr;
+      size_t      hostLinearCapacity = 0;
+      int         linearFormat     = PIXEL_FLOAT4;
+      vec2i       linearSize       { 0 };
+      bool        hasLinear        = false;
+      /*! @} */
+      int        *hostActivePixels = nullptr;
+      vec2i       size             { 0 };
+      cudaEvent_t start, launchStart, launchEnd, done;
+      long long   frameNumber      = -1;
+      /*! submitted but not collected yet, and collected - ie, its
+          pixels can be shown */
+      bool        pending          = false;
+      bool        ready            = false;
+      /*! render()ed with 'present' */
+      bool        presented        = false;
+      /*! @{ what collectFrames() does with it */
+      bool        countsActive     = false;
+      bool        feedsSamples     = false;
+      bool        feedsResolution  = false;
+      SamplePlan  plan             { 1,1 };
+      int         numPixels        = 0;
+      float       scale            = 1.f;
+      /*! @} */
+    };
+    FrameSlot frameSlots[MAX_FRAMES_IN_FLIGHT];
+    int       currentSlot        = 0;
+    /*! the slot the display holds on to, if any */
+    int       heldSlot           = -1;
+    long long numFramesSubmitted = 0;
+
+    /*! queue the current slot's downloads and its 'done' event */
+    void submitFrame(FrameSlot &slot);
+    /*! take in all frames that are done, oldest first; with 'until',
+        wait until that one is */
+    void collectFrames(const FrameSlot *until = nullptr);
+    /*! the newest frame of the current size that's done, waiting for
+        the oldest in flight only if none is (and 'wait') */
+    const FrameSlot *newestFrame(bool wait = true);
+    /*! point the slot's displayPixels at where it renders to */
+    void beginDisplayPixels(FrameSlot &slot);
+    /*! where the current frame's linear color is on the device -
+        what the tone map read */
+    PixelBuffer linearColor() const;
+
+    /*! device allocations made before this frame began - the render
+        loop's steady state should make none */
+    size_t allocsBeforeFrame = 0;
+  public:
+    /*! device allocations made by the last frame */
+    size_t allocsLastFrame = 0;
+  protected:
+
+    /*! @{ first-hit positions and per-pixel history lengths of the
+        current frame, and the previous frame's buffers (plus the
+        camera it was rendered with) to reproject from after a move */
+    CUDABuffer   fbPosition;
+    CUDABuffer   fbHistory;
+    CUDABuffer   prevColor;
+    CUDABuffer   prevNormal;
+    CUDABuffer   prevPosition;
+    CUDABuffer   prevHistory;
+    LaunchCamera reprojectionCamera;
+    vec2i        reprojectionSize { 0 };
+    bool         reprojectionPending = false;
+    /*! @} */
+
+    /*! @{ adaptive sampling statistics (see AdaptiveSampling.h), and
+        the counter of pixels that are still active */
+    CUDABuffer adaptiveStats;
+    CUDABuffer adaptiveActiveCounter;
+    /*! @} */
 
     OptixDenoiser denoiser = nullptr;
     CUDABuffer    denoiserScratch;
     CUDABuffer    denoiserState;
     CUDABuffer    denoiserIntensity;
+    /*! what the denoiser needs at the current size - its buffers may
+        be larger, from an earlier, larger size */
+    size_t        denoiserScratchSize = 0;
+    size_t        denoiserStateSize   = 0;
+    /*! @{ whether the denoiser got set up for tiles, with how many
+        pixels of overlap; and the tiles of the last frame size we
+        planned for (see DenoiserTiling.h) */
+    bool                      denoiserTiled   = false;
+    int                       denoiserOverlap = 0;
+    vec2i                     denoiserTilesFor { 0 };
+    std::vector<DenoiserTile> denoiserTiles;
+    /*! @} */
+    /*! @{ the aov precision the frame buffers got allocated with (-1
+        if none yet), and the PIXEL_* formats that means for guides
+        and denoised output */
+    int           createdAovPrecision = -1;
+    int           guideFormat         = PIXEL_FLOAT4;
+    int           denoisedFormat      = PIXEL_FLOAT4;
+    /*! @} */
+    /*! the model the denoiser got created with, -1 if none yet */
+    int           createdDenoiserModel = -1;
+    /*! @{ temporal model only: per-pixel motion since the last
+        denoised frame (written by raygen), and that frame's denoised
+        image, size and camera; haveDenoised is false until there's
+        one to warp - or after the frame stopped matching it */
+    CUDABuffer    motionBuffer;
+    CUDABuffer    prevDenoised;
+    vec2i         denoisedSize { 0 };
+    LaunchCamera  denoisedCamera;
+    bool          haveDenoised = false;
+    /*! @} */
+    /*! @{ the host backend's threads, and where it gets the frame
+        and its guides downloaded to (and denoises in place) */
+    std::unique_ptr<ThreadPool> cpuDenoiserPool;
+    std::vector<vec4f>          cpuColor;
+    std::vector<vec4f>          cpuAlbedo;
+    std::vector<vec4f>          cpuNormal;
+    std::vector<uint8_t>        cpuStaging[2];
+    /*! @} */
+
+    /*! @{ wavefront queues (see WavefrontQueues in LaunchParams.h);
+        wfRayCapacity is the number of rays they're allocated for */
+    CUDABuffer wfRays;
+    CUDABuffer wfHitFlags;
+    CUDABuffer wfHits;
+    CUDABuffer wfSortedHits;
+    CUDABuffer wfShadowRays;
+    CUDABuffer wfCounters;
+    CUDABuffer wfColorSum;
+    CUDABuffer wfNormalSum;
+    CUDABuffer wfAlbedoSum;
+    CUDABuffer wfMaterialOffsets;
+    int        wfRayCapacity { 0 };
+    /*! rays in the last batch renderWavefront() ran, which is what
+        the queues still hold */
+    int        wfLastBatchRays { 0 };
+    /*! @} */
     
     /*! the camera we are to render with. */
     Camera lastSetCamera;
+    /*! whether setCamera() got called since the last frame */
+    bool   cameraMoved = false;
+
+    /*! size of the window we display in; frame.size is the size we
+        render at, which dynamic resolution may scale down */
+    vec2i  displaySize { 0 };
     
     /*! the model we are going to trace rays against */
     const Model *model;
@@ -178,6 +660,19 @@ namespace opz {
     std::vector<CUDABuffer> indexBuffer;
     /*! @} */
     
+    /*! @{ the lights, and the table to pick them by power */
+    std::vector<QuadLight> quadLights;
+    std::vector<int>       meshFirstLightID;
+    CUDABuffer             lightsBuffer;
+    CUDABuffer             lightAliasTableBuffer;
+    /*! @} */
+    
+    /*! @{ host copy of the packed tables, and their device versions */
+    PackedSceneTables sceneTables;
+    CUDABuffer        meshTableBuffer;
+    CUDABuffer        materialTableBuffer;
+    /*! @} */
+    
     //! buffer that keeps the (final, compacted) accel structure
     CUDABuffer asBuffer;
 
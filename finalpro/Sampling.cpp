@@ -0,0 +1,214 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Sampling.h"
+#include "Checks.h"
+#include "gdt/random/random.h"
+#include "gdt/random/sampler.h"
+// std
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  typedef gdt::LCG<16> Random;
+
+  /*! report one estimate that should come out at 'expected' */
+  static bool checkEstimate(const char *what, double estimate, double expected,
+                            double tolerance)
+  {
+    const bool ok = fabs(estimate-expected) <= tolerance;
+    std::cout << "  " << what << ": " << estimate
+              << " (expected " << expected << ")"
+              << (ok ? "" : "  <-- FAILED") << std::endl;
+    return ok;
+  }
+
+  bool checkSamplingFunctions(const vec3f &lightOrigin,
+                              const vec3f &lightE1,
+                              const vec3f &lightE2,
+                              bool triangle,
+                              int numSamples)
+  {
+    std::cout << "#osc: checking sampling functions for a "
+              << (triangle ? "triangle" : "quad") << " light ("
+              << prettyNumber(numSamples) << " samples per test)" << std::endl;
+    Random random(0,0);
+    bool ok = true;
+
+    // a shading point right below the light's center, facing it, so
+    // the whole light is in its upper hemisphere
+    const vec3f lightN = areaLightNormal(lightE1,lightE2);
+    const vec3f center = lightOrigin + (triangle ? 1.f/3.f : .5f)*(lightE1+lightE2);
+    const float size   = length(lightE1) + length(lightE2);
+    const vec3f P      = center + size * lightN;
+    const vec3f N      = -lightN;
+
+    // the cosine pdf has to integrate to one over the sphere ...
+    double sum = 0.;
+    for (int i=0;i<numSamples;i++) {
+      const float z   = 1.f - 2.f*random();
+      const float r   = sqrtf(std::max(0.f,1.f-z*z));
+      const float phi = 2.f*float(M_PI)*random();
+      const vec3f dir(r*cosf(phi),r*sinf(phi),z);
+      sum += cosineHemispherePdf(N,dir) * 4.*M_PI;
+    }
+    ok &= checkEstimate("integral of cosine pdf",sum/numSamples,1.,1e-2);
+
+    // ... and so does the light pdf, over the directions that hit the
+    // light; importance-sampled with the cosine distribution
+    sum = 0.;
+    for (int i=0;i<numSamples;i++) {
+      const vec3f dir = sampleCosineHemisphere(N,random(),random());
+      float dist;
+      const float lightPdf = areaLightPdf(lightOrigin,lightE1,lightE2,triangle,P,dir,dist);
+      if (lightPdf > 0.f)
+        sum += lightPdf / cosineHemispherePdf(N,dir);
+    }
+    ok &= checkEstimate("integral of light pdf",sum/numSamples,1.,2e-2);
+
+    // light samples must find their way back to the light, with the
+    // same pdf they were drawn with
+    int numMismatches = 0;
+    for (int i=0;i<numSamples;i++) {
+      LightSample sample;
+      if (!sampleAreaLight(lightOrigin,lightE1,lightE2,triangle,P,random(),random(),sample))
+        { numMismatches++; continue; }
+      float dist = 0.f;
+      const float pdf = areaLightPdf(lightOrigin,lightE1,lightE2,triangle,P,sample.dir,dist);
+      if (fabsf(pdf-sample.pdf) > 1e-3f*sample.pdf
+          || fabsf(dist-sample.dist) > 1e-3f*sample.dist)
+        numMismatches++;
+    }
+    ok &= checkEstimate("light samples disagreeing with areaLightPdf",
+                        numMismatches,0,0);
+
+    // the two mis weights of any direction must sum to one
+    double maxWeightError = 0.;
+    for (int i=0;i<numSamples;i++) {
+      const float pdfA = random(), pdfB = 10.f*random();
+      maxWeightError = std::max(maxWeightError,
+                                (double)fabsf(powerHeuristic(pdfA,pdfB)
+                                              + powerHeuristic(pdfB,pdfA) - 1.f));
+    }
+    ok &= checkEstimate("max deviation of mis weight sum from 1",
+                        maxWeightError,0.,1e-5);
+
+    return endCheck("sampling functions",ok);
+  }
+  
+  /*! the integrand of checkSamplers: exactly pi*.16 over [0,1)^4 */
+  static inline float samplerTestFunction(float u0, float u1, float u2, float u3)
+  {
+    const float dx = u0-.5f, dy = u1-.5f;
+    return (dx*dx+dy*dy < .16f) ? u2+u3 : 0.f;
+  }
+
+  /*! per-pixel errors of one sampler over a size x size image */
+  template<typename InitAndSample>
+  static std::vector<double> samplerErrors(int size, int numSamples,
+                                           const InitAndSample &estimate)
+  {
+    const double expected = M_PI*.16;
+    std::vector<double> errors(size*size);
+    for (int iy=0;iy<size;iy++)
+      for (int ix=0;ix<size;ix++)
+        errors[ix+size*iy] = estimate(ix,iy,numSamples) - expected;
+    return errors;
+  }
+
+  static double rmsError(const std::vector<double> &errors)
+  {
+    double sum = 0.;
+    for (double e : errors) sum += e*e;
+    return sqrt(sum/errors.size());
+  }
+
+  /*! correlation of each pixel's error with its right and lower
+      neighbors': around zero for white noise, negative for blue */
+  static double neighborCorrelation(const std::vector<double> &errors, int size)
+  {
+    double sumProducts = 0., sumSquares = 0.;
+    for (int iy=0;iy<size;iy++)
+      for (int ix=0;ix<size;ix++) {
+        const double e = errors[ix+size*iy];
+        sumSquares += e*e;
+        if (ix+1 < size) sumProducts += e*errors[ix+1+size*iy];
+        if (iy+1 < size) sumProducts += e*errors[ix+size*(iy+1)];
+      }
+    return sumProducts / (2.*sumSquares);
+  }
+
+  bool checkSamplers(int maxSamplesPerPixel)
+  {
+    const int size = 64;
+    std::cout << "#osc: checking pixel samplers on a " << size << "x" << size
+              << " image" << std::endl;
+
+    auto lcg = [&](int ix, int iy, int numSamples) {
+      Random random(ix+size*iy,0);
+      double sum = 0.;
+      for (int i=0;i<numSamples;i++) {
+        const float u0 = random(), u1 = random(), u2 = random(), u3 = random();
+        sum += samplerTestFunction(u0,u1,u2,u3);
+      }
+      return sum/numSamples;
+    };
+    auto sobol = [&](int ix, int iy, int numSamples) {
+      double sum = 0.;
+      for (int i=0;i<numSamples;i++) {
+        gdt::OwenSobolSampler sampler;
+        sampler.initPixel(ix+size*iy,i);
+        const vec2f u01 = sampler.next2D(), u23 = sampler.next2D();
+        sum += samplerTestFunction(u01.x,u01.y,u23.x,u23.y);
+      }
+      return sum/numSamples;
+    };
+    auto blueNoise = [&](int ix, int iy, int numSamples) {
+      double sum = 0.;
+      for (int i=0;i<numSamples;i++) {
+        gdt::OwenSobolSampler sampler;
+        sampler.initBlueNoise(vec2i(ix,iy),vec2i(size),i,numSamples);
+        const vec2f u01 = sampler.next2D(), u23 = sampler.next2D();
+        sum += samplerTestFunction(u01.x,u01.y,u23.x,u23.y);
+      }
+      return sum/numSamples;
+    };
+
+    bool ok = true;
+    std::cout << "  spp      lcg rms    sobol rms    blue rms   (lcg/sobol/blue neighbor corr.)"
+              << std::endl;
+    for (int numSamples=4;numSamples<=maxSamplesPerPixel;numSamples*=4) {
+      const std::vector<double> lcgErrors   = samplerErrors(size,numSamples,lcg);
+      const std::vector<double> sobolErrors = samplerErrors(size,numSamples,sobol);
+      const std::vector<double> blueErrors  = samplerErrors(size,numSamples,blueNoise);
+      const double lcgRMS = rmsError(lcgErrors), sobolRMS = rmsError(sobolErrors);
+      const double blueCorrelation = neighborCorrelation(blueErrors,size);
+      printf("  %5i  %10.3e  %10.3e  %10.3e   (%+.2f/%+.2f/%+.2f)\n",
+             numSamples,lcgRMS,sobolRMS,rmsError(blueErrors),
+             neighborCorrelation(lcgErrors,size),
+             neighborCorrelation(sobolErrors,size),
+             blueCorrelation);
+      // sobol should pull ahead of the LCG quickly, and blue noise
+      // matters at low sample counts
+      if (numSamples >= 16) ok &= sobolRMS < lcgRMS;
+      if (numSamples <= 16) ok &= blueCorrelation < -.02;
+    }
+    return endCheck("pixel samplers",ok);
+  }
+  
+} // ::opz
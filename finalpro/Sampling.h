@@ -0,0 +1,187 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  // ------------------------------------------------------------------
+  // sampling and pdf functions for next-event estimation, shared by
+  // the device programs and the host-side checks in Sampling.cpp.
+  // all pdfs are with respect to solid angle at the shading point
+  // ------------------------------------------------------------------
+
+  /*! one sample on an area light, as seen from a shading point */
+  struct LightSample {
+    vec3f dir;
+    float dist;
+    /*! solid-angle pdf of having picked 'dir' */
+    float pdf;
+  };
+
+  // ------------------------------------------------------------------
+  // area lights are parallelograms origin + [0,1]*e1 + [0,1]*e2, or
+  // triangles (origin, origin+e1, origin+e2); both are one-sided and
+  // emit along cross(e1,e2)
+  // ------------------------------------------------------------------
+
+  inline __both__ vec3f areaLightNormal(const vec3f &e1, const vec3f &e2)
+  { return normalize(cross(e1,e2)); }
+
+  inline __both__ float areaLightArea(const vec3f &e1, const vec3f &e2, bool triangle)
+  { return (triangle ? .5f : 1.f) * length(cross(e1,e2)); }
+
+  /*! pick a uniformly distributed point on the light; returns false
+      if P sees the back of the light (or the light is degenerate) */
+  inline __both__ bool sampleAreaLight(const vec3f &origin,
+                                       const vec3f &e1,
+                                       const vec3f &e2,
+                                       bool triangle,
+                                       const vec3f &P,
+                                       float u1, float u2,
+                                       LightSample &sample)
+  {
+    // fold the upper half of the square back onto the triangle
+    if (triangle && u1+u2 > 1.f) { u1 = 1.f-u1; u2 = 1.f-u2; }
+    const vec3f toLight = origin + u1*e1 + u2*e2 - P;
+    const float dist2   = dot(toLight,toLight);
+    sample.dist = sqrtf(dist2);
+    sample.dir  = toLight * (1.f/sample.dist);
+    const float cosLight = -dot(sample.dir,areaLightNormal(e1,e2));
+    if (cosLight <= 0.f) return false;
+    // uniform in area is 1/area; convert to solid angle
+    sample.pdf = dist2 / (areaLightArea(e1,e2,triangle) * cosLight);
+    return true;
+  }
+
+  /*! solid-angle pdf with which sampleAreaLight would have picked
+      'dir' from P, or 0 if the ray (P,dir) misses the light's front
+      side; also returns the distance to the light */
+  inline __both__ float areaLightPdf(const vec3f &origin,
+                                     const vec3f &e1,
+                                     const vec3f &e2,
+                                     bool triangle,
+                                     const vec3f &P,
+                                     const vec3f &dir,
+                                     float &dist)
+  {
+    const vec3f N        = cross(e1,e2);
+    const float len      = length(N);
+    const float cosLight = -dot(dir,N) / len;
+    if (cosLight <= 0.f) return 0.f;
+
+    // ray/parallelogram (or triangle) intersection
+    const float t = dot(origin-P,N) / dot(dir,N);
+    if (t <= 0.f) return 0.f;
+    const vec3f H = P + t*dir - origin;
+    const float u = dot(cross(H,e2),N) / (len*len);
+    const float v = dot(cross(e1,H),N) / (len*len);
+    if (u < 0.f || v < 0.f) return 0.f;
+    if (triangle ? (u+v > 1.f) : (u > 1.f || v > 1.f)) return 0.f;
+
+    dist = t;
+    return t*t / (areaLightArea(e1,e2,triangle)*cosLight);
+  }
+
+  // ------------------------------------------------------------------
+  // picking one of many lights in O(1), from a (Walker/Vose) alias
+  // table built by buildAliasTable() in LightList.cpp
+  // ------------------------------------------------------------------
+
+  struct AliasEntry {
+    /*! probability of keeping this bucket's own index ... */
+    float prob;
+    /*! ... and what to return otherwise */
+    int   alias;
+    /*! probability of picking this index overall, for pdf lookups */
+    float pmf;
+  };
+
+  /*! one area light, as the alias table picks them: a quad, or one
+      triangle of an emissive mesh */
+  struct LightData {
+    vec3f origin, e1, e2;
+    /*! emitted radiance, from the side cross(e1,e2) points to */
+    vec3f radiance;
+    int   isTriangle;
+  };
+
+  /*! pick an index according to the table's distribution, using one
+      uniform number; returns its overall probability in 'pmf' */
+  inline __both__ int sampleAliasTable(const AliasEntry *table, int size,
+                                       float u, float &pmf)
+  {
+    const float scaled = u*size;
+    const int   bucket = int(scaled) < size-1 ? int(scaled) : size-1;
+    const int   picked = (scaled-bucket < table[bucket].prob) ? bucket : table[bucket].alias;
+    pmf = table[picked].pmf;
+    return picked;
+  }
+
+  /*! cosine-distributed direction around N, from two uniform numbers */
+  inline __both__ vec3f sampleCosineHemisphere(const vec3f &N, float u1, float u2)
+  {
+    const float phi = 2.f*float(M_PI)*u1;
+    const float r   = sqrtf(u2);
+    const vec3f T   = normalize(cross(fabsf(N.x) > .1f ? vec3f(0.f,1.f,0.f) : vec3f(1.f,0.f,0.f),N));
+    const vec3f B   = cross(N,T);
+    return normalize(r*cosf(phi)*T + r*sinf(phi)*B + sqrtf(1.f-u2)*N);
+  }
+
+  inline __both__ float cosineHemispherePdf(const vec3f &N, const vec3f &dir)
+  {
+    const float cosTheta = dot(N,dir);
+    return cosTheta > 0.f ? cosTheta * float(1./M_PI) : 0.f;
+  }
+
+  /*! lambertian brdf value */
+  inline __both__ vec3f diffuseBrdf(const vec3f &albedo)
+  { return albedo * float(1./M_PI); }
+
+  /*! power heuristic (beta=2) weight of a sample drawn with pdf
+      'pdfA', when 'pdfB' could have drawn it as well */
+  inline __both__ float powerHeuristic(float pdfA, float pdfB)
+  {
+    const float a2 = pdfA*pdfA;
+    const float b2 = pdfB*pdfB;
+    return (a2 + b2) > 0.f ? a2 / (a2 + b2) : 0.f;
+  }
+
+  /*! host-side sanity checks of the above, for the given light: that
+      the pdfs integrate to one and that sampleAreaLight and
+      areaLightPdf agree. prints what it finds, and returns true if
+      everything is within tolerance */
+  bool checkSamplingFunctions(const vec3f &lightOrigin,
+                              const vec3f &lightE1,
+                              const vec3f &lightE2,
+                              bool triangle,
+                              int numSamples = 1<<20);
+
+  /*! host-side convergence test of the pixel samplers: integrates a
+      4D function (a disk in the first two dimensions, a ramp in the
+      next two) over a 64x64 "image" with the LCG, per-pixel sobol and
+      blue-noise sobol samplers at increasing sample counts, printing
+      their RMS errors and how correlated neighboring pixels' errors
+      are. returns true if sobol beats the LCG and, at low sample
+      counts, the blue-noise sampler's neighbors are anti-correlated */
+  bool checkSamplers(int maxSamplesPerPixel = 1024);
+  
+} // ::opz
@@ -0,0 +1,113 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "SceneTables.h"
+#include "Checks.h"
+
+//std
+#include <map>
+#include <tuple>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  PackedSceneTables packSceneTables(const Model *model, int numTextures)
+  {
+    PackedSceneTables tables;
+
+    // loadOBJ creates one mesh per (shape,material) pair, so the same
+    // material typically shows up many times - match on its contents
+    typedef std::tuple<float,float,float,int,float,float,float> MaterialKey;
+    std::map<MaterialKey,int> knownMaterials;
+
+    for (auto mesh : model->meshes) {
+      PackedMaterial material;
+      material.diffuse  = mesh->diffuse;
+      material.emission = mesh->emission;
+      material.diffuseTextureID
+        = (mesh->diffuseTextureID >= 0 && mesh->diffuseTextureID < numTextures)
+        ? mesh->diffuseTextureID
+        : -1;
+
+      const MaterialKey key(material.diffuse.x,
+                            material.diffuse.y,
+                            material.diffuse.z,
+                            material.diffuseTextureID,
+                            material.emission.x,
+                            material.emission.y,
+                            material.emission.z);
+      auto it = knownMaterials.find(key);
+      if (it == knownMaterials.end()) {
+        const int materialID = (int)tables.materials.size();
+        tables.materials.push_back(material);
+        it = knownMaterials.insert(std::make_pair(key,materialID)).first;
+      }
+      tables.meshMaterialIDs.push_back(it->second);
+    }
+    return tables;
+  }
+
+  bool checkSceneTables()
+  {
+    beginCheck("scene tables");
+    bool ok = true;
+
+    // six meshes: 0, 2 and 4 look the same except that 4's texture
+    // didn't load; 1 is textured, 3 emits, and 5 only differs from 0
+    // in its emission
+    const int numTextures = 2;
+    Model model;
+    for (int i=0;i<6;i++) model.meshes.push_back(new TriangleMesh);
+    for (auto mesh : model.meshes) mesh->diffuse = vec3f(.5f,.25f,.125f);
+    model.meshes[1]->diffuseTextureID = 1;
+    model.meshes[3]->diffuse          = vec3f(0.f);
+    model.meshes[3]->emission         = vec3f(10.f,8.f,6.f);
+    model.meshes[4]->diffuseTextureID = numTextures;
+    model.meshes[5]->emission         = vec3f(0.f,0.f,1e-3f);
+
+    const PackedSceneTables tables = packSceneTables(&model,numTextures);
+    const std::vector<int> &ids = tables.meshMaterialIDs;
+    ok &= checkResult("one material ID per mesh",ids.size() == model.meshes.size());
+    if (!ok) return endCheck("scene tables",ok);
+
+    bool idsValid = true;
+    for (int id : ids) idsValid &= (id >= 0 && id < (int)tables.materials.size());
+    ok &= checkResult("material IDs index the table",idsValid);
+    if (!idsValid) return endCheck("scene tables",ok);
+
+    ok &= checkResult("meshes sharing a material share its entry",
+                      ids[0] == ids[2] && ids[0] == ids[4]
+                      && tables.materials.size() == 4);
+    ok &= checkResult("different materials get entries of their own",
+                      ids[0] != ids[1] && ids[0] != ids[3] && ids[0] != ids[5]
+                      && ids[1] != ids[3] && ids[1] != ids[5] && ids[3] != ids[5]);
+    ok &= checkResult("texture IDs out of range mean no texture",
+                      tables.materials[ids[4]].diffuseTextureID == -1
+                      && tables.materials[ids[0]].diffuseTextureID == -1);
+    ok &= checkResult("... and ones in range are kept",
+                      tables.materials[ids[1]].diffuseTextureID == 1);
+    ok &= checkResult("emission is carried through",
+                      tables.materials[ids[3]].emission == vec3f(10.f,8.f,6.f)
+                      && tables.materials[ids[5]].emission == vec3f(0.f,0.f,1e-3f)
+                      && tables.materials[ids[0]].emission == vec3f(0.f));
+    ok &= checkResult("... and so is the diffuse color",
+                      tables.materials[ids[0]].diffuse == vec3f(.5f,.25f,.125f)
+                      && tables.materials[ids[3]].diffuse == vec3f(0.f));
+
+    return endCheck("scene tables",ok);
+  }
+}
@@ -0,0 +1,52 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Model.h"
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! host-side description of one unique material; the renderer
+      turns the texture ID into a cuda texture object on upload */
+  struct PackedMaterial {
+    vec3f diffuse;
+    /*! index into model->textures, or -1 if untextured */
+    int   diffuseTextureID { -1 };
+    vec3f emission;
+  };
+
+  /*! the material and mesh tables the hit programs index into. meshes
+      that use the same material share a single table entry */
+  struct PackedSceneTables {
+    std::vector<PackedMaterial> materials;
+    /*! material table index for each mesh in model->meshes */
+    std::vector<int>            meshMaterialIDs;
+  };
+
+  /*! build the de-duplicated material table for the given model.
+      texture IDs outside [0,numTextures) (ie, textures that failed to
+      load) are treated as 'no texture'. pure host code - does not
+      touch the device */
+  PackedSceneTables packSceneTables(const Model *model, int numTextures);
+
+  /*! host-side checks of packSceneTables on a synthetic model: shared
+      materials, bad texture IDs, emission and the mesh-to-material
+      indices; prints what it finds, and returns true if all pass */
+  bool checkSceneTables();
+}
@@ -0,0 +1,107 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+// common std stuff
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! minimal fixed-size pool of host worker threads. jobs may enqueue
+      further jobs (which is exactly what optix compile tasks do), and
+      wait() returns only once the queue has run completely dry */
+  class ThreadPool {
+  public:
+    /*! create given number of workers; 0 means one per hardware thread */
+    explicit ThreadPool(int numThreads = 0)
+    {
+      if (numThreads <= 0)
+        numThreads = std::max(1,(int)std::thread::hardware_concurrency());
+      for (int i=0;i<numThreads;i++)
+        workers.emplace_back([this]{ workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      jobAvailable.notify_all();
+      for (auto &worker : workers) worker.join();
+    }
+
+    //! add a job to the queue; safe to call from within a job
+    void enqueue(std::function<void()> job)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+      }
+      jobAvailable.notify_one();
+    }
+
+    //! block until all queued jobs - and all jobs they spawned - are done
+    void wait()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      allDone.wait(lock,[this]{ return jobs.empty() && numActive == 0; });
+    }
+
+    inline int size() const { return (int)workers.size(); }
+
+  private:
+    void workerLoop()
+    {
+      while (true) {
+        std::function<void()> job;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          jobAvailable.wait(lock,[this]{ return stopping || !jobs.empty(); });
+          if (jobs.empty()) return;
+          job = std::move(jobs.front());
+          jobs.pop_front();
+          numActive++;
+        }
+        job();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          numActive--;
+          if (jobs.empty() && numActive == 0)
+            allDone.notify_all();
+        }
+      }
+    }
+
+    std::vector<std::thread>          workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex                        mutex;
+    std::condition_variable           jobAvailable;
+    std::condition_variable           allDone;
+    int                               numActive { 0 };
+    bool                              stopping  { false };
+  };
+
+} // ::opz
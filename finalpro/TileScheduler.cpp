@@ -0,0 +1,256 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#include "TileScheduler.h"
+#include "Checks.h"
+// std
+#include <algorithm>
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! position of the d'th cell along an n x n (n a power of two)
+      hilbert curve */
+  static vec2i hilbertCell(int n, int d)
+  {
+    vec2i cell(0);
+    for (int s=1;s<n;s*=2) {
+      const int rx = 1 & (d/2);
+      const int ry = 1 & (d ^ rx);
+      if (ry == 0) {
+        if (rx == 1) cell = vec2i(s-1) - cell;
+        std::swap(cell.x,cell.y);
+      }
+      cell.x += s*rx;
+      cell.y += s*ry;
+      d /= 4;
+    }
+    return cell;
+  }
+  
+  std::vector<Tile> makeTileOrder(const vec2i &frameSize, int tileSize, int order)
+  {
+    std::vector<Tile> tiles;
+    if (frameSize.x <= 0 || frameSize.y <= 0 || tileSize <= 0) return tiles;
+    const vec2i numTiles((frameSize.x+tileSize-1)/tileSize,
+                         (frameSize.y+tileSize-1)/tileSize);
+    const int   total = numTiles.x*numTiles.y;
+    auto addTile = [&](const vec2i &tileID) {
+      if (tileID.x < 0 || tileID.y < 0 ||
+          tileID.x >= numTiles.x || tileID.y >= numTiles.y) return;
+      Tile tile;
+      tile.origin = tileID*tileSize;
+      tile.size   = min(vec2i(tileSize),frameSize-tile.origin);
+      tiles.push_back(tile);
+    };
+
+    switch (order) {
+    case TILE_ORDER_SPIRAL: {
+      // walk right, down, left, up, ..., one step longer every other
+      // leg; the walk leaves the frame on its narrow side long before
+      // it's done, so skip what falls outside
+      const vec2i step[4] = { vec2i(1,0),vec2i(0,1),vec2i(-1,0),vec2i(0,-1) };
+      vec2i tileID = (numTiles-1)/2;
+      addTile(tileID);
+      for (int leg=0;(int)tiles.size()<total;leg++)
+        for (int i=0;i<leg/2+1;i++) {
+          tileID = tileID + step[leg%4];
+          addTile(tileID);
+        }
+    } break;
+    case TILE_ORDER_HILBERT: {
+      // the curve over the smallest power-of-two square that holds
+      // all tiles, skipping what falls outside
+      int n = 1;
+      while (n < std::max(numTiles.x,numTiles.y)) n *= 2;
+      for (int d=0;d<n*n;d++)
+        addTile(hilbertCell(n,d));
+    } break;
+    default:
+      for (int ty=0;ty<numTiles.y;ty++)
+        for (int tx=0;tx<numTiles.x;tx++)
+          addTile(vec2i(tx,ty));
+    }
+    return tiles;
+  }
+
+  bool TileScheduler::setFrame(const vec2i &newSize)
+  {
+    if (newSize == frameSize && tileSize == builtTileSize && order == builtOrder)
+      return false;
+    frameSize     = newSize;
+    builtTileSize = tileSize;
+    builtOrder    = order;
+    tiles         = makeTileOrder(frameSize,tileSize,order);
+    nextTile      = 0;
+    active        = false;
+    return true;
+  }
+
+  void TileScheduler::beginPass()
+  {
+    nextTile = 0;
+    active   = !tiles.empty();
+  }
+
+  void TileScheduler::beginFrame()
+  {
+    sliceUsed     = 0.;
+    lastTileTime  = 0.;
+    passCompleted = false;
+  }
+
+  bool TileScheduler::tileDone(double seconds)
+  {
+    sliceUsed   += seconds;
+    lastTileTime = seconds;
+    if (++nextTile < (int)tiles.size()) return false;
+    active        = false;
+    passCompleted = true;
+    return true;
+  }
+
+  bool TileScheduler::timeLeft() const
+  {
+    if (passCompleted)   return false;
+    if (timeSlice <= 0.) return true;
+    return sliceUsed + lastTileTime <= timeSlice;
+  }
+
+  /*! true if the tiles cover every pixel of the frame exactly once */
+  static bool coversFrameOnce(const std::vector<Tile> &tiles, const vec2i &frameSize)
+  {
+    std::vector<int> count(frameSize.x*frameSize.y,0);
+    for (auto &tile : tiles)
+      for (int iy=tile.origin.y;iy<tile.origin.y+tile.size.y;iy++)
+        for (int ix=tile.origin.x;ix<tile.origin.x+tile.size.x;ix++) {
+          if (ix < 0 || iy < 0 || ix >= frameSize.x || iy >= frameSize.y)
+            return false;
+          count[ix+frameSize.x*iy]++;
+        }
+    for (int c : count) if (c != 1) return false;
+    return true;
+  }
+
+  /*! fraction of consecutive tiles that share an edge */
+  static float adjacentFraction(const std::vector<Tile> &tiles)
+  {
+    if (tiles.size() < 2) return 1.f;
+    int numAdjacent = 0;
+    for (size_t i=1;i<tiles.size();i++) {
+      const vec2i d = tiles[i].origin - tiles[i-1].origin;
+      const int   tileSize = std::max(tiles[i-1].size.x,tiles[i-1].size.y);
+      if ((d.x == 0) != (d.y == 0)
+          && std::abs(d.x) <= tileSize && std::abs(d.y) <= tileSize)
+        numAdjacent++;
+    }
+    return float(numAdjacent)/(tiles.size()-1);
+  }
+  
+  bool checkTileScheduler()
+  {
+    beginCheck("tile scheduler");
+    const char *orderName[TILE_ORDER_COUNT] = { "scanline","spiral","hilbert" };
+    bool ok = true;
+
+    // every order covers odd sizes and odd tile sizes exactly once
+    const vec2i frameSizes[] = { vec2i(1920,1080),vec2i(1000,37),vec2i(513,512),vec2i(1) };
+    const int   tileSizes[]  = { 256,64,17 };
+    bool allCovered = true;
+    for (int order=0;order<TILE_ORDER_COUNT;order++)
+      for (auto &frameSize : frameSizes)
+        for (int tileSize : tileSizes)
+          allCovered &= coversFrameOnce(makeTileOrder(frameSize,tileSize,order),frameSize);
+    ok &= checkResult("all orders cover every pixel exactly once",allCovered);
+
+    for (int order=0;order<TILE_ORDER_COUNT;order++)
+      std::cout << "  " << orderName[order] << ": "
+                << int(100.f*adjacentFraction(makeTileOrder(vec2i(1920,1080),128,order)))
+                << "% of consecutive 1080p tiles touch" << std::endl;
+    ok &= checkResult("hilbert tiles of a power-of-two grid all touch",
+                      adjacentFraction(makeTileOrder(vec2i(1024),64,TILE_ORDER_HILBERT))
+                      == 1.f);
+    {
+      const vec2i frameSize(1920,1080);
+      const Tile  first = makeTileOrder(frameSize,128,TILE_ORDER_SPIRAL)[0];
+      const vec2i center = first.origin + first.size/2;
+      ok &= checkResult("spiral starts in the middle of the screen",
+                        std::abs(center.x-frameSize.x/2) <= 128
+                        && std::abs(center.y-frameSize.y/2) <= 128);
+    }
+
+    // time slicing: tiles cost time in proportion to their pixels;
+    // frames must keep within their slice, and resume where the last
+    // one stopped until the pass is done
+    {
+      const vec2i frameSize(1920,1080);
+      TileScheduler scheduler;
+      scheduler.tileSize = 128;
+      scheduler.setFrame(frameSize);
+      const double fullTileTime = 4e-3;
+      std::vector<Tile> rendered;
+      int    numFrames = 0;
+      double maxFrameTime = 0.;
+      bool   passDone = false;
+      scheduler.beginPass();
+      while (!passDone && numFrames < 1000) {
+        scheduler.beginFrame();
+        double frameTime = 0.;
+        do {
+          const Tile tile = scheduler.currentTile();
+          const double t
+            = fullTileTime*tile.size.x*tile.size.y/(128.*128.);
+          rendered.push_back(tile);
+          frameTime += t;
+          passDone = scheduler.tileDone(t);
+        } while (!passDone && scheduler.timeLeft());
+        maxFrameTime = std::max(maxFrameTime,frameTime);
+        numFrames++;
+      }
+      std::cout << "  " << scheduler.numTiles() << " tiles took " << numFrames
+                << " frames, at most " << maxFrameTime*1000. << "ms each" << std::endl;
+      ok &= checkResult("time sliced frames keep within their slice",
+                        maxFrameTime <= scheduler.timeSlice);
+      ok &= checkResult("and together render the pass exactly once",
+                        passDone && !scheduler.passActive()
+                        && coversFrameOnce(rendered,frameSize));
+      // no slice: each frame is exactly one pass
+      scheduler.timeSlice = 0.;
+      scheduler.beginPass();
+      scheduler.beginFrame();
+      int numTiles = 0;
+      do {
+        numTiles++;
+        if (scheduler.tileDone(fullTileTime)) break;
+      } while (scheduler.timeLeft());
+      ok &= checkResult("without a slice, a frame is one whole pass",
+                        numTiles == scheduler.numTiles());
+      // a new frame size starts over
+      scheduler.beginPass();
+      scheduler.tileDone(0.);
+      ok &= checkResult("resizing abandons the pass",
+                        scheduler.setFrame(vec2i(1280,720)) && !scheduler.passActive()
+                        && !scheduler.setFrame(vec2i(1280,720)));
+    }
+
+    return endCheck("tile scheduler",ok);
+  }
+  
+} // ::opz
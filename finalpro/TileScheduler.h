@@ -0,0 +1,112 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#pragma once
+
+#include "gdt/math/vec.h"
+// std
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+  using namespace gdt;
+
+  /*! the orders tiles get rendered in */
+  typedef enum {
+    /*! rows of tiles, top to bottom */
+    TILE_ORDER_SCANLINE=0,
+    /*! square spiral out of the center tile, so what's in the middle
+        of the screen gets refined first */
+    TILE_ORDER_SPIRAL,
+    /*! along a hilbert curve; consecutive tiles touch, so their rays
+        tend to hit the same part of the scene */
+    TILE_ORDER_HILBERT,
+    TILE_ORDER_COUNT
+  } TileOrder;
+
+  /*! a rectangle of pixels; edge tiles get clipped to the frame */
+  struct Tile {
+    vec2i origin;
+    vec2i size;
+  };
+
+  /*! all tiles of a frame of 'frameSize' pixels, in the given order */
+  std::vector<Tile> makeTileOrder(const vec2i &frameSize, int tileSize, int order);
+
+  /*! bookkeeping of tiled progressive rendering: a pass renders every
+      tile once; each displayed frame renders tiles - resuming where
+      the last one stopped - until its time slice is used up or the
+      pass is done, so no single frame (or launch) takes too long no
+      matter the resolution and sample count. pure host logic, no cuda - see
+      checkTileScheduler() */
+  class TileScheduler {
+  public:
+    /*! @{ tiles are tileSize^2 pixels, rendered in one of TILE_ORDER_* */
+    int    tileSize  = 256;
+    int    order     = TILE_ORDER_HILBERT;
+    /*! @} */
+    /*! rendering time per displayed frame, in seconds; 0 means one
+        whole pass per frame */
+    double timeSlice = 1./30.;
+
+    /*! (re-)build the tiles if the frame size or tile settings
+        changed; returns true if so, which abandons the current pass */
+    bool setFrame(const vec2i &frameSize);
+
+    /*! start a new pass at the first tile */
+    void beginPass();
+    /*! true while a pass has tiles left */
+    inline bool passActive() const { return active; }
+
+    /*! start a new displayed frame, ie, time slice */
+    void beginFrame();
+    /*! the tile to render next */
+    inline const Tile &currentTile() const { return tiles[nextTile]; }
+    /*! report the current tile took 'seconds'; returns true if that
+        completed the pass */
+    bool tileDone(double seconds);
+    /*! whether this frame should render another tile: its pass isn't
+        done yet, and another tile still fits into the time slice
+        (judging by how long the last one took) */
+    bool timeLeft() const;
+
+    inline int   numTiles() const { return (int)tiles.size(); }
+    /*! fraction of the current pass that's done */
+    inline float progress() const
+    { return tiles.empty() ? 0.f : float(nextTile)/tiles.size(); }
+    
+  private:
+    std::vector<Tile> tiles;
+    vec2i  frameSize        { 0 };
+    int    builtTileSize    = 0;
+    int    builtOrder       = -1;
+    int    nextTile         = 0;
+    bool   active           = false;
+    bool   passCompleted    = false;
+    double sliceUsed        = 0.;
+    double lastTileTime     = 0.;
+  };
+
+  /*! host-side checks of the tile orders (every pixel exactly once
+      per pass, spiral starts in the middle, hilbert tiles touch) and
+      of the time slicing against simulated tile times; prints what
+      it finds, and returns true if all pass */
+  bool checkTileScheduler();
+  
+} // ::opz
@@ -0,0 +1,125 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "WavefrontQueues.h"
+#include "Checks.h"
+#include "gdt/random/random.h"
+// std
+#include <algorithm>
+#include <stdexcept>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  std::vector<int> compactQueue(const std::vector<int> &activeFlags)
+  {
+    std::vector<int> indices;
+    for (int i=0;i<(int)activeFlags.size();i++)
+      if (activeFlags[i]) indices.push_back(i);
+    return indices;
+  }
+
+  std::vector<int> sortByMaterial(const std::vector<int> &keys, int numKeys)
+  {
+    // histogram ...
+    std::vector<int> offsets(numKeys+1,0);
+    for (int key : keys) {
+      if (key < 0 || key >= numKeys)
+        throw std::runtime_error("sortByMaterial: material ID out of range");
+      offsets[key+1]++;
+    }
+    // ... exclusive scan ...
+    for (int key=0;key<numKeys;key++)
+      offsets[key+1] += offsets[key];
+    // ... and scatter, in input order so equal keys keep their order
+    std::vector<int> permutation(keys.size());
+    for (int i=0;i<(int)keys.size();i++)
+      permutation[offsets[keys[i]]++] = i;
+    return permutation;
+  }
+
+  // ------------------------------------------------------------------
+  // checks
+  // ------------------------------------------------------------------
+
+  bool checkWavefrontQueues()
+  {
+    beginCheck("wavefront queues");
+    bool ok = true;
+
+    // compaction: a seeded mix of active and inactive entries
+    {
+      gdt::LCG<16> random(13,17);
+      std::vector<int> flags(1000);
+      std::vector<int> expected;
+      for (int i=0;i<(int)flags.size();i++) {
+        // (any non-zero flag counts as active)
+        flags[i] = random() < .3f ? 1+(i%3) : 0;
+        if (flags[i]) expected.push_back(i);
+      }
+      ok &= checkResult("compaction keeps exactly the active indices, in order",
+                        compactQueue(flags) == expected);
+      ok &= checkResult("... and gives nothing for an empty or all-inactive queue",
+                        compactQueue({}).empty()
+                        && compactQueue(std::vector<int>(16,0)).empty());
+    }
+
+    // sort: few materials, so every key comes up many times
+    {
+      const int numKeys = 7;
+      gdt::LCG<16> random(19,23);
+      std::vector<int> keys(2000);
+      for (auto &key : keys) key = std::min(numKeys-1,int(random()*numKeys));
+      // the middle key never shows up, so its bucket is empty
+      for (auto &key : keys) if (key == numKeys/2) key = 0;
+      const std::vector<int> permutation = sortByMaterial(keys,numKeys);
+
+      std::vector<bool> seen(keys.size(),false);
+      bool valid = permutation.size() == keys.size();
+      for (int i=0;valid && i<(int)permutation.size();i++) {
+        valid = permutation[i] >= 0 && permutation[i] < (int)keys.size()
+          && !seen[permutation[i]];
+        if (valid) seen[permutation[i]] = true;
+      }
+      ok &= checkResult("sort returns a permutation of the input",valid);
+      bool sorted = valid, stable = valid;
+      for (int i=1;valid && i<(int)permutation.size();i++) {
+        const int a = permutation[i-1], b = permutation[i];
+        sorted &= keys[a] <= keys[b];
+        stable &= keys[a] != keys[b] || a < b;
+      }
+      ok &= checkResult("... sorted by material",sorted);
+      ok &= checkResult("... with equal materials in their input order",stable);
+      ok &= checkResult("sorting an empty queue gives an empty permutation",
+                        sortByMaterial({},numKeys).empty());
+      bool rejected = true;
+      for (int bad : { -1,numKeys }) {
+        bool threw = false;
+        try {
+          sortByMaterial({ 0,bad,1 },numKeys);
+        } catch (std::runtime_error &) {
+          threw = true;
+        }
+        rejected &= threw;
+      }
+      ok &= checkResult("material IDs out of range get turned down",rejected);
+    }
+
+    return endCheck("wavefront queues",ok);
+  }
+  
+} // ::opz
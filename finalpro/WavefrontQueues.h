@@ -0,0 +1,46 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+// common std stuff
+#include <vector>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! CPU reference for the wavefront queue compaction: returns the
+      indices of all active entries, in order. the device appends
+      through an atomic counter instead, so its queue has the same
+      entries in some other order */
+  std::vector<int> compactQueue(const std::vector<int> &activeFlags);
+
+  /*! CPU reference for sorting a hit queue by material: a stable
+      counting sort of 'keys' (each in [0,numKeys)), returning the
+      permutation, ie, sorted[i] = unsorted[permutation[i]]. the
+      device version is a histogram / scan / scatter over the same
+      keys, which is equivalent up to order within one key */
+  std::vector<int> sortByMaterial(const std::vector<int> &keys, int numKeys);
+
+  /*! host-side checks of the two references above: compaction keeps
+      exactly the active indices in order, and the sort returns a
+      valid, stable permutation (also of nothing) and turns down
+      material IDs out of range. prints what it finds, and returns
+      true if all pass */
+  bool checkWavefrontQueues();
+  
+} // ::opz
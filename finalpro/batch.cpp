@@ -0,0 +1,219 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+
+#include "SampleRenderer.h"
+#include "ImageWriter.h"
+// std
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  static void usage(const char *argv0)
+  {
+    std::cout << "usage: " << argv0 << " <scene.obj> [options]\n"
+              << "  -o <file>                     output; .png (tone mapped), .exr, .hdr,\n"
+              << "                                .pfm or .raw (linear)\n"
+              << "  --sequence <n>                also write every n-th frame, as <file>_0000 ...\n"
+              << "  --writer-threads <n>          threads encoding images (one per core)\n"
+              << "  --size <w> <h>                resolution (1920 1080)\n"
+              << "  --spp <n>                     samples per pixel (256)\n"
+              << "  --spf <n>                     of those, samples per frame (16)\n"
+              << "  --camera <from> <at> <up>     nine floats; default looks at the scene\n"
+              << "  --light <origin> <du> <dv> <power>\n"
+              << "                                a quad light, twelve floats; may repeat\n"
+              << "  --max-depth <n>               path depth\n"
+              << "  --no-denoiser, --cpu-denoiser\n"
+              << "  --compile-threads <n>, --no-cache, --cache-dir <dir>\n"
+              << "timings get printed as a single line of json, last" << std::endl;
+  }
+
+  static vec3f parseVec3f(char **av)
+  {
+    return vec3f((float)atof(av[0]),(float)atof(av[1]),(float)atof(av[2]));
+  }
+
+  /*! 'str' as a json string literal */
+  static std::string jsonString(const std::string &str)
+  {
+    std::string quoted = "\"";
+    for (char c : str) {
+      if (c == '"' || c == '\\') quoted += '\\';
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  /*! renders one image without a window - nor glfw or opengl, so it
+      runs on machines without a display - and writes it to a file */
+  extern "C" int main(int ac, char **av)
+  {
+    std::string sceneFile, outFile = "out.png";
+    vec2i size(1920,1080);
+    int   numSamples = 256, samplesPerFrame = 16, maxDepth = -1;
+    int   sequenceInterval = 0, writerThreads = 0;
+    bool  haveCamera = false, denoise = true, cpuDenoiser = false;
+    Camera camera;
+    std::vector<QuadLight> quadLights;
+    CompileConfig compileConfig;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-o" && i+1<ac)
+        outFile = av[++i];
+      else if (arg == "--size" && i+2<ac) {
+        size.x = atoi(av[++i]);
+        size.y = atoi(av[++i]);
+      } else if (arg == "--spp" && i+1<ac)
+        numSamples = atoi(av[++i]);
+      else if (arg == "--spf" && i+1<ac)
+        samplesPerFrame = atoi(av[++i]);
+      else if (arg == "--sequence" && i+1<ac)
+        sequenceInterval = atoi(av[++i]);
+      else if (arg == "--writer-threads" && i+1<ac)
+        writerThreads = atoi(av[++i]);
+      else if (arg == "--camera" && i+9<ac) {
+        camera = { parseVec3f(av+i+1),parseVec3f(av+i+4),parseVec3f(av+i+7) };
+        haveCamera = true;
+        i += 9;
+      } else if (arg == "--light" && i+12<ac) {
+        quadLights.push_back({ parseVec3f(av+i+1),parseVec3f(av+i+4),
+                               parseVec3f(av+i+7),parseVec3f(av+i+10) });
+        i += 12;
+      } else if (arg == "--max-depth" && i+1<ac)
+        maxDepth = atoi(av[++i]);
+      else if (arg == "--no-denoiser") denoise = false;
+      else if (arg == "--cpu-denoiser") cpuDenoiser = true;
+      else if (arg == "--compile-threads" && i+1<ac)
+        compileConfig.numThreads = atoi(av[++i]);
+      else if (arg == "--no-cache")
+        compileConfig.cacheEnabled = false;
+      else if (arg == "--cache-dir" && i+1<ac)
+        compileConfig.cacheLocation = av[++i];
+      else if (arg[0] != '-' && sceneFile.empty())
+        sceneFile = arg;
+      else {
+        usage(av[0]);
+        return 1;
+      }
+    }
+    const ImageFormat format = imageFormatOf(outFile);
+    if (sceneFile.empty() || format == IMAGE_FORMAT_UNKNOWN
+        || size.x <= 0 || size.y <= 0 || numSamples <= 0 || samplesPerFrame <= 0) {
+      usage(av[0]);
+      return 1;
+    }
+
+    try {
+      const double t0 = getCurrentTime();
+      Model *model = loadOBJ(sceneFile);
+      if (!haveCamera)
+        // the same view the interactive renderer starts with
+        camera = { vec3f(-5.f,0.f,5.f),model->bounds.center(),vec3f(0.f,1.f,0.f) };
+      const double t1 = getCurrentTime();
+
+      SampleRenderer renderer(model,quadLights,compileConfig);
+      renderer.setCamera(camera);
+      // an exact sample count at a fixed size: none of the
+      // interactive controllers
+      renderer.dynamicResolution  = false;
+      renderer.autoSampleCount    = false;
+      renderer.tiledLaunches      = false;
+      renderer.accumulate         = true;
+      renderer.denoiserOn         = denoise;
+      // (every frame we write has to be denoised, converged or not)
+      renderer.denoiserScheduler.convergedInterval = 1;
+      if (cpuDenoiser)
+        renderer.denoiserBackend = DENOISER_BACKEND_CPU;
+      if (maxDepth > 0)
+        renderer.launchParams.path.maxDepth = maxDepth;
+      renderer.resize(size);
+      const double t2 = getCurrentTime();
+
+      // images get encoded and written in the background; the last
+      // one is <file> itself, the ones before get numbered
+      ImageWriter writer(writerThreads);
+      const int totalFrames = (numSamples+samplesPerFrame-1)/samplesPerFrame;
+      const int totalImages = sequenceInterval > 0
+        ? totalFrames/sequenceInterval + (totalFrames % sequenceInterval ? 1 : 0)
+        : 1;
+      const size_t dot = outFile.find_last_of('.');
+      int numImages = 0;
+      auto nextImageName = [&]() {
+        if (++numImages == totalImages) return outFile;
+        char number[16];
+        snprintf(number,sizeof(number),"_%04d",numImages-1);
+        return outFile.substr(0,dot)+number+outFile.substr(dot);
+      };
+      int samplesLeft = numSamples, numFrames = 0;
+      // frames come with the renderer's own downloads - rgba8, or
+      // the linear color as it has it - and go to the writer without
+      // waiting for anything; it converts linear color on its threads
+      if (isLinearFormat(format))
+        renderer.onLinearFrameDone = [&](const PixelBuffer &color, const vec2i &frameSize) {
+          const uint8_t *bytes = (const uint8_t*)color.data;
+          writer.write(nextImageName(),frameSize,
+                       std::vector<uint8_t>(bytes,bytes+size_t(frameSize.x)*frameSize.y
+                                            *pixelSize(color.format)),
+                       color.format);
+        };
+      else
+        renderer.onFrameDone = [&](const uint32_t *pixels, const vec2i &frameSize) {
+          writer.write(nextImageName(),frameSize,
+                       std::vector<uint32_t>(pixels,pixels+size_t(frameSize.x)*frameSize.y));
+        };
+
+      // only frames we write get 'presented' - and so denoised
+      while (samplesLeft > 0) {
+        renderer.launchParams.numPixelSamples = std::min(samplesLeft,samplesPerFrame);
+        samplesLeft -= renderer.launchParams.numPixelSamples;
+        numFrames++;
+        const bool last = samplesLeft == 0;
+        const bool save = last || (sequenceInterval > 0 && numFrames % sequenceInterval == 0);
+        renderer.render(save);
+      }
+      renderer.finishFrames();
+      const double t3 = getCurrentTime();
+      writer.finish();
+      const double t4 = getCurrentTime();
+
+      const double samplesPerSecond = double(numSamples)*size.x*size.y/(t3-t2);
+      std::cout << "{\"scene\": " << jsonString(sceneFile)
+                << ", \"output\": " << jsonString(outFile)
+                << ", \"width\": " << size.x << ", \"height\": " << size.y
+                << ", \"spp\": " << numSamples << ", \"frames\": " << numFrames
+                << ", \"denoised\": " << (denoise ? "true" : "false")
+                << ", \"load_s\": " << (t1-t0)
+                << ", \"setup_s\": " << (t2-t1)
+                << ", \"compile_s\": " << renderer.startupReport.moduleTime
+                << ", \"render_s\": " << (t3-t2)
+                << ", \"images\": " << writer.numWritten
+                << ", \"peak_queued_images\": " << writer.peakQueued
+                << ", \"write_wait_s\": " << (t4-t3)
+                << ", \"total_s\": " << (t4-t0)
+                << ", \"samples_per_s\": " << samplesPerSecond
+                << "}" << std::endl;
+    } catch (std::runtime_error &e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+} // ::opz
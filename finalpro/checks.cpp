@@ -0,0 +1,201 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Sampling.h"
+#include "AdaptiveSampling.h"
+#include "LightList.h"
+#include "SceneTables.h"
+#include "BVHAnalyzer.h"
+#include "ResolutionController.h"
+#include "SampleCountController.h"
+#include "DenoiserScheduler.h"
+#include "AtrousDenoiser.h"
+#include "HalfFloat.h"
+#include "TileScheduler.h"
+#include "DenoiserTiling.h"
+#include "Mailbox.h"
+#include "ImageWriter.h"
+#include "WavefrontQueues.h"
+// std
+#include <cstring>
+#include <iostream>
+
+/*! \namespace opz - Optix ZYM-PKU */
+namespace opz {
+
+  /*! a triangle mesh with the given emission, nothing else */
+  static TriangleMesh *makeTriangle(const vec3f &a, const vec3f &b, const vec3f &c,
+                                    const vec3f &emission)
+  {
+    TriangleMesh *mesh = new TriangleMesh;
+    mesh->vertex   = { a, b, c };
+    mesh->index    = { vec3i(0,1,2) };
+    mesh->diffuse  = vec3f(.5f);
+    mesh->emission = emission;
+    return mesh;
+  }
+
+  static bool checkSampling()
+  {
+    // (the quad light main.cpp hangs over sponza)
+    const float size = 200.f;
+    const QuadLight light = { vec3f(-1000-size,800,-size),
+                              vec3f(2.f*size,0,0),
+                              vec3f(0,0,2.f*size),
+                              vec3f(3000000.f*float(M_PI)) };
+    bool ok = true;
+    ok &= checkSamplingFunctions(light.origin,light.du,light.dv,false);
+    ok &= checkSamplingFunctions(light.origin,light.du,light.dv,true);
+    ok &= checkSamplers();
+    ok &= checkAdaptiveSampling();
+
+    // that light, plus emitters of very different power
+    Model model;
+    model.meshes.push_back(makeTriangle(vec3f(0,0,0),vec3f(1,0,0),vec3f(0,1,0),
+                                        vec3f(0.f)));
+    model.meshes.push_back(makeTriangle(vec3f(0,0,0),vec3f(10,0,0),vec3f(0,10,0),
+                                        vec3f(5.f)));
+    model.meshes.push_back(makeTriangle(vec3f(0,0,1),vec3f(1,0,1),vec3f(0,1,1),
+                                        vec3f(.1f,.2f,.3f)));
+    const LightList lightList = buildLightList(&model,{ light });
+    std::vector<float> powers;
+    for (auto &l : lightList.lights) powers.push_back(lightPower(l));
+    ok &= checkAliasTable(powers);
+    return ok;
+  }
+
+  static bool checkControllers()
+  {
+    bool ok = true;
+    ok &= checkResolutionController();
+    ok &= checkSampleCountController();
+    ok &= checkDenoiserScheduler();
+    return ok;
+  }
+
+  static bool checkDenoiser()
+  {
+    bool ok = true;
+    ok &= checkAtrousDenoiser();
+    ok &= checkHalfFloat();
+    return ok;
+  }
+
+  static bool checkTiles()
+  {
+    bool ok = true;
+    ok &= checkTileScheduler();
+    ok &= checkDenoiserTiling();
+    return ok;
+  }
+
+  struct NamedCheck {
+    const char *name;
+    bool      (*run)();
+  };
+
+  /*! each of these is a test of its own in ctest */
+  static const NamedCheck allChecks[] = {
+    { "sampling",    checkSampling     },
+    { "scene",       checkSceneTables  },
+    { "presplit",    checkPresplit     },
+    { "controllers", checkControllers  },
+    { "denoiser",    checkDenoiser     },
+    { "tiles",       checkTiles        },
+    { "mailbox",     checkMailbox      },
+    { "writer",      checkImageWriter  },
+    { "wavefront",   checkWavefrontQueues },
+  };
+
+  static void benchmarkWriter() { benchmarkImageWriter(); }
+
+  struct NamedBenchmark {
+    const char *name;
+    void      (*run)();
+  };
+
+  /*! timings, not checks: they only run with --benchmark, and never
+      under ctest */
+  static const NamedBenchmark allBenchmarks[] = {
+    { "writer",      benchmarkWriter   },
+  };
+
+  static int usage(const char *name)
+  {
+    std::cout << "usage: " << name << " [check ...]; checks are";
+    for (auto &check : allChecks) std::cout << " " << check.name;
+    std::cout << std::endl;
+    std::cout << "       " << name << " --benchmark [benchmark ...]; benchmarks are";
+    for (auto &benchmark : allBenchmarks) std::cout << " " << benchmark.name;
+    std::cout << std::endl;
+    return 2;
+  }
+
+  /*! runs the benchmarks named in av[first..ac) - all of them if none */
+  static int runBenchmarks(int first, int ac, char **av)
+  {
+    for (int i=first;i<ac;i++) {
+      bool known = false;
+      for (auto &benchmark : allBenchmarks)
+        known |= !strcmp(av[i],benchmark.name);
+      if (!known) return usage(av[0]);
+    }
+    for (auto &benchmark : allBenchmarks) {
+      bool wanted = (ac == first);
+      for (int i=first;i<ac;i++)
+        wanted |= !strcmp(av[i],benchmark.name);
+      if (wanted)
+        benchmark.run();
+    }
+    return 0;
+  }
+  
+  /*! runs the host-side checks - all of them, or the ones named on
+      the command line - and exits with 1 if any of them failed. none
+      of them needs a gpu, a display or a scene. with --benchmark
+      first, runs the benchmarks instead */
+  extern "C" int main(int ac, char **av)
+  {
+    const bool benchmark = ac > 1 && !strcmp(av[1],"--benchmark");
+    if (!benchmark)
+      for (int i=1;i<ac;i++) {
+        bool known = false;
+        for (auto &check : allChecks)
+          known |= !strcmp(av[i],check.name);
+        if (!known) return usage(av[0]);
+      }
+    try {
+      if (benchmark)
+        return runBenchmarks(2,ac,av);
+      bool ok = true;
+      for (auto &check : allChecks) {
+        bool wanted = (ac == 1);
+        for (int i=1;i<ac;i++)
+          wanted |= !strcmp(av[i],check.name);
+        if (wanted)
+          ok &= check.run();
+      }
+      std::cout << "#osc: " << (ok ? "all checks OK" : "some checks FAILED") << std::endl;
+      return ok ? 0 : 1;
+    } catch (std::runtime_error& e) {
+      std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
+                << GDT_TERMINAL_DEFAULT << std::endl;
+      return 1;
+    }
+  }
+  
+} // ::opz
@@ -19,28 +19,40 @@
 #include <cuda_runtime.h>
 
 #include "LaunchParams.h"
-#include "gdt/random/random.h"
+#include "Sampling.h"
+#include "gdt/random/sampler.h"
 
 using namespace opz;
 
-#define NUM_LIGHT_SAMPLES 4
-
 namespace opz {
 
-  typedef gdt::LCG<16> Random;
+  typedef gdt::OwenSobolSampler Random;
   
   /*! launch parameters in constant memory, filled in by optix upon
       optixLaunch (this gets filled in from the buffer we pass to
       optixLaunch) */
   extern "C" __constant__ LaunchParams optixLaunchParams;
 
-  /*! per-ray data now captures random number generator, so programs
-      can access RNG state */
+  /*! what a radiance ray reports back to whoever traced it */
+  struct PathVertex {
+    /*! light arriving along the ray: direct light at a hit (plus, in
+        recursive mode, everything further down the path), or the
+        background on a miss */
+    vec3f radiance;
+    vec3f Ns;
+    vec3f albedo;
+    vec3f Ng;
+    /*! hit distance along the ray; negative on a miss */
+    float t;
+  };
+
+  /*! per-ray data now captures the sampler, so programs can draw the
+      next dimensions of the path's sample */
   struct PRD {
-    Random random;
-    vec3f  pixelColor;
-    vec3f  pixelNormal;
-    vec3f  pixelAlbedo;
+    Random     random;
+    PathVertex vertex;
+    /*! number of bounces before this ray */
+    int        depth;
   };
   
   static __forceinline__ __device__
@@ -66,6 +78,185 @@ namespace opz {
     const uint32_t u1 = optixGetPayload_1();
     return reinterpret_cast<T*>( unpackPointer( u0, u1 ) );
   }
+
+  //------------------------------------------------------------------------------
+  // payload access. with USE_REGISTER_PAYLOAD, everything a ray
+  // carries lives directly in payload registers:
+  //
+  //   radiance: p0 = sample index (input), p1..3 = radiance, p4..6 =
+  //             shading normal, p7..9 = albedo, p10 = hit distance,
+  //             p11..13 = geometry normal, p14 = path depth (input),
+  //             p15 = sampler seed
+  //   shadow  : p0 = visibility (0 or 1)
+  //
+  // otherwise, p0/p1 hold a pointer to a PRD on the raygen's stack
+  // (the old scheme, kept for comparison). hit and miss programs only
+  // ever go through these helpers, so they don't care which one it is
+  //------------------------------------------------------------------------------
+
+  static __forceinline__ __device__ uint32_t asUint(float f) { return __float_as_uint(f); }
+  static __forceinline__ __device__ float    asFloat(uint32_t u) { return __uint_as_float(u); }
+
+#if USE_REGISTER_PAYLOAD
+  static __forceinline__ __device__ Random loadRandom()
+  {
+    Random random;
+    random.index = optixGetPayload_0();
+    random.seed  = optixGetPayload_15();
+    return random;
+  }
+
+  static __forceinline__ __device__ void storeRandom(const Random &random)
+  { optixSetPayload_15(random.seed); }
+
+  static __forceinline__ __device__ int loadDepth()
+  { return (int)optixGetPayload_14(); }
+
+  static __forceinline__ __device__ void storeVertex(const PathVertex &vertex)
+  {
+    optixSetPayload_1(asUint(vertex.radiance.x));
+    optixSetPayload_2(asUint(vertex.radiance.y));
+    optixSetPayload_3(asUint(vertex.radiance.z));
+    optixSetPayload_4(asUint(vertex.Ns.x));
+    optixSetPayload_5(asUint(vertex.Ns.y));
+    optixSetPayload_6(asUint(vertex.Ns.z));
+    optixSetPayload_7(asUint(vertex.albedo.x));
+    optixSetPayload_8(asUint(vertex.albedo.y));
+    optixSetPayload_9(asUint(vertex.albedo.z));
+    optixSetPayload_10(asUint(vertex.t));
+    optixSetPayload_11(asUint(vertex.Ng.x));
+    optixSetPayload_12(asUint(vertex.Ng.y));
+    optixSetPayload_13(asUint(vertex.Ng.z));
+  }
+
+  static __forceinline__ __device__ void storeBackground(const vec3f &color)
+  {
+    optixSetPayload_1(asUint(color.x));
+    optixSetPayload_2(asUint(color.y));
+    optixSetPayload_3(asUint(color.z));
+    optixSetPayload_10(asUint(-1.f));
+  }
+
+  static __forceinline__ __device__ void storeShadowVisible()
+  { optixSetPayload_0(1u); }
+#else
+  static __forceinline__ __device__ Random loadRandom()
+  { return getPRD<PRD>()->random; }
+
+  static __forceinline__ __device__ void storeRandom(const Random &random)
+  { getPRD<PRD>()->random = random; }
+
+  static __forceinline__ __device__ int loadDepth()
+  { return getPRD<PRD>()->depth; }
+
+  static __forceinline__ __device__ void storeVertex(const PathVertex &vertex)
+  { getPRD<PRD>()->vertex = vertex; }
+
+  static __forceinline__ __device__ void storeBackground(const vec3f &color)
+  {
+    PRD &prd = *getPRD<PRD>();
+    prd.vertex.radiance = color;
+    prd.vertex.t        = -1.f;
+  }
+
+  static __forceinline__ __device__ void storeShadowVisible()
+  { *getPRD<float>() = 1.f; }
+#endif
+
+  /*! trace a shadow ray, and return whether the segment is unoccluded */
+  static __forceinline__ __device__ float traceShadowRay(const vec3f &org,
+                                                         const vec3f &dir,
+                                                         float tmin,
+                                                         float tmax)
+  {
+#if USE_REGISTER_PAYLOAD
+    uint32_t visible = 0u;
+#else
+    float visibility = 0.f;
+    // the values we store the PRD pointer in:
+    uint32_t u0, u1;
+    packPointer( &visibility, u0, u1 );
+#endif
+    optixTrace(optixLaunchParams.traversable,
+               org,
+               dir,
+               tmin,
+               tmax,
+               0.0f,       // rayTime
+               OptixVisibilityMask( 255 ),
+               // For shadow rays: skip any/closest hit shaders and terminate on first
+               // intersection with anything. The miss shader is used to mark if the
+               // light was visible.
+               OPTIX_RAY_FLAG_DISABLE_ANYHIT
+               | OPTIX_RAY_FLAG_TERMINATE_ON_FIRST_HIT
+               | OPTIX_RAY_FLAG_DISABLE_CLOSESTHIT,
+               SHADOW_RAY_TYPE,            // SBT offset
+               RAY_TYPE_COUNT,               // SBT stride
+               SHADOW_RAY_TYPE,            // missSBTIndex 
+#if USE_REGISTER_PAYLOAD
+               visible );
+    return visible ? 1.f : 0.f;
+#else
+               u0, u1 );
+    return visibility;
+#endif
+  }
+
+  /*! trace a radiance ray, advancing the given RNG, and return the
+      path vertex the hit (or miss) program produced; 'depth' is the
+      number of bounces before this ray */
+  static __forceinline__ __device__ void traceRadianceRay(const vec3f &org,
+                                                          const vec3f &dir,
+                                                          Random &random,
+                                                          int depth,
+                                                          PathVertex &vertex)
+  {
+#if USE_REGISTER_PAYLOAD
+    uint32_t p0 = random.index;
+    uint32_t p1 = 0u, p2 = 0u, p3 = 0u;
+    uint32_t p4 = 0u, p5 = 0u, p6 = 0u;
+    uint32_t p7 = 0u, p8 = 0u, p9 = 0u;
+    uint32_t p10 = asUint(-1.f), p11 = 0u, p12 = 0u, p13 = 0u;
+    uint32_t p14 = (uint32_t)depth, p15 = random.seed;
+#else
+    PRD prd;
+    prd.random          = random;
+    prd.vertex.radiance = vec3f(0.f);
+    prd.vertex.Ns       = vec3f(0.f);
+    prd.vertex.albedo   = vec3f(0.f);
+    prd.vertex.Ng       = vec3f(0.f);
+    prd.vertex.t        = -1.f;
+    prd.depth           = depth;
+    // the values we store the PRD pointer in:
+    uint32_t u0, u1;
+    packPointer( &prd, u0, u1 );
+#endif
+    optixTrace(optixLaunchParams.traversable,
+               org,
+               dir,
+               0.f,    // tmin
+               1e20f,  // tmax
+               0.0f,   // rayTime
+               OptixVisibilityMask( 255 ),
+               OPTIX_RAY_FLAG_DISABLE_ANYHIT,//OPTIX_RAY_FLAG_NONE,
+               RADIANCE_RAY_TYPE,            // SBT offset
+               RAY_TYPE_COUNT,               // SBT stride
+               RADIANCE_RAY_TYPE,            // missSBTIndex 
+#if USE_REGISTER_PAYLOAD
+               p0, p1, p2, p3, p4, p5, p6, p7, p8, p9,
+               p10, p11, p12, p13, p14, p15 );
+    random.seed     = p15;
+    vertex.radiance = vec3f(asFloat(p1),asFloat(p2),asFloat(p3));
+    vertex.Ns       = vec3f(asFloat(p4),asFloat(p5),asFloat(p6));
+    vertex.albedo   = vec3f(asFloat(p7),asFloat(p8),asFloat(p9));
+    vertex.t        = asFloat(p10);
+    vertex.Ng       = vec3f(asFloat(p11),asFloat(p12),asFloat(p13));
+#else
+               u0, u1 );
+    random = prd.random;
+    vertex = prd.vertex;
+#endif
+  }
   
   //------------------------------------------------------------------------------
   // closest hit and anyhit programs for radiance-type rays.
@@ -82,39 +273,45 @@ namespace opz {
     /* not going to be used ... */
   }
   
-  extern "C" __global__ void __closesthit__radiance()
-  {
-    const TriangleMeshSBTData &sbtData
-      = *(const TriangleMeshSBTData*)optixGetSbtDataPointer();
-    PRD &prd = *getPRD<PRD>();
+  /*! everything shading needs to know about a hit point, with both
+      normals already face-forwarded and normalized */
+  struct SurfaceHit {
+    vec3f pos;
+    vec3f Ng;
+    vec3f Ns;
+    vec3f diffuseColor;
+  };
 
-    // ------------------------------------------------------------------
-    // gather some basic hit information
-    // ------------------------------------------------------------------
-    const int   primID = optixGetPrimitiveIndex();
-    const vec3i index  = sbtData.index[primID];
-    const float u = optixGetTriangleBarycentrics().x;
-    const float v = optixGetTriangleBarycentrics().y;
+  /*! reconstruct the hit point on the given triangle; compiled once
+      per material feature set, so that each variant only contains the
+      code (and memory loads) it actually needs */
+  template<bool shadingNormals, bool diffuseTexture>
+  static __forceinline__ __device__
+  SurfaceHit evalSurface(const MeshData &mesh,
+                         const MaterialData &material,
+                         int primID, float u, float v,
+                         const vec3f &rayDir)
+  {
+    SurfaceHit surf;
+    const vec3i index  = mesh.index[primID];
 
     // ------------------------------------------------------------------
     // compute normal, using either shading normal (if avail), or
     // geometry normal (fallback)
     // ------------------------------------------------------------------
-    const vec3f &A     = sbtData.vertex[index.x];
-    const vec3f &B     = sbtData.vertex[index.y];
-    const vec3f &C     = sbtData.vertex[index.z];
+    const vec3f &A     = mesh.vertex[index.x];
+    const vec3f &B     = mesh.vertex[index.y];
+    const vec3f &C     = mesh.vertex[index.z];
     vec3f Ng = cross(B-A,C-A);
-    vec3f Ns = (sbtData.normal)
-      ? ((1.f-u-v) * sbtData.normal[index.x]
-         +       u * sbtData.normal[index.y]
-         +       v * sbtData.normal[index.z])
+    vec3f Ns = shadingNormals
+      ? ((1.f-u-v) * mesh.normal[index.x]
+         +       u * mesh.normal[index.y]
+         +       v * mesh.normal[index.z])
       : Ng;
     
     // ------------------------------------------------------------------
     // face-forward and normalize normals
     // ------------------------------------------------------------------
-    const vec3f rayDir = optixGetWorldRayDirection();
-    
     if (dot(rayDir,Ng) > 0.f) Ng = -Ng;
     Ng = normalize(Ng);
     
@@ -126,74 +323,314 @@ namespace opz {
     // compute diffuse material color, including diffuse texture, if
     // available
     // ------------------------------------------------------------------
-    vec3f diffuseColor = sbtData.color;
-    if (sbtData.hasTexture && sbtData.texcoord) {
+    vec3f diffuseColor = material.diffuseColor;
+    if (diffuseTexture) {
       const vec2f tc
-        = (1.f-u-v) * sbtData.texcoord[index.x]
-        +         u * sbtData.texcoord[index.y]
-        +         v * sbtData.texcoord[index.z];
+        = (1.f-u-v) * mesh.texcoord[index.x]
+        +         u * mesh.texcoord[index.y]
+        +         v * mesh.texcoord[index.z];
       
-      vec4f fromTexture = tex2D<float4>(sbtData.texture,tc.x,tc.y);
+      vec4f fromTexture = tex2D<float4>(material.diffuseTexture,tc.x,tc.y);
       diffuseColor *= (vec3f)fromTexture;
     }
 
-    // start with some ambient term
-    vec3f pixelColor = (0.1f + 0.2f*fabsf(dot(Ns,rayDir)))*diffuseColor;
+    surf.pos = (1.f-u-v) * A + u * B + v * C;
+    surf.Ng  = Ng;
+    surf.Ns  = Ns;
+    surf.diffuseColor = diffuseColor;
+    return surf;
+  }
+
+  /*! evalSurface, with the feature set picked at runtime */
+  static __forceinline__ __device__
+  SurfaceHit evalSurfaceDynamic(const MeshData &mesh,
+                                const MaterialData &material,
+                                int primID, float u, float v,
+                                const vec3f &rayDir)
+  {
+    const bool hasNormals = mesh.normal != nullptr;
+    const bool hasTexture = material.diffuseTexture && mesh.texcoord;
+    if (hasNormals) {
+      if (hasTexture) return evalSurface<true,true>(mesh,material,primID,u,v,rayDir);
+      else            return evalSurface<true,false>(mesh,material,primID,u,v,rayDir);
+    } else {
+      if (hasTexture) return evalSurface<false,true>(mesh,material,primID,u,v,rayDir);
+      else            return evalSurface<false,false>(mesh,material,primID,u,v,rayDir);
+    }
+  }
+
+  /*! the constant-ish ambient term that stands in for all indirect
+      light the path doesn't trace any more */
+  static __forceinline__ __device__
+  vec3f ambientTerm(const vec3f &Ns, const vec3f &albedo, const vec3f &rayDir)
+  {
+    return (0.1f + 0.2f*fabsf(dot(Ns,rayDir)))*albedo;
+  }
+
+  /*! pick one light by power, and a point on it; returns false if it
+      is behind the surface (or faces away), else the direction and
+      distance to it, and the solid-angle pdf of the whole choice */
+  static __forceinline__ __device__
+  bool pickLight(const vec3f &P, Random &random,
+                 int &lightID, LightSample &sample)
+  {
+    const auto &lights = optixLaunchParams.lights;
+    if (lights.numLights == 0) return false;
+    float pmf;
+    lightID = sampleAliasTable(lights.aliasTable,lights.numLights,random(),pmf);
+    const LightData &light = lights.lights[lightID];
+    const vec2f u = random.next2D();
+    if (!sampleAreaLight(light.origin,light.e1,light.e2,light.isTriangle,
+                         P,u.x,u.y,sample))
+      return false;
+    sample.pdf *= pmf;
+    return true;
+  }
+
+  /*! solid-angle pdf with which pickLight would have sampled 'dir'
+      towards the given light */
+  static __forceinline__ __device__
+  float pickLightPdf(int lightID, const vec3f &P, const vec3f &dir)
+  {
+    const auto &lights = optixLaunchParams.lights;
+    const LightData &light = lights.lights[lightID];
+    float dist;
+    return lights.aliasTable[lightID].pmf
+      * areaLightPdf(light.origin,light.e1,light.e2,light.isTriangle,P,dir,dist);
+  }
+
+  /*! trace an extend ray and return which light (if any) it sees
+      first: an emissive triangle in the scene, or - since those aren't
+      geometry - one of the quad lights in front of that */
+  static __forceinline__ __device__
+  int firstLightAlong(const vec3f &org, const vec3f &dir)
+  {
+    uint32_t meshID = (uint32_t)-1, primID = 0u, u = 0u, v = 0u;
+    optixTrace(optixLaunchParams.traversable,
+               org,
+               dir,
+               0.f,    // tmin
+               1e20f,  // tmax
+               0.0f,   // rayTime
+               OptixVisibilityMask( 255 ),
+               OPTIX_RAY_FLAG_DISABLE_ANYHIT,
+               EXTEND_RAY_TYPE,              // SBT offset
+               RAY_TYPE_COUNT,               // SBT stride
+               EXTEND_RAY_TYPE,              // missSBTIndex 
+               meshID, primID, u, v );
+
+    const auto &lights = optixLaunchParams.lights;
+    int   lightID = -1;
+    float hitDist = 1e20f;
+    if ((int)meshID >= 0) {
+      const MeshData &mesh = optixLaunchParams.meshes[meshID];
+      const vec3i index = mesh.index[primID];
+      const float b1 = asFloat(u), b2 = asFloat(v);
+      const vec3f hitPos
+        = (1.f-b1-b2) * mesh.vertex[index.x]
+        +          b1 * mesh.vertex[index.y]
+        +          b2 * mesh.vertex[index.z];
+      hitDist = dot(hitPos-org,dir);
+      if (mesh.firstLightID >= 0) lightID = mesh.firstLightID + (int)primID;
+    }
+    for (int quadID=0;quadID<lights.numQuadLights;quadID++) {
+      const LightData &quad = lights.lights[quadID];
+      float quadDist;
+      if (areaLightPdf(quad.origin,quad.e1,quad.e2,false,org,dir,quadDist) > 0.f
+          && quadDist < hitDist) {
+        hitDist = quadDist;
+        lightID = quadID;
+      }
+    }
+    return lightID;
+  }
+
+  /*! pick a light and a point on it; returns false if it is behind
+      the surface (or faces away), else the shadow ray to trace, and
+      what it contributes (one of numLightSamples, light sampling
+      only) if unoccluded */
+  static __forceinline__ __device__
+  bool sampleLight(const SurfaceHit &surf, Random &random, int numLightSamples,
+                   vec3f &lightDir, float &lightDist, vec3f &contribution)
+  {
+    int lightID;
+    LightSample sample;
+    if (!pickLight(surf.pos,random,lightID,sample)) return false;
+    const float cosTheta = dot(sample.dir,surf.Ns);
+    if (cosTheta <= 0.f) return false;
     
-    // ------------------------------------------------------------------
-    // compute shadow
-    // ------------------------------------------------------------------
-    const vec3f surfPos
-      = (1.f-u-v) * sbtData.vertex[index.x]
-      +         u * sbtData.vertex[index.y]
-      +         v * sbtData.vertex[index.z];
+    lightDir  = sample.dir;
+    lightDist = sample.dist;
+    contribution
+      = diffuseBrdf(surf.diffuseColor)
+      * optixLaunchParams.lights.lights[lightID].radiance
+      * (cosTheta / (sample.pdf*numLightSamples));
+    return true;
+  }
 
-    const int numLightSamples = NUM_LIGHT_SAMPLES;
-    for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
-      // produce random light sample
-      const vec3f lightPos
-        = optixLaunchParams.light.origin
-        + prd.random() * optixLaunchParams.light.du
-        + prd.random() * optixLaunchParams.light.dv;
-      vec3f lightDir = lightPos - surfPos;
-      float lightDist = gdt::length(lightDir);
-      lightDir = normalize(lightDir);
+  /*! light arriving at the surface directly from any of the lights;
+      each shadow ray goes to a single light picked by power, so the
+      cost doesn't depend on how many there are. with mis, every light
+      sample is paired with a brdf sample that may hit a light as
+      well, and both get power heuristic weights - light sampling wins
+      for small, far lights, brdf sampling for large or close ones */
+  static __forceinline__ __device__
+  vec3f directLight(const SurfaceHit &surf, Random &random)
+  {
+    const auto  &lights    = optixLaunchParams.lights;
+    const bool   mis       = optixLaunchParams.misEnabled;
+    const vec3f  brdf      = diffuseBrdf(surf.diffuseColor);
+    const vec3f  shadowOrg = surf.pos + 1e-3f * surf.Ng;
+    const int    numLightSamples = NUM_LIGHT_SAMPLES;
     
-      // trace shadow ray:
-      const float NdotL = dot(lightDir,Ns);
-      if (NdotL >= 0.f) {
-        vec3f lightVisibility = 0.f;
-        // the values we store the PRD pointer in:
-        uint32_t u0, u1;
-        packPointer( &lightVisibility, u0, u1 );
-        optixTrace(optixLaunchParams.traversable,
-                   surfPos + 1e-3f * Ng,
-                   lightDir,
-                   1e-3f,      // tmin
-                   lightDist * (1.f-1e-3f),  // tmax
-                   0.0f,       // rayTime
-                   OptixVisibilityMask( 255 ),
-                   // For shadow rays: skip any/closest hit shaders and terminate on first
-                   // intersection with anything. The miss shader is used to mark if the
-                   // light was visible.
-                   OPTIX_RAY_FLAG_DISABLE_ANYHIT
-                   | OPTIX_RAY_FLAG_TERMINATE_ON_FIRST_HIT
-                   | OPTIX_RAY_FLAG_DISABLE_CLOSESTHIT,
-                   SHADOW_RAY_TYPE,            // SBT offset
-                   RAY_TYPE_COUNT,               // SBT stride
-                   SHADOW_RAY_TYPE,            // missSBTIndex 
-                   u0, u1 );
-        pixelColor
-          += lightVisibility
-          *  optixLaunchParams.light.power
-          *  diffuseColor
-          *  (NdotL / (lightDist*lightDist*numLightSamples));
+    vec3f radiance = 0.f;
+    for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
+      // sample the lights ...
+      int lightID;
+      LightSample sample;
+      if (pickLight(surf.pos,random,lightID,sample)) {
+        const float cosTheta = dot(sample.dir,surf.Ns);
+        if (cosTheta > 0.f) {
+          const float weight
+            = mis
+            ? powerHeuristic(sample.pdf,cosineHemispherePdf(surf.Ns,sample.dir))
+            : 1.f;
+          const float lightVisibility
+            = traceShadowRay(shadowOrg,sample.dir,
+                             1e-3f,                      // tmin
+                             sample.dist * (1.f-1e-3f)); // tmax
+          radiance
+            += (lightVisibility * weight * cosTheta / sample.pdf)
+            *  brdf * lights.lights[lightID].radiance;
+        }
+      }
+      if (!mis || lights.numLights == 0) continue;
+
+      // ... and the brdf
+      const vec2f u = random.next2D();
+      const vec3f dir = sampleCosineHemisphere(surf.Ns,u.x,u.y);
+      const int hitLightID = firstLightAlong(shadowOrg,dir);
+      if (hitLightID >= 0) {
+        const float lightPdf = pickLightPdf(hitLightID,surf.pos,dir);
+        if (lightPdf > 0.f) {
+          const float weight
+            = powerHeuristic(cosineHemispherePdf(surf.Ns,dir),lightPdf);
+          // brdf*cos/pdf of a cosine-sampled diffuse bounce is the albedo
+          radiance += weight * surf.diffuseColor * lights.lights[hitLightID].radiance;
+        }
       }
     }
+    return radiance * (1.f/numLightSamples);
+  }
 
-    prd.pixelNormal = Ns;
-    prd.pixelAlbedo = diffuseColor;
-    prd.pixelColor = pixelColor;
+  /*! russian roulette: from path.rouletteDepth on, kill the path with
+      a probability that grows as its throughput drops, and reweight
+      survivors so the estimate stays unbiased */
+  static __forceinline__ __device__
+  bool survivesRoulette(int depth, vec3f &throughput, Random &random)
+  {
+    if (depth < optixLaunchParams.path.rouletteDepth) return true;
+    const float survival = min(.95f,reduce_max(throughput));
+    if (random() >= survival) return false;
+    throughput *= 1.f/survival;
+    return true;
+  }
+
+  /*! recursive mode only: continue the path from inside the closest
+      hit program, by tracing the next bounce from right here */
+  static __forceinline__ __device__
+  vec3f recursiveBounce(const SurfaceHit &surf, const vec3f &rayDir,
+                        Random &random, int depth)
+  {
+    if (depth+1 >= optixLaunchParams.path.maxDepth)
+      return ambientTerm(surf.Ns,surf.diffuseColor,rayDir);
+    vec3f throughput = surf.diffuseColor;
+    if (!survivesRoulette(depth,throughput,random))
+      return vec3f(0.f);
+    const vec2f u = random.next2D();
+    PathVertex next;
+    traceRadianceRay(surf.pos + 1e-3f * surf.Ng,
+                     sampleCosineHemisphere(surf.Ns,u.x,u.y),
+                     random,depth+1,next);
+    return throughput * next.radiance;
+  }
+
+  /*! the actual radiance shading code, run from the closest hit
+      program of the given material feature set. only does direct
+      light, and reports the surface back so that raygen can continue
+      the path */
+  template<bool shadingNormals, bool diffuseTexture>
+  static __forceinline__ __device__ void shadeRadiance()
+  {
+    const HitgroupData &hitData
+      = *(const HitgroupData*)optixGetSbtDataPointer();
+    const MeshData     &mesh     = optixLaunchParams.meshes[hitData.meshID];
+    const MaterialData &material = optixLaunchParams.materials[mesh.materialID];
+    Random random = loadRandom();
+
+    // ------------------------------------------------------------------
+    // gather some basic hit information
+    // ------------------------------------------------------------------
+    const int   primID = optixGetPrimitiveIndex();
+    const float u = optixGetTriangleBarycentrics().x;
+    const float v = optixGetTriangleBarycentrics().y;
+    const vec3f rayDir = optixGetWorldRayDirection();
+
+    const SurfaceHit surf
+      = evalSurface<shadingNormals,diffuseTexture>(mesh,material,primID,u,v,rayDir);
+
+    PathVertex vertex;
+    const int depth = loadDepth();
+    vertex.radiance = directLight(surf,random);
+    // emitters only show up where nothing else accounts for them
+    // already, ie, where a camera ray hits them directly
+    if (depth == 0)
+      vertex.radiance += material.emission;
+    vertex.Ns       = surf.Ns;
+    vertex.albedo   = surf.diffuseColor;
+    vertex.Ng       = surf.Ng;
+    vertex.t        = optixGetRayTmax();
+    if (optixLaunchParams.path.recursive)
+      vertex.radiance += recursiveBounce(surf,rayDir,random,depth);
+
+    storeRandom(random);
+    storeVertex(vertex);
+  }
+
+  //------------------------------------------------------------------------------
+  // one closest hit program per material feature set; buildSBT picks
+  // the right one for each mesh
+  //------------------------------------------------------------------------------
+
+  extern "C" __global__ void __closesthit__radiance()
+  { shadeRadiance<false,false>(); }
+
+  extern "C" __global__ void __closesthit__radiance_normals()
+  { shadeRadiance<true,false>(); }
+
+  extern "C" __global__ void __closesthit__radiance_texture()
+  { shadeRadiance<false,true>(); }
+
+  extern "C" __global__ void __closesthit__radiance_normals_texture()
+  { shadeRadiance<true,true>(); }
+
+  /*! general version that decides at runtime, for comparison against
+      the specialized ones */
+  extern "C" __global__ void __closesthit__radiance_dynamic()
+  {
+    const HitgroupData &hitData
+      = *(const HitgroupData*)optixGetSbtDataPointer();
+    const MeshData     &mesh     = optixLaunchParams.meshes[hitData.meshID];
+    const MaterialData &material = optixLaunchParams.materials[mesh.materialID];
+    const bool hasNormals = mesh.normal != nullptr;
+    const bool hasTexture = material.diffuseTexture && mesh.texcoord;
+    if (hasNormals) {
+      if (hasTexture) shadeRadiance<true,true>();
+      else            shadeRadiance<true,false>();
+    } else {
+      if (hasTexture) shadeRadiance<false,true>();
+      else            shadeRadiance<false,false>();
+    }
   }
   
   extern "C" __global__ void __anyhit__radiance()
@@ -212,16 +649,249 @@ namespace opz {
   
   extern "C" __global__ void __miss__radiance()
   {
-    PRD &prd = *getPRD<PRD>();
     // set to constant white as background color
-    prd.pixelColor = vec3f(1.f);
+    storeBackground(vec3f(1.f));
   }
 
   extern "C" __global__ void __miss__shadow()
   {
     // we didn't hit anything, so the light is visible
-    vec3f &prd = *(vec3f*)getPRD<vec3f>();
-    prd = vec3f(1.f);
+    storeShadowVisible();
+  }
+
+  //------------------------------------------------------------------------------
+  // extend rays (wavefront mode only) - just report what they hit
+  //------------------------------------------------------------------------------
+
+  extern "C" __global__ void __closesthit__extend()
+  {
+    const HitgroupData &hitData
+      = *(const HitgroupData*)optixGetSbtDataPointer();
+    optixSetPayload_0((uint32_t)hitData.meshID);
+    optixSetPayload_1((uint32_t)optixGetPrimitiveIndex());
+    optixSetPayload_2(asUint(optixGetTriangleBarycentrics().x));
+    optixSetPayload_3(asUint(optixGetTriangleBarycentrics().y));
+  }
+
+  extern "C" __global__ void __miss__extend()
+  {
+    optixSetPayload_0((uint32_t)-1);
+  }
+
+  /*! set up the sampler for pixel (ix,iy)'s sample 'sampleIndex',
+      which keeps counting up across accumulated frames */
+  static __forceinline__ __device__
+  void initPixelSampler(Random &random, int ix, int iy, uint32_t sampleIndex)
+  {
+    const auto &frame = optixLaunchParams.frame;
+    const int numPixelSamples = optixLaunchParams.numPixelSamples;
+    if (optixLaunchParams.sampler == SAMPLER_BLUE_NOISE)
+      random.initBlueNoise(vec2i(ix,iy),frame.size,sampleIndex,numPixelSamples);
+    else
+      random.initPixel(ix+frame.size.x*iy,sampleIndex);
+  }
+
+  /*! jittered primary ray direction through pixel (ix,iy) */
+  static __forceinline__ __device__
+  vec3f cameraRayDir(int ix, int iy, Random &random)
+  {
+    const auto &camera = optixLaunchParams.camera;
+
+    // normalized screen plane position, in [0,1]^2
+
+    // iw: note for denoising that's not actually correct - if we
+    // assume that the camera should only(!) cover the denoised
+    // screen then the actual screen plane we shuld be using during
+    // rendreing is slightly larger than [0,1]^2
+    vec2f screen((vec2f(ix,iy)+random.next2D())
+                 / vec2f(optixLaunchParams.frame.size));
+      
+    // generate ray direction
+    return normalize(camera.direction
+                     + (screen.x - 0.5f) * camera.horizontal
+                     + (screen.y - 0.5f) * camera.vertical);
+  }
+
+  /*! atomically add to one of the wavefront per-pixel sums */
+  static __forceinline__ __device__
+  void addToPixel(float4 *sum, int pixelID, const vec3f &v)
+  {
+    atomicAdd(&sum[pixelID].x,v.x);
+    atomicAdd(&sum[pixelID].y,v.y);
+    atomicAdd(&sum[pixelID].z,v.z);
+  }
+
+  //------------------------------------------------------------------------------
+  // wavefront mode: instead of one megakernel per pixel, each stage
+  // below is its own launch over the queue written by the previous
+  // one. the host sorts the hit queue by material between 'extend'
+  // and 'shade', so neighboring threads run the same shading code
+  //------------------------------------------------------------------------------
+
+  /*! stage 1: one thread per pixel of the batch, writing
+      numPixelSamples camera rays */
+  extern "C" __global__ void __raygen__wfGenerate()
+  {
+    const WavefrontQueues &wf = optixLaunchParams.wavefront;
+    const int batchPixelID = optixGetLaunchIndex().x;
+    const int pixelID = wf.firstPixel+batchPixelID;
+    const int ix = pixelID % optixLaunchParams.frame.size.x;
+    const int iy = pixelID / optixLaunchParams.frame.size.x;
+    const int numPixelSamples = optixLaunchParams.numPixelSamples;
+
+    for (int sampleID=0;sampleID<numPixelSamples;sampleID++) {
+      const int rayID = batchPixelID*numPixelSamples+sampleID;
+      // every ray gets its own sequence, since it gets shaded in a
+      // different thread than the one that generated it
+      Random random;
+      initPixelSampler(random,ix,iy,
+                       optixLaunchParams.frame.firstSampleIndex+sampleID);
+
+      WavefrontRay ray;
+      ray.origin    = optixLaunchParams.camera.position;
+      ray.direction = cameraRayDir(ix,iy,random);
+      ray.pixelID   = pixelID;
+      ray.rngIndex  = random.index;
+      ray.rngSeed   = random.seed;
+      wf.rays[rayID] = ray;
+    }
+  }
+
+  /*! stage 2: one thread per camera ray; misses go straight into the
+      pixel sums, hits get appended to the hit queue */
+  extern "C" __global__ void __raygen__wfExtend()
+  {
+    const int rayID = optixGetLaunchIndex().x;
+    const WavefrontQueues &wf = optixLaunchParams.wavefront;
+    const WavefrontRay ray = wf.rays[rayID];
+
+    uint32_t meshID = (uint32_t)-1, primID = 0u, u = 0u, v = 0u;
+    optixTrace(optixLaunchParams.traversable,
+               ray.origin,
+               ray.direction,
+               0.f,    // tmin
+               1e20f,  // tmax
+               0.0f,   // rayTime
+               OptixVisibilityMask( 255 ),
+               OPTIX_RAY_FLAG_DISABLE_ANYHIT,
+               EXTEND_RAY_TYPE,              // SBT offset
+               RAY_TYPE_COUNT,               // SBT stride
+               EXTEND_RAY_TYPE,              // missSBTIndex 
+               meshID, primID, u, v );
+
+    if ((int)meshID < 0) {
+      wf.hitFlags[rayID] = 0;
+      // constant white background, same as __miss__radiance
+      addToPixel(wf.colorSum,ray.pixelID,vec3f(1.f));
+      return;
+    }
+
+    wf.hitFlags[rayID] = 1;
+    WavefrontHit hit;
+    hit.rayDir   = ray.direction;
+    hit.pixelID  = ray.pixelID;
+    hit.meshID   = (int)meshID;
+    hit.primID   = (int)primID;
+    hit.u        = asFloat(u);
+    hit.v        = asFloat(v);
+    hit.rngIndex = ray.rngIndex;
+    hit.rngSeed  = ray.rngSeed;
+    wf.hits[atomicAdd(&wf.counters[WF_NUM_HITS],1)] = hit;
+  }
+
+  /*! stage 3: one thread per (material-sorted) hit; adds the ambient
+      term and the AOVs, and appends one shadow ray per light sample.
+      nothing gets re-enqueued, so this is the megakernel's last bounce
+      at maxDepth 1 (with light sampling only; no mis) - the wavefront
+      renderer ignores path.maxDepth */
+  extern "C" __global__ void __raygen__wfShade()
+  {
+    const int hitID = optixGetLaunchIndex().x;
+    const WavefrontQueues &wf = optixLaunchParams.wavefront;
+    if (hitID >= wf.counters[WF_NUM_HITS]) return;
+
+    const WavefrontHit hit = wf.sortedHits[hitID];
+    const MeshData     &mesh     = optixLaunchParams.meshes[hit.meshID];
+    const MaterialData &material = optixLaunchParams.materials[mesh.materialID];
+    const SurfaceHit surf
+      = evalSurfaceDynamic(mesh,material,hit.primID,hit.u,hit.v,hit.rayDir);
+
+    // (every wavefront hit is a camera ray hit, so emitters show up)
+    addToPixel(wf.colorSum, hit.pixelID,
+               material.emission
+               + ambientTerm(surf.Ns,surf.diffuseColor,hit.rayDir));
+    addToPixel(wf.normalSum,hit.pixelID,surf.Ns);
+    addToPixel(wf.albedoSum,hit.pixelID,surf.diffuseColor);
+
+    Random random;
+    random.index = hit.rngIndex;
+    random.seed  = hit.rngSeed;
+    const int numLightSamples = NUM_LIGHT_SAMPLES;
+    for (int lightSampleID=0;lightSampleID<numLightSamples;lightSampleID++) {
+      WavefrontShadowRay shadowRay;
+      float lightDist;
+      if (!sampleLight(surf,random,numLightSamples,
+                       shadowRay.direction,lightDist,shadowRay.contribution))
+        continue;
+      shadowRay.origin  = surf.pos + 1e-3f * surf.Ng;
+      shadowRay.tmax    = lightDist * (1.f-1e-3f);
+      shadowRay.pixelID = hit.pixelID;
+      wf.shadowRays[atomicAdd(&wf.counters[WF_NUM_SHADOW_RAYS],1)] = shadowRay;
+    }
+  }
+
+  /*! stage 4: one thread per queued shadow ray */
+  extern "C" __global__ void __raygen__wfConnect()
+  {
+    const int shadowRayID = optixGetLaunchIndex().x;
+    const WavefrontQueues &wf = optixLaunchParams.wavefront;
+    if (shadowRayID >= wf.counters[WF_NUM_SHADOW_RAYS]) return;
+
+    const WavefrontShadowRay shadowRay = wf.shadowRays[shadowRayID];
+    const float visibility
+      = traceShadowRay(shadowRay.origin,shadowRay.direction,1e-3f,shadowRay.tmax);
+    if (visibility > 0.f)
+      addToPixel(wf.colorSum,shadowRay.pixelID,visibility*shadowRay.contribution);
+  }
+
+  /*! iterative path tracer: every bounce returns to here, so the
+      trace depth never exceeds 2 (radiance ray, plus the shadow rays
+      its hit program traces), no matter how long the path gets.
+      returns the path's radiance, and the first hit's normal, albedo
+      (for the denoiser) and distance (negative on a miss) */
+  static __forceinline__ __device__
+  vec3f tracePath(vec3f org, vec3f dir, Random &random,
+                  vec3f &firstNormal, vec3f &firstAlbedo, float &firstT)
+  {
+    const int maxDepth = optixLaunchParams.path.maxDepth;
+    vec3f radiance   = 0.f;
+    vec3f throughput = 1.f;
+    firstNormal = 0.f;
+    firstAlbedo = 0.f;
+    firstT      = -1.f;
+    for (int depth=0;depth<maxDepth;depth++) {
+      PathVertex vertex;
+      traceRadianceRay(org,dir,random,depth,vertex);
+      if (depth == 0) {
+        firstNormal = vertex.Ns;
+        firstAlbedo = vertex.albedo;
+        firstT      = vertex.t;
+      }
+      radiance += throughput * vertex.radiance;
+      if (vertex.t < 0.f) break;
+
+      if (depth == maxDepth-1) {
+        radiance += throughput * ambientTerm(vertex.Ns,vertex.albedo,dir);
+        break;
+      }
+      throughput *= vertex.albedo;
+      if (!survivesRoulette(depth,throughput,random)) break;
+
+      org = org + vertex.t * dir + 1e-3f * vertex.Ng;
+      const vec2f u = random.next2D();
+      dir = sampleCosineHemisphere(vertex.Ns,u.x,u.y);
+    }
+    return radiance;
   }
 
   //------------------------------------------------------------------------------
@@ -230,62 +900,65 @@ namespace opz {
   extern "C" __global__ void __raygen__renderFrame()
   {
     // compute a test pattern based on pixel ID
-    const int ix = optixGetLaunchIndex().x;
-    const int iy = optixGetLaunchIndex().y;
+    const int ix = optixGetLaunchIndex().x + optixLaunchParams.frame.tileOrigin.x;
+    const int iy = optixGetLaunchIndex().y + optixLaunchParams.frame.tileOrigin.y;
     const auto &camera = optixLaunchParams.camera;
+    const auto &adaptive = optixLaunchParams.adaptive;
+    const int frameID = optixLaunchParams.frame.frameID;
+    const uint32_t fbIndex = ix+iy*optixLaunchParams.frame.size.x;
     
-    PRD prd;
-    prd.random.init(ix+optixLaunchParams.frame.size.x*iy,
-                    optixLaunchParams.frame.frameID);
-    prd.pixelColor = vec3f(0.f);
-
-    // the values we store the PRD pointer in:
-    uint32_t u0, u1;
-    packPointer( &prd, u0, u1 );
-
     int numPixelSamples = optixLaunchParams.numPixelSamples;
+    uint32_t firstSampleIndex = optixLaunchParams.frame.firstSampleIndex;
+
+    // in adaptive mode, the pixel's own statistics decide how many
+    // samples it takes - if any
+    vec4f stats(0.f);
+    if (adaptive.enabled) {
+      if (frameID > 0)
+        stats = vec4f(adaptive.statsBuffer[fbIndex]);
+      numPixelSamples = adaptiveSampleCount(stats,numPixelSamples,
+                                            adaptive.threshold,
+                                            adaptive.minSamples,
+                                            adaptive.maxScale);
+      firstSampleIndex = (uint32_t)stats.x;
+      stats.w = float(numPixelSamples);
+      if (numPixelSamples == 0) {
+        // converged: leave its color alone
+        adaptive.statsBuffer[fbIndex] = (float4)stats;
+        return;
+      }
+      atomicAdd(adaptive.activePixels,1);
+    }
 
     vec3f pixelColor = 0.f;
     vec3f pixelNormal = 0.f;
     vec3f pixelAlbedo = 0.f;
+    vec4f pixelPosition = 0.f;
     for (int sampleID=0;sampleID<numPixelSamples;sampleID++) {
-      // normalized screen plane position, in [0,1]^2
-
-      // iw: note for denoising that's not actually correct - if we
-      // assume that the camera should only(!) cover the denoised
-      // screen then the actual screen plane we shuld be using during
-      // rendreing is slightly larger than [0,1]^2
-      vec2f screen(vec2f(ix+prd.random(),iy+prd.random())
-                   / vec2f(optixLaunchParams.frame.size));
-      // screen
-      //   = screen
-      //   * vec2f(optixLaunchParams.frame.denoisedSize)
-      //   * vec2f(optixLaunchParams.frame.size)
-      //   - 0.5f*(vec2f(optixLaunchParams.frame.size)
-      //           -
-      //           vec2f(optixLaunchParams.frame.denoisedSize)
-      //           );
-      
-      // generate ray direction
-      vec3f rayDir = normalize(camera.direction
-                               + (screen.x - 0.5f) * camera.horizontal
-                               + (screen.y - 0.5f) * camera.vertical);
-
-      optixTrace(optixLaunchParams.traversable,
-                 camera.position,
-                 rayDir,
-                 0.f,    // tmin
-                 1e20f,  // tmax
-                 0.0f,   // rayTime
-                 OptixVisibilityMask( 255 ),
-                 OPTIX_RAY_FLAG_DISABLE_ANYHIT,//OPTIX_RAY_FLAG_NONE,
-                 RADIANCE_RAY_TYPE,            // SBT offset
-                 RAY_TYPE_COUNT,               // SBT stride
-                 RADIANCE_RAY_TYPE,            // missSBTIndex 
-                 u0, u1 );
-      pixelColor  += prd.pixelColor;
-      pixelNormal += prd.pixelNormal;
-      pixelAlbedo += prd.pixelAlbedo;
+      Random random;
+      initPixelSampler(random,ix,iy,firstSampleIndex+sampleID);
+      vec3f rayDir = cameraRayDir(ix,iy,random);
+
+      vec3f sampleColor, sampleNormal, sampleAlbedo;
+      float sampleT;
+      if (optixLaunchParams.path.recursive) {
+        // the hit programs do the whole path
+        PathVertex vertex;
+        traceRadianceRay(camera.position,rayDir,random,0,vertex);
+        sampleColor  = vertex.radiance;
+        sampleNormal = vertex.Ns;
+        sampleAlbedo = vertex.albedo;
+        sampleT      = vertex.t;
+      } else
+        sampleColor = tracePath(camera.position,rayDir,random,
+                                sampleNormal,sampleAlbedo,sampleT);
+      pixelColor  += sampleColor;
+      pixelNormal += sampleNormal;
+      pixelAlbedo += sampleAlbedo;
+      if (sampleT >= 0.f)
+        pixelPosition += vec4f(camera.position + sampleT*rayDir,1.f);
+      if (adaptive.enabled)
+        addPixelSample(stats,luminance(sampleColor));
     }
 
     vec4f rgba(pixelColor/numPixelSamples,1.f);
@@ -293,16 +966,46 @@ namespace opz {
     vec4f normal(pixelNormal/numPixelSamples,1.f);
 
     // and write/accumulate to frame buffer ...
-    const uint32_t fbIndex = ix+iy*optixLaunchParams.frame.size.x;
-    if (optixLaunchParams.frame.frameID > 0) {
-      rgba
-        += float(optixLaunchParams.frame.frameID)
-        *  vec4f(optixLaunchParams.frame.colorBuffer[fbIndex]);
-      rgba /= (optixLaunchParams.frame.frameID+1.f);
+    if (adaptive.enabled) {
+      // pixels took different numbers of samples, so weigh by those
+      const float oldCount = stats.x - numPixelSamples;
+      if (oldCount > 0.f)
+        rgba = (oldCount*vec4f(optixLaunchParams.frame.colorBuffer[fbIndex])
+                + vec4f(pixelColor,numPixelSamples)) / stats.x;
+      adaptive.statsBuffer[fbIndex] = (float4)stats;
+    } else {
+      // (after a camera move, the host reprojects the old history
+      // into this frame, so it needn't be firstSampleIndex samples
+      // long)
+      const float history
+        = frameID > 0 ? optixLaunchParams.frame.historyBuffer[fbIndex] : 0.f;
+      if (history > 0.f)
+        rgba = (history*vec4f(optixLaunchParams.frame.colorBuffer[fbIndex])
+                + vec4f(pixelColor,numPixelSamples)) / (history+numPixelSamples);
+      optixLaunchParams.frame.historyBuffer[fbIndex] = history+numPixelSamples;
+    }
+    if (pixelPosition.w > 0.f)
+      pixelPosition = vec4f(vec3f(pixelPosition)/pixelPosition.w,1.f);
+    optixLaunchParams.frame.positionBuffer[fbIndex] = (float4)pixelPosition;
+    if (optixLaunchParams.frame.motionBuffer) {
+      // motion of the first hit - or, if there's none, of the
+      // background through the pixel center - since motionCamera
+      const auto &size = optixLaunchParams.frame.size;
+      const vec3f d
+        = pixelPosition.w > 0.f
+        ? vec3f(pixelPosition) - optixLaunchParams.frame.motionCamera.position
+        : camera.direction
+        + ((ix+.5f)/size.x-.5f)*camera.horizontal
+        + ((iy+.5f)/size.y-.5f)*camera.vertical;
+      vec2f prevPixel;
+      const vec2f motion
+        = projectDirection(optixLaunchParams.frame.motionCamera,size,d,prevPixel)
+        ? vec2f(ix,iy) - prevPixel : vec2f(0.f);
+      optixLaunchParams.frame.motionBuffer[fbIndex] = (float2)motion;
     }
     optixLaunchParams.frame.colorBuffer[fbIndex] = (float4)rgba;
-    optixLaunchParams.frame.albedoBuffer[fbIndex] = (float4)albedo;
-    optixLaunchParams.frame.normalBuffer[fbIndex] = (float4)normal;
+    optixLaunchParams.frame.albedoBuffer.write(fbIndex,albedo);
+    optixLaunchParams.frame.normalBuffer.write(fbIndex,normal);
   }
   
 } // ::osc
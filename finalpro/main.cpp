@@ -16,6 +16,9 @@
 
 
 #include "SampleRenderer.h"
+#include "BVHAnalyzer.h"
+#include "InteropDisplay.h"
+#include "Mailbox.h"
 
 // our helper library for window handling
 #include "glfWindow/GLFWindow.h"
@@ -32,40 +35,72 @@ namespace opz {
     SampleWindow(const std::string &title,
                  const Model *model,
                  const Camera &camera,
-                 const QuadLight &light,
-                 const float worldScale)
+                 const std::vector<QuadLight> &quadLights,
+                 const float worldScale,
+                 const CompileConfig &compileConfig,
+                 bool useInterop = true)
       : GLFCameraWindow(title,camera.from,camera.at,camera.up,worldScale),
-        sample(model,light)
+        sample(model,quadLights,compileConfig)
     {
       sample.setCamera(camera);
       ImGui::CreateContext();     // Setup Dear ImGui context
       ImGui::StyleColorsDark();       // Setup Dear ImGui style
       ImGui_ImplGlfw_InitForOpenGL(handle, true);     // Setup Platform/Renderer backends
       ImGui_ImplOpenGL3_Init("#version 330");
+      // show frames straight from gl buffers the renderer writes, if
+      // cuda can get at them
+      if (useInterop) {
+        interop.reset(new InteropDisplay(MAX_FRAMES_IN_FLIGHT));
+        if (!interop->init()) interop.reset();
+      }
     }
     
-    virtual void render() override
+    /*! camera changes go to render() through the mailbox, so a
+        render thread never waits on the ui for them (nor the other
+        way around) */
+    virtual void postUpdates() override
     {
-      if (cameraFrame.modified) {
-        sample.setCamera(Camera{ cameraFrame.get_from(),
+      if (!cameraFrame.modified) return;
+      cameraMailbox.post(Camera{ cameraFrame.get_from(),
                                  cameraFrame.get_at(),
                                  cameraFrame.get_up() });
-        cameraFrame.modified = false;
-      }
+      cameraFrame.modified = false;
+    }
+
+    virtual void render() override
+    {
+      Camera camera;
+      if (cameraMailbox.take(camera))
+        sample.setCamera(camera);
       sample.render();
     }
     
     virtual void draw() override
     {
-      sample.downloadPixels(pixels.data());
       if (fbTexture == 0)
         glGenTextures(1, &fbTexture);
       
-      glBindTexture(GL_TEXTURE_2D, fbTexture);
-      GLenum texFormat = GL_RGBA;
-      GLenum texelType = GL_UNSIGNED_BYTE;
-      glTexImage2D(GL_TEXTURE_2D, 0, texFormat, fbSize.x, fbSize.y, 0, GL_RGBA,
-                   texelType, pixels.data());
+      // hold on to the newest frame while we upload it; a render
+      // thread doesn't get waited for - the last frame stays up
+      int frame;
+      {
+        auto lock = lockRender();
+        frame = sample.holdNewestFrame(!renderThread);
+      }
+      if (frame >= 0) {
+        if (interop)
+          // (the frame already is in one of the gl buffers)
+          interop->upload(frame,fbTexture,fbSize);
+        else {
+          glBindTexture(GL_TEXTURE_2D, fbTexture);
+          GLenum texFormat = GL_RGBA;
+          GLenum texelType = GL_UNSIGNED_BYTE;
+          glTexImage2D(GL_TEXTURE_2D, 0, texFormat, fbSize.x, fbSize.y, 0, GL_RGBA,
+                       texelType, sample.hostFramePixels(frame));
+        }
+        auto lock = lockRender();
+        sample.releaseFrame();
+      }
 
       glDisable(GL_LIGHTING);
       glColor3f(1, 1, 1);
@@ -112,13 +147,135 @@ namespace opz {
       ImGui::NewFrame();
 
       {
+          // (everything below may touch what render() uses)
+          auto lock = lockRender();
           ImGui::Begin("Main Panel");
 
           ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+          {
+            const double now = getCurrentTime();
+            if (now - renderRateTime >= .5) {
+              const long long rendered = numRendered;
+              renderRate         = float((rendered - renderRateCount)/(now - renderRateTime));
+              renderRateCount    = rendered;
+              renderRateTime     = now;
+            }
+            ImGui::Text("Rendering:     %.1f frames/s%s",renderRate,
+                        renderThread ? " (render thread)" : "");
+          }
           if (cameraFrameManip == flyModeManip)
               ImGui::Text("Current Mode:  Fly Mode");
           else if(cameraFrameManip == inspectModeManip)
               ImGui::Text("Current Mode:  Inspect Mode");
+          ImGui::Text("Hit Programs:  %s",
+                      sample.specializedHitPrograms ? "Specialized" : "Dynamic");
+          if (sample.hitProgramFrameTime[0] > 0.)
+            ImGui::Text("               %.2f ms/frame specialized, %.2f dynamic",
+                        1000.*sample.hitProgramFrameTime[1],
+                        1000.*sample.hitProgramFrameTime[0]);
+          ImGui::Text("Renderer:      %s",
+                      sample.wavefront ? "Wavefront" : "Megakernel");
+          ImGui::Text("Direct Light:  %s",
+                      sample.renderedMIS() ? "MIS" : "Light Sampling");
+          ImGui::Text("Display:       %s",
+                      interop ? "CUDA-GL Interop" : "Host Download");
+          ImGui::Text("Sampler:       %s",
+                      sample.launchParams.sampler == SAMPLER_BLUE_NOISE
+                      ? "Blue-Noise Sobol" : "Sobol");
+
+          ImGui::SliderInt("Frames In Flight",&sample.framesInFlight,
+                           1,MAX_FRAMES_IN_FLIGHT);
+          {
+            const auto &tracker = AllocationTracker::get();
+            ImGui::Text("Device Memory: %dMB in %d allocations, %d last frame",
+                        int(tracker.liveBytes>>20),
+                        int(tracker.numAllocs-tracker.numFrees),
+                        int(sample.allocsLastFrame));
+          }
+          {
+            bool halfAovs = sample.aovPrecision == AOV_PRECISION_HALF;
+            if (ImGui::Checkbox("Half Precision AOVs",&halfAovs))
+              sample.aovPrecision = halfAovs ? AOV_PRECISION_HALF : AOV_PRECISION_FLOAT;
+          }
+          if (sample.denoiserOn) {
+            const char *models[DENOISER_MODEL_COUNT] = { "LDR","HDR","Temporal" };
+            const char *backends[DENOISER_BACKEND_COUNT] = { "OptiX","CPU A-Trous" };
+            ImGui::Combo("Denoiser Backend",&sample.denoiserBackend,
+                         backends,DENOISER_BACKEND_COUNT);
+            if (sample.denoiserBackend == DENOISER_BACKEND_OPTIX)
+              ImGui::Combo("Denoiser",&sample.denoiserModel,models,DENOISER_MODEL_COUNT);
+            else
+              ImGui::SliderInt("A-Trous Passes",&sample.cpuDenoiser.numPasses,1,8);
+            auto &scheduler = sample.denoiserScheduler;
+            ImGui::SliderInt("Denoise Every",&scheduler.convergedInterval,0,64,
+                             scheduler.convergedInterval == 0 ? "once converged" : "%d frames");
+            ImGui::Text("Denoised:      %.0f%% of frames",
+                        scheduler.numFrames
+                        ? 100.f*scheduler.numDenoised/scheduler.numFrames : 0.f);
+            if (sample.numDenoiserTiles() > 1)
+              ImGui::Text("Denoiser Tiles: %d of %dx%d",sample.numDenoiserTiles(),
+                          sample.denoiserTileSize,sample.denoiserTileSize);
+          }
+          ImGui::Checkbox("Temporal Reprojection",&sample.temporalReprojection);
+          ImGui::Checkbox("Dynamic Resolution",&sample.dynamicResolution);
+          if (sample.dynamicResolution) {
+            const vec2i size = sample.launchParams.frame.size;
+            ImGui::Text("Render Scale:  %.2f (%dx%d)",
+                        sample.resolutionController.scale(),size.x,size.y);
+          }
+          ImGui::Checkbox("Auto Sample Count",&sample.autoSampleCount);
+          if (sample.autoSampleCount) {
+            auto &controller = sample.sampleController;
+            float budget = float(1000.*controller.frameBudget);
+            if (ImGui::SliderFloat("Frame Budget (ms)",&budget,0.f,100.f,
+                                   budget == 0.f ? "unlimited" : "%.1f"))
+              controller.frameBudget = 1e-3*budget;
+            const SamplePlan plan = controller.plan();
+            ImGui::Text("Samples:       %d spp x %d launches (%s samples/s)",
+                        plan.samplesPerLaunch,plan.numLaunches,
+                        prettyNumber((size_t)controller.samplesPerSecond()).c_str());
+          } else
+            ImGui::Text("Samples:       %d spp",sample.launchParams.numPixelSamples);
+          if (ImGui::Checkbox("Tiled Launches",&sample.tiledLaunches))
+            sample.launchParams.frame.frameID = 0;
+          if (sample.tiledLaunches) {
+            auto &scheduler = sample.tileScheduler;
+            float slice = float(1000.*scheduler.timeSlice);
+            if (ImGui::SliderFloat("Time Slice (ms)",&slice,0.f,100.f,
+                                   slice == 0.f ? "whole pass" : "%.1f"))
+              scheduler.timeSlice = 1e-3*slice;
+            const char *orders[TILE_ORDER_COUNT] = { "Scanline","Spiral","Hilbert" };
+            ImGui::Combo("Tile Order",&scheduler.order,orders,TILE_ORDER_COUNT);
+            ImGui::Text("Tile Pass:     %d tiles, %.0f%% done",
+                        scheduler.numTiles(),100.f*scheduler.progress());
+          }
+
+          auto &adaptive = sample.launchParams.adaptive;
+          bool adaptiveOn = adaptive.enabled;
+          if (ImGui::Checkbox("Adaptive Sampling",&adaptiveOn)) {
+            adaptive.enabled = adaptiveOn;
+            sample.launchParams.frame.frameID = 0;
+          }
+          if (adaptive.enabled) {
+            // (the statistics stay valid, so no need to restart)
+            ImGui::SliderFloat("Error Threshold",&adaptive.threshold,
+                               .002f,.2f,"%.3f",ImGuiSliderFlags_Logarithmic);
+            ImGui::Checkbox("Sample Heatmap",&sample.showSampleHeatmap);
+            if (sample.adaptiveActivePixels >= 0) {
+              const vec2i size = sample.launchParams.frame.size;
+              ImGui::Text("Active Pixels: %d (%.1f%%)%s",
+                          sample.adaptiveActivePixels,
+                          100.f*sample.adaptiveActivePixels/(size.x*size.y),
+                          sample.adaptiveConverged() ? " - converged" : "");
+            }
+          }
+          if (sample.wavefront)
+            ImGui::Text("Path Depth:    %d (wavefront: direct light only, no MIS)",
+                        sample.renderedMaxDepth());
+          else
+            ImGui::Text("Path Depth:    %d (%s)",
+                        sample.renderedMaxDepth(),
+                        sample.launchParams.path.recursive ? "Recursive" : "Iterative");
 
           ImGui::End();
       }
@@ -132,7 +289,12 @@ namespace opz {
     {
       fbSize = newSize;
       sample.resize(newSize);
-      pixels.resize(newSize.x*newSize.y);
+      if (interop) {
+        // (growing the buffers re-registers them)
+        sample.setDisplayBuffers(nullptr);
+        interop->resize(newSize);
+        sample.setDisplayBuffers(interop->resources.data());
+      }
     }
 
     virtual void keyAction(int key, int action, int mods)
@@ -179,13 +341,74 @@ namespace opz {
         sample.accumulate = !sample.accumulate;
         std::cout << "accumulation/progressive refinement now " << (sample.accumulate?"ON":"OFF") << std::endl;
       }
+      if ((key == 'H' || key == 'h') && action == GLFW_PRESS) {
+        sample.setSpecializedHitPrograms(!sample.specializedHitPrograms);
+        std::cout << "specialized closest-hit programs now "
+                  << (sample.specializedHitPrograms?"ON":"OFF") << std::endl;
+      }
+      if ((key == 'K' || key == 'k') && action == GLFW_PRESS) {
+        sample.benchmarkHitPrograms();
+      }
+      if ((key == 'M' || key == 'm') && action == GLFW_PRESS) {
+        sample.wavefront = !sample.wavefront;
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "wavefront renderer now "
+                  << (sample.wavefront?"ON (direct light only: max depth 1, no mis)":"OFF")
+                  << std::endl;
+      }
+      if ((key == 'V' || key == 'v') && action == GLFW_PRESS) {
+        sample.validateWavefront();
+      }
+      if (key == '[' && action == GLFW_PRESS) {
+        sample.launchParams.path.maxDepth
+          = std::max(1,sample.launchParams.path.maxDepth-1);
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "max path depth now "
+                  << sample.launchParams.path.maxDepth << std::endl;
+      }
+      if (key == ']' && action == GLFW_PRESS) {
+        sample.launchParams.path.maxDepth
+          = std::min(MAX_PATH_DEPTH,sample.launchParams.path.maxDepth+1);
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "max path depth now "
+                  << sample.launchParams.path.maxDepth << std::endl;
+      }
+      if ((key == 'P' || key == 'p') && action == GLFW_PRESS) {
+        sample.launchParams.path.recursive = !sample.launchParams.path.recursive;
+        std::cout << "recursive path tracing now "
+                  << (sample.launchParams.path.recursive?"ON":"OFF") << std::endl;
+      }
+      if ((key == 'B' || key == 'b') && action == GLFW_PRESS) {
+        sample.benchmarkPathTracing();
+      }
+      if ((key == 'L' || key == 'l') && action == GLFW_PRESS) {
+        sample.launchParams.misEnabled = !sample.launchParams.misEnabled;
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "mis for direct light now "
+                  << (sample.launchParams.misEnabled?"ON":"OFF") << std::endl;
+      }
+      if ((key == 'G' || key == 'g') && action == GLFW_PRESS) {
+        sample.launchParams.sampler
+          = (sample.launchParams.sampler+1) % SAMPLER_COUNT;
+        sample.launchParams.frame.frameID = 0;
+        std::cout << "sampler now "
+                  << (sample.launchParams.sampler == SAMPLER_BLUE_NOISE
+                      ? "blue-noise sobol" : "sobol") << std::endl;
+      }
+      if ((key == 'T' || key == 't') && action == GLFW_PRESS) {
+        sample.measureTimeToError();
+      }
+      // (setting the sample count by hand turns the controller off;
+      // accumulation just carries on with the new count)
       if (key == ',' && action == GLFW_PRESS) {
+        sample.autoSampleCount = false;
         sample.launchParams.numPixelSamples
           = std::max(1,sample.launchParams.numPixelSamples-1);
         std::cout << "num samples/pixel now "
                   << sample.launchParams.numPixelSamples << std::endl;
       }
       if (key == '.' && action == GLFW_PRESS) {
+        sample.autoSampleCount = false;
         sample.launchParams.numPixelSamples
           = std::max(1,sample.launchParams.numPixelSamples+1);
         std::cout << "num samples/pixel now "
@@ -209,7 +432,15 @@ namespace opz {
     vec2i                 fbSize;
     GLuint                fbTexture {0};
     SampleRenderer        sample;
-    std::vector<uint32_t> pixels;
+    /*! null if frames get downloaded instead */
+    std::unique_ptr<InteropDisplay> interop;
+    /*! ui thread to render() */
+    Mailbox<Camera>       cameraMailbox;
+    /*! @{ render() calls per second, as last measured */
+    float                 renderRate      = 0.f;
+    long long             renderRateCount = 0;
+    double                renderRateTime  = 0.;
+    /*! @} */
   };
   
   
@@ -229,6 +460,60 @@ namespace opz {
       "../models/sponza.obj"
 #endif
                              );
+
+      // optional offline look at the geometry the accel gets built
+      // over: '--bvh-stats' reports SAH quality, '--presplit' also
+      // splits long, thin triangles before we upload anything
+      bool bvhStats = false, presplit = false;
+      // '--cpu-denoiser' makes the host denoiser the one we render with
+      bool cpuDenoiser = false;
+      // '--denoiser-tile <n>' denoises frames bigger than n pixels in
+      // either dimension in tiles of n^2 pixels
+      int denoiserTileSize = 0;
+      // '--alloc-report' prints where device memory got allocated on
+      // exit; '--strict-alloc' throws on allocations in the render
+      // loop's hot path even in release builds
+      bool allocReport = false;
+      // '--no-interop' downloads every frame to the host and uploads
+      // it again, instead of showing it from gl buffers cuda wrote
+      bool useInterop = true;
+      // '--render-thread' renders on a thread of its own, as fast as
+      // it goes, and only shows the newest frame at display refresh
+      bool renderThread = false;
+      // '--no-sponza-light' leaves only the model's own (MTL Ke) emitters
+      bool sponzaLight = true;
+      // how to compile (and cache) the device programs
+      CompileConfig compileConfig;
+      for (int i=1;i<ac;i++) {
+        const std::string arg = av[i];
+        if (arg == "--bvh-stats") bvhStats = true;
+        else if (arg == "--presplit") presplit = true;
+        else if (arg == "--cpu-denoiser") cpuDenoiser = true;
+        else if (arg == "--denoiser-tile" && i+1<ac)
+          denoiserTileSize = atoi(av[++i]);
+        else if (arg == "--alloc-report") allocReport = true;
+        else if (arg == "--strict-alloc") AllocationTracker::get().strict = true;
+        else if (arg == "--no-sponza-light") sponzaLight = false;
+        else if (arg == "--no-interop") useInterop = false;
+        else if (arg == "--render-thread") renderThread = true;
+        else if (arg == "--compile-threads" && i+1<ac)
+          compileConfig.numThreads = atoi(av[++i]);
+        else if (arg == "--no-cache")
+          compileConfig.cacheEnabled = false;
+        else if (arg == "--cache-dir" && i+1<ac)
+          compileConfig.cacheLocation = av[++i];
+        else if (arg == "--cache-size" && i+1<ac)
+          // given in MB
+          compileConfig.cacheSizeInBytes = size_t(atoll(av[++i])) << 20;
+      }
+      if (bvhStats || presplit)
+        printBVHStats("as loaded",analyzeBVH(model));
+      if (presplit) {
+        const int numSplit = presplitTriangles(model);
+        std::cout << "#osc: pre-splitting added " << numSplit << " triangles" << std::endl;
+        printBVHStats("after pre-splitting",analyzeBVH(model));
+      }
+
       Camera camera = { /*from*/vec3f(-5.f,0.f,5.f),
           /* at */model->bounds.center(),
           /* up */vec3f(0.f,1.f,0.f) };
@@ -238,21 +523,42 @@ namespace opz {
       QuadLight light = { /* origin */ vec3f(-1000-light_size,800,-light_size),
                           /* edge 1 */ vec3f(2.f*light_size,0,0),
                           /* edge 2 */ vec3f(0,0,2.f*light_size),
-                          /* power */  vec3f(3000000.f) };
-                      
+                          /* power */  vec3f(3000000.f*float(M_PI)) };
+      // (power is radiant intensity; the pi makes up for the 1/pi of
+      // the diffuse brdf, which direct light used to leave out)
+      std::vector<QuadLight> quadLights;
+      if (sponzaLight) quadLights.push_back(light);
       // something approximating the scale of the world, so the
       // camera knows how much to move for any given user interaction:
       const float worldScale = length(model->bounds.span());
 
       SampleWindow *window = new SampleWindow("Optix 7 Project",
-                                              model,camera,light,worldScale);
+                                              model,camera,quadLights,worldScale,
+                                              compileConfig,useInterop);
       window->enableFlyMode();
+      window->renderThread = renderThread;
+      if (cpuDenoiser)
+        window->sample.denoiserBackend = DENOISER_BACKEND_CPU;
+      if (denoiserTileSize > 0)
+        window->sample.denoiserTileSize = denoiserTileSize;
       
       std::cout << "Press 'r' to enable/disable accumulation/progressive refinement" << std::endl;
       std::cout << "Press 'n' to enable/disable denoising" << std::endl;
       std::cout << "Press ',' to reduce the number of paths/pixel" << std::endl;
       std::cout << "Press '.' to increase the number of paths/pixel" << std::endl;
+      std::cout << "Press 'h' to toggle specialized/dynamic closest-hit programs" << std::endl;
+      std::cout << "Press 'k' to compare specialized and dynamic closest-hit program throughput" << std::endl;
+      std::cout << "Press 'm' to toggle megakernel/wavefront rendering (wavefront: depth 1, no mis)" << std::endl;
+      std::cout << "Press 'v' to check the wavefront queues against the CPU reference" << std::endl;
+      std::cout << "Press '[' / ']' to decrease/increase the max path depth" << std::endl;
+      std::cout << "Press 'p' to toggle iterative/recursive path tracing" << std::endl;
+      std::cout << "Press 'b' to compare iterative and recursive path tracing throughput" << std::endl;
+      std::cout << "Press 'l' to toggle mis / light sampling only for direct light" << std::endl;
+      std::cout << "Press 'g' to switch between sobol and blue-noise sobol sampling" << std::endl;
+      std::cout << "Press 't' to compare time to a target error with and without mis" << std::endl;
       window->run();
+      if (allocReport)
+        AllocationTracker::get().print();
       
     } catch (std::runtime_error& e) {
       std::cout << GDT_TERMINAL_RED << "FATAL ERROR: " << e.what()
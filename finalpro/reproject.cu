@@ -0,0 +1,118 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+
+#include "SampleRenderer.h"
+
+using namespace opz;
+
+namespace opz {
+
+  /*! blends each pixel's fresh first frame after a camera move (or
+      a change of render size) with the history it reprojects to in
+      the previous frame. each of the four bilinear taps only counts
+      if it saw (about) the same surface - same position and
+      orientation - so disoccluded pixels start over; reprojected
+      history is capped at maxHistory frames' worth of samples, which
+      bounds how long any smearing sticks around */
+  __global__ void reprojectHistoryKernel(float4       *colorBuffer,
+                                         float        *historyBuffer,
+                                         const float4 *positionBuffer,
+                                         PixelBuffer   normalBuffer,
+                                         const float4 *prevColorBuffer,
+                                         const float  *prevHistoryBuffer,
+                                         const float4 *prevPositionBuffer,
+                                         PixelBuffer   prevNormalBuffer,
+                                         vec2i         size,
+                                         vec2i         prevSize,
+                                         LaunchCamera  prevCamera,
+                                         float         maxHistory)
+  {
+    int pixelX = threadIdx.x + blockIdx.x*blockDim.x;
+    int pixelY = threadIdx.y + blockIdx.y*blockDim.y;
+    if (pixelX >= size.x) return;
+    if (pixelY >= size.y) return;
+
+    int pixelID = pixelX + size.x*pixelY;
+
+    const vec4f position = positionBuffer[pixelID];
+    // background pixels have nothing to reproject by
+    if (position.w == 0.f) return;
+    const vec3f P = vec3f(position);
+    const vec3f N = normalize(vec3f(normalBuffer.read(pixelID)));
+
+    vec2f prevPixel;
+    if (!projectToPixel(prevCamera,prevSize,P,prevPixel)) return;
+
+    // surfaces closer than this (relative to their distance) count
+    // as the same
+    const float maxDistance = 1e-2f * length(P - prevCamera.position);
+    const int   x0 = (int)floorf(prevPixel.x);
+    const int   y0 = (int)floorf(prevPixel.y);
+    const float fx = prevPixel.x - x0;
+    const float fy = prevPixel.y - y0;
+
+    vec4f color   = 0.f;
+    float history = 0.f;
+    float weight  = 0.f;
+    for (int tap=0;tap<4;tap++) {
+      const int tx = x0 + (tap & 1);
+      const int ty = y0 + (tap >> 1);
+      if (tx < 0 || ty < 0 || tx >= prevSize.x || ty >= prevSize.y) continue;
+      const int prevID = tx + prevSize.x*ty;
+      const vec4f prevPosition = prevPositionBuffer[prevID];
+      if (prevPosition.w == 0.f) continue;
+      if (length(vec3f(prevPosition) - P) > maxDistance) continue;
+      if (dot(normalize(vec3f(prevNormalBuffer.read(prevID))),N) < .9f) continue;
+      const float w = ((tap & 1) ? fx : 1.f-fx) * ((tap >> 1) ? fy : 1.f-fy);
+      color   += w * vec4f(prevColorBuffer[prevID]);
+      history += w * prevHistoryBuffer[prevID];
+      weight  += w;
+    }
+    if (weight < 1e-2f) return;
+
+    // (the fresh frame's history is the samples it just took)
+    const float fresh = historyBuffer[pixelID];
+    color   /= weight;
+    history  = fminf(history/weight,maxHistory*fresh);
+    colorBuffer[pixelID]
+      = (float4)((history*color + fresh*vec4f(colorBuffer[pixelID])) / (history+fresh));
+    historyBuffer[pixelID] = history+fresh;
+  }
+
+  void SampleRenderer::reprojectHistory()
+  {
+    vec2i fbSize = launchParams.frame.size;
+    vec2i blockSize = 32;
+    vec2i numBlocks = divRoundUp(fbSize,blockSize);
+    reprojectHistoryKernel
+      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y),0,stream>>>
+      (launchParams.frame.colorBuffer,
+       launchParams.frame.historyBuffer,
+       launchParams.frame.positionBuffer,
+       launchParams.frame.normalBuffer,
+       (const float4*)prevColor.d_pointer(),
+       (const float *)prevHistory.d_pointer(),
+       (const float4*)prevPosition.d_pointer(),
+       PixelBuffer{ (void*)prevNormal.d_pointer(),guideFormat },
+       fbSize,
+       reprojectionSize,
+       reprojectionCamera,
+       (float)maxHistoryFrames);
+  }
+  
+} // ::osc
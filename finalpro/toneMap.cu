@@ -36,19 +36,39 @@ namespace opz {
                        clampf(f.w));
   }
   
-  /*! runs a cuda kernel that performs gamma correction and float4-to-rgba conversion */
-  __global__ void computeFinalPixelColorsKernel(uint32_t *finalColorBuffer,
-                                                float4   *denoisedBuffer,
-                                                vec2i     size)
+  /*! bilinear lookup into a (densely packed) image of 'size', at the
+      center of display pixel (x,y) of an image of 'displaySize' */
+  inline __device__ vec4f upscale(const PixelBuffer &image, vec2i size,
+                                  int x, int y, vec2i displaySize)
+  {
+    if (size == displaySize) return image.read(x + size.x*y);
+    const float fx = (x+.5f)*size.x/displaySize.x - .5f;
+    const float fy = (y+.5f)*size.y/displaySize.y - .5f;
+    const int   x0 = max(0,min(size.x-1,(int)floorf(fx)));
+    const int   y0 = max(0,min(size.y-1,(int)floorf(fy)));
+    const int   x1 = min(size.x-1,x0+1);
+    const int   y1 = min(size.y-1,y0+1);
+    const float wx = clampf(fx-x0), wy = clampf(fy-y0);
+    return
+      (1.f-wy) * ((1.f-wx)*image.read(x0+size.x*y0) + wx*image.read(x1+size.x*y0))
+      +     wy * ((1.f-wx)*image.read(x0+size.x*y1) + wx*image.read(x1+size.x*y1));
+  }
+  
+  /*! runs a cuda kernel that performs gamma correction and float4-to-rgba conversion,
+      upscaling from the render size to the display size if those differ */
+  __global__ void computeFinalPixelColorsKernel(uint32_t    *finalColorBuffer,
+                                                PixelBuffer  image,
+                                                vec2i        size,
+                                                vec2i        displaySize)
   {
     int pixelX = threadIdx.x + blockIdx.x*blockDim.x;
     int pixelY = threadIdx.y + blockIdx.y*blockDim.y;
-    if (pixelX >= size.x) return;
-    if (pixelY >= size.y) return;
+    if (pixelX >= displaySize.x) return;
+    if (pixelY >= displaySize.y) return;
 
-    int pixelID = pixelX + size.x*pixelY;
+    int pixelID = pixelX + displaySize.x*pixelY;
 
-    float4 f4 = denoisedBuffer[pixelID];
+    float4 f4 = (float4)upscale(image,size,pixelX,pixelY,displaySize);
     f4 = clamp(sqrt(f4));
     uint32_t rgba = 0;
     rgba |= (uint32_t)(f4.x * 255.9f) <<  0;
@@ -58,16 +78,76 @@ namespace opz {
     finalColorBuffer[pixelID] = rgba;
   }
 
+  /*! blue (no samples) to red (maxScale times the uniform count) */
+  inline __device__ vec3f heatmapColor(float t)
+  {
+    t = clampf(t);
+    return vec3f(clampf(1.5f-fabsf(4.f*t-3.f)),
+                 clampf(1.5f-fabsf(4.f*t-2.f)),
+                 clampf(1.5f-fabsf(4.f*t-1.f)));
+  }
+
+  /*! color-codes each pixel's sample count relative to what uniform
+      sampling would have spent; converged pixels are dimmed */
+  __global__ void computeSampleHeatmapKernel(uint32_t     *finalColorBuffer,
+                                             const float4 *statsBuffer,
+                                             vec2i         size,
+                                             vec2i         displaySize,
+                                             float         uniformSamples,
+                                             float         maxScale)
+  {
+    int pixelX = threadIdx.x + blockIdx.x*blockDim.x;
+    int pixelY = threadIdx.y + blockIdx.y*blockDim.y;
+    if (pixelX >= displaySize.x) return;
+    if (pixelY >= displaySize.y) return;
+
+    int pixelID = pixelX + displaySize.x*pixelY;
+
+    // (nearest, not bilinear: these are counts)
+    const int statsX = pixelX*size.x/displaySize.x;
+    const int statsY = pixelY*size.y/displaySize.y;
+    const float4 stats = statsBuffer[statsX + size.x*statsY];
+    vec3f color = heatmapColor(stats.x / (uniformSamples*maxScale));
+    if (stats.w == 0.f) color *= .5f;
+    uint32_t rgba = 0;
+    rgba |= (uint32_t)(color.x * 255.9f) <<  0;
+    rgba |= (uint32_t)(color.y * 255.9f) <<  8;
+    rgba |= (uint32_t)(color.z * 255.9f) << 16;
+    rgba |= (uint32_t)255                << 24;
+    finalColorBuffer[pixelID] = rgba;
+  }
+
+  void SampleRenderer::computeSampleHeatmap()
+  {
+    vec2i fbSize = launchParams.frame.size;
+    vec2i blockSize = 32;
+    vec2i numBlocks = divRoundUp(displaySize,blockSize);
+    const float uniformSamples
+      = std::max(1.f,float(launchParams.frame.firstSampleIndex));
+    computeSampleHeatmapKernel
+      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y),0,stream>>>
+      (frameSlots[currentSlot].displayPixels,
+       (const float4*)adaptiveStats.d_pointer(),
+       fbSize,
+       displaySize,
+       uniformSamples,
+       launchParams.adaptive.maxScale);
+  }
+
   void SampleRenderer::computeFinalPixelColors()
   {
     vec2i fbSize = launchParams.frame.size;
     vec2i blockSize = 32;
-    vec2i numBlocks = divRoundUp(fbSize,blockSize);
+    vec2i numBlocks = divRoundUp(displaySize,blockSize);
     computeFinalPixelColorsKernel
-      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y)>>>
-      ((uint32_t*)finalColorBuffer.d_pointer(),
-       (float4*)denoisedBuffer.d_pointer(),
-       fbSize);
+      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y),0,stream>>>
+      (frameSlots[currentSlot].displayPixels,
+       // (without a denoiser, straight from the accumulation)
+       denoiserOn
+       ? PixelBuffer{ (void*)denoisedBuffer.d_pointer(),denoisedFormat }
+       : PixelBuffer{ (void*)fbColor.d_pointer(),PIXEL_FLOAT4 },
+       fbSize,
+       displaySize);
   }
   
 } // ::osc
@@ -0,0 +1,150 @@
+// ======================================================================== //
+// Copyright 2022-2023 ZYM-PKU                                           //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "SampleRenderer.h"
+
+using namespace opz;
+
+namespace opz {
+
+  // ------------------------------------------------------------------
+  // sorting the wavefront hit queue by material: histogram, scan,
+  // scatter. the number of hits is only known on the device, so all
+  // kernels get launched over the full queue capacity and check the
+  // counter themselves
+  // ------------------------------------------------------------------
+  
+  __global__ void materialHistogramKernel(const WavefrontHit *hits,
+                                          const int          *counters,
+                                          const MeshData     *meshes,
+                                          int                *materialOffsets)
+  {
+    int hitID = threadIdx.x + blockIdx.x*blockDim.x;
+    if (hitID >= counters[WF_NUM_HITS]) return;
+    atomicAdd(&materialOffsets[meshes[hits[hitID].meshID].materialID],1);
+  }
+
+  /*! exclusive scan over the per-material counts; there's only ever
+      a few dozen materials, so a single thread does fine */
+  __global__ void materialScanKernel(int *materialOffsets, int numMaterials)
+  {
+    int sum = 0;
+    for (int materialID=0;materialID<numMaterials;materialID++) {
+      int count = materialOffsets[materialID];
+      materialOffsets[materialID] = sum;
+      sum += count;
+    }
+  }
+
+  __global__ void materialScatterKernel(const WavefrontHit *hits,
+                                        const int          *counters,
+                                        const MeshData     *meshes,
+                                        int                *materialOffsets,
+                                        WavefrontHit       *sortedHits)
+  {
+    int hitID = threadIdx.x + blockIdx.x*blockDim.x;
+    if (hitID >= counters[WF_NUM_HITS]) return;
+    const WavefrontHit hit = hits[hitID];
+    int slot = atomicAdd(&materialOffsets[meshes[hit.meshID].materialID],1);
+    sortedHits[slot] = hit;
+  }
+
+  void SampleRenderer::sortHitsByMaterial(int numRays)
+  {
+    const int numMaterials = (int)sceneTables.materials.size();
+    const int blockSize = 128;
+    const int numBlocks = divRoundUp(numRays,blockSize);
+    const WavefrontQueues &wf = launchParams.wavefront;
+    
+    CUDA_CHECK(MemsetAsync((void*)wfMaterialOffsets.d_pointer(),0,
+                           numMaterials*sizeof(int),stream));
+    materialHistogramKernel
+      <<<numBlocks,blockSize,0,stream>>>
+      (wf.hits,wf.counters,launchParams.meshes,
+       (int*)wfMaterialOffsets.d_pointer());
+    materialScanKernel
+      <<<1,1,0,stream>>>
+      ((int*)wfMaterialOffsets.d_pointer(),numMaterials);
+    materialScatterKernel
+      <<<numBlocks,blockSize,0,stream>>>
+      (wf.hits,wf.counters,launchParams.meshes,
+       (int*)wfMaterialOffsets.d_pointer(),wf.sortedHits);
+  }
+
+  // ------------------------------------------------------------------
+  // turning the per-pixel sums into this frame's color, normal and
+  // albedo buffers - same accumulation as __raygen__renderFrame
+  // ------------------------------------------------------------------
+  
+  __global__ void resolveWavefrontKernel(float4       *colorBuffer,
+                                         PixelBuffer   normalBuffer,
+                                         PixelBuffer   albedoBuffer,
+                                         vec2i         size,
+                                         float         numAccumulated,
+                                         const float4 *colorSum,
+                                         const float4 *normalSum,
+                                         const float4 *albedoSum,
+                                         int numPixelSamples)
+  {
+    int pixelX = threadIdx.x + blockIdx.x*blockDim.x;
+    int pixelY = threadIdx.y + blockIdx.y*blockDim.y;
+    if (pixelX >= size.x) return;
+    if (pixelY >= size.y) return;
+
+    int pixelID = pixelX + size.x*pixelY;
+    const float scale = 1.f/numPixelSamples;
+
+    vec4f rgba(colorSum[pixelID].x*scale,
+               colorSum[pixelID].y*scale,
+               colorSum[pixelID].z*scale,
+               1.f);
+    if (numAccumulated > 0.f) {
+      rgba
+        = (numAccumulated*vec4f(colorBuffer[pixelID]) + float(numPixelSamples)*rgba)
+        / (numAccumulated+numPixelSamples);
+    }
+    colorBuffer[pixelID]  = (float4)rgba;
+    normalBuffer.write(pixelID,vec4f(normalSum[pixelID].x*scale,
+                                     normalSum[pixelID].y*scale,
+                                     normalSum[pixelID].z*scale,
+                                     1.f));
+    albedoBuffer.write(pixelID,vec4f(albedoSum[pixelID].x*scale,
+                                     albedoSum[pixelID].y*scale,
+                                     albedoSum[pixelID].z*scale,
+                                     1.f));
+  }
+
+  void SampleRenderer::resolveWavefrontFrame()
+  {
+    vec2i fbSize = launchParams.frame.size;
+    vec2i blockSize = 32;
+    vec2i numBlocks = divRoundUp(fbSize,blockSize);
+    resolveWavefrontKernel
+      <<<dim3(numBlocks.x,numBlocks.y),dim3(blockSize.x,blockSize.y),0,stream>>>
+      (launchParams.frame.colorBuffer,
+       launchParams.frame.normalBuffer,
+       launchParams.frame.albedoBuffer,
+       fbSize,
+       // (every pixel took firstSampleIndex samples before this frame)
+       (float)launchParams.frame.firstSampleIndex,
+       launchParams.wavefront.colorSum,
+       launchParams.wavefront.normalSum,
+       launchParams.wavefront.albedoSum,
+       launchParams.numPixelSamples);
+  }
+  
+} // ::osc